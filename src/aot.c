@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include "aot.h"
+#include "context.h"
+#include "environment.h"
+#include "symbol.h"
+
+/*
+ * Unboxes the 'arity' arguments 'bound' followed by 'args' into 'out'.
+ * Returns 0 if any of them is not an integer.
+ */
+int laot_int_args(struct lvalue **bound, size_t bound_count, struct lvalue **args, size_t arity, long long *out) {
+    for ( size_t i = 0; i < arity; ++i ) {
+        struct lvalue *arg = i < bound_count ? bound[i] : args[i - bound_count];
+        if ( arg->type != LVAL_INT ) {
+            return 0;
+        }
+        out[i] = arg->val.intval;
+    }
+    return 1;
+}
+
+/*
+ * Whether every guarded name is still bound globally, and only globally,
+ * to what the C code was compiled against.
+ */
+int laot_guards_hold(struct laot_guard *guards, size_t count) {
+    for ( size_t i = 0; i < count; ++i ) {
+        struct laot_guard *g = &guards[i];
+        if ( g->sym->shadows != 0 || g->sym->global == NULL ) {
+            return 0;
+        }
+        struct lvalue *v = g->sym->global->envval;
+        if ( v->type != g->type ) {
+            return 0;
+        }
+        if ( v->type == LVAL_BUILTIN ? v->val.builtin != g->builtin : v->val.fun->native != g->native ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* whether the guards on builtins hold; the functions are not defined yet */
+static int laot_builtins_hold(struct laot_guard *guards, size_t count) {
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( guards[i].type == LVAL_BUILTIN && !laot_guards_hold(&guards[i], 1) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void laot_resolve(struct lisper_ctx *ctx, struct laot_guard *guards, size_t count) {
+    for ( size_t i = 0; i < count; ++i ) {
+        struct laot_guard *g = &guards[i];
+        g->sym = lsymbol_of(lsymtab_intern(&ctx->symbols, g->name));
+        g->builtin = NULL;
+        if ( g->type == LVAL_BUILTIN && g->sym->global != NULL && g->sym->global->envval->type == LVAL_BUILTIN ) {
+            g->builtin = g->sym->global->envval->val.builtin;
+        }
+    }
+}
+
+/*
+ * Runs the top-level forms of a compiled program like 'load' runs the
+ * forms of a file; errors are printed and do not stop the program.
+ * The C code of a function is attached to it right after the form that
+ * defines it, provided the defining builtins were not rebound.
+ */
+int laot_run(struct lisper_ctx *ctx, struct laot_form *forms, size_t count) {
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+
+    for ( size_t i = 0; i < count; ++i ) {
+        laot_resolve(ctx, forms[i].definers, forms[i].definer_count);
+        laot_resolve(ctx, forms[i].guards, forms[i].guard_count);
+    }
+
+    for ( size_t i = 0; i < count; ++i ) {
+        struct laot_form *form = &forms[i];
+        struct lvalue *x = lvalue_eval(ctx->env, form->build());
+        int failed = x->type == LVAL_ERR;
+        if ( failed ) {
+            lvalue_println(x);
+        }
+        lvalue_del(x);
+
+        if ( failed || form->defines == NULL || !laot_guards_hold(form->definers, form->definer_count) ||
+            !laot_builtins_hold(form->guards, form->guard_count) ) {
+            continue;
+        }
+        struct lsymbol *sym = lsymbol_of(lsymtab_intern(&ctx->symbols, form->defines));
+        if ( sym->global != NULL && sym->global->envval->type == LVAL_FUNCTION ) {
+            sym->global->envval->val.fun->native = form->native;
+        }
+    }
+
+    lisper_ctx_enter(prev);
+    return 0;
+}
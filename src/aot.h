@@ -0,0 +1,78 @@
+#ifndef LISPER_AOT
+#define LISPER_AOT
+
+#include <stdlib.h>
+#include "value.h"
+
+/*
+ * Runtime of programs compiled ahead of time by 'lisper --emit-c'.
+ *
+ * A compiled program is a table of top-level forms, each built as an
+ * lvalue and run by the embedded interpreter in order. Functions whose
+ * body is integer arithmetic, comparisons, 'if', '&&', '||' and calls of
+ * other compiled functions are also translated to C, and that code is
+ * attached to the function once its definition has been evaluated.
+ */
+
+struct lsymbol;
+
+/* a name the C code of a function was specialized to the binding of */
+struct laot_guard {
+    const char *name;
+    enum ltype type; /* LVAL_BUILTIN or LVAL_FUNCTION */
+    lnative_fn native; /* code of the function expected to be bound */
+    struct lsymbol *sym; /* set by laot_run */
+    const struct lbuiltin *builtin; /* builtin bound at startup; set by laot_run */
+};
+
+/* a top-level form of a compiled program */
+struct laot_form {
+    struct lvalue *(*build)(void);
+    const char *defines; /* function the form defines, if it has C code */
+    lnative_fn native;
+    struct laot_guard *definers; /* builtins the form defines the function with */
+    size_t definer_count;
+    struct laot_guard *guards; /* free names of the body; checked on every call */
+    size_t guard_count;
+};
+
+int laot_run(struct lisper_ctx *, struct laot_form *, size_t);
+int laot_int_args(struct lvalue **, size_t, struct lvalue **, size_t, long long *);
+int laot_guards_hold(struct laot_guard *, size_t);
+
+/* integer arithmetic of the interpreter; wraps around on overflow */
+
+static inline long long laot_add(long long a, long long b) {
+    return (long long) ((unsigned long long) a + (unsigned long long) b);
+}
+
+static inline long long laot_sub(long long a, long long b) {
+    return (long long) ((unsigned long long) a - (unsigned long long) b);
+}
+
+static inline long long laot_mul(long long a, long long b) {
+    return (long long) ((unsigned long long) a * (unsigned long long) b);
+}
+
+static inline long long laot_neg(long long a) {
+    return (long long) (0ULL - (unsigned long long) a);
+}
+
+/* division by zero is an error of the interpreter; raise 'deopt' to have it run the call */
+static inline long long laot_div(long long a, long long b, char *deopt) {
+    if ( b == 0 ) {
+        *deopt = 1;
+        return 0;
+    }
+    return b == -1 ? laot_neg(a) : a / b;
+}
+
+static inline long long laot_mod(long long a, long long b, char *deopt) {
+    if ( b == 0 ) {
+        *deopt = 1;
+        return 0;
+    }
+    return b == -1 ? 0 : a % b;
+}
+
+#endif
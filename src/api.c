@@ -0,0 +1,105 @@
+
+#include <stdlib.h>
+#include "lisper.h"
+#include "context.h"
+#include "builtin.h"
+#include "environment.h"
+#include "value.h"
+
+struct lisper_ctx *lisper_create(int argc, char **argv) {
+    return lisper_ctx_new(argc, argv);
+}
+
+void lisper_destroy(struct lisper_ctx *ctx) {
+    lisper_ctx_del(ctx);
+}
+
+struct lisper_ctx *lisper_use(struct lisper_ctx *ctx) {
+    return lisper_ctx_enter(ctx);
+}
+
+/*
+ * Load and evaluate a source file in the global environment.
+ * Returns the empty s-expression on success or an error value.
+ */
+struct lvalue *lisper_load(struct lisper_ctx *ctx, const char *path) {
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+    lbudget_start(ctx, &ctx->limits);
+
+    struct lvalue *args = lvalue_add(lvalue_sexpr(), lvalue_str((char *) path));
+    struct lvalue *res = builtin_load(ctx->env, args);
+
+    lisper_ctx_enter(prev);
+    return res;
+}
+
+/*
+ * Evaluate every top-level expression of 'source' in order.
+ * Returns the value of the last expression, or the first error.
+ */
+struct lvalue *lisper_eval(struct lisper_ctx *ctx, const char *source) {
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+    struct lvalue *res = NULL;
+    mpc_result_t r;
+    lbudget_start(ctx, &ctx->limits);
+
+    if ( mpc_parse("<embed>", source, ctx->elems.Lisper, &r) ) {
+        struct lvalue *expr = lvalue_read(r.output);
+        mpc_ast_delete(r.output);
+
+        res = lvalue_sexpr();
+        while ( expr->val.l.count ) {
+            lvalue_del(res);
+            res = lvalue_eval(ctx->env, lvalue_pop(expr, 0));
+            if ( res->type == LVAL_ERR ) {
+                break;
+            }
+        }
+        lvalue_del(expr);
+    } else {
+        char *err_msg = mpc_err_string(r.error);
+        mpc_err_delete(r.error);
+
+        res = lvalue_err("Could not parse source %s", err_msg);
+        free(err_msg);
+    }
+
+    lisper_ctx_enter(prev);
+    return res;
+}
+
+/*
+ * Call the function bound to 'name' in the global environment.
+ * Ownership of the argument values is transferred to the call.
+ */
+struct lvalue *lisper_call(struct lisper_ctx *ctx, const char *name, size_t argc, struct lvalue **argv) {
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+
+    struct lvalue *sym = lvalue_sym((char *) name);
+    struct lvalue *expr = lvalue_add(lvalue_sexpr(), lenvironment_get(ctx->env, sym));
+    lvalue_del(sym);
+
+    for ( size_t i = 0; i < argc; ++i ) {
+        lvalue_add(expr, argv[i]);
+    }
+
+    lbudget_start(ctx, &ctx->limits);
+    struct lvalue *res = lvalue_eval(ctx->env, expr);
+
+    lisper_ctx_enter(prev);
+    return res;
+}
+
+void lisper_value_del(struct lisper_ctx *ctx, struct lvalue *v) {
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+    lvalue_del(v);
+    lisper_ctx_enter(prev);
+}
+
+/*
+ * Stops the evaluation in progress with an error. Returns 1 if the
+ * previous interrupt has not been seen by the evaluation yet.
+ */
+int lisper_interrupt(struct lisper_ctx *ctx) {
+    return lbudget_interrupt(&ctx->budget);
+}
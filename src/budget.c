@@ -0,0 +1,189 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* clock_gettime */
+#endif
+#include <stdint.h>
+#include <time.h>
+#include "budget.h"
+#include "context.h"
+#include "mempool.h"
+#include "value.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+/* nanoseconds of the monotonic clock */
+long long lbudget_now(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Bytes in use by the lvalues of the interpreter, and where the C
+ * library can tell, by the heap of the process.
+ */
+size_t lbudget_heap(struct lisper_ctx *ctx) {
+    size_t used = mempool_used(ctx->lvalue_mp);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    used += mi.uordblks + mi.hblkhd;
+#endif
+    return used;
+}
+
+void lbudget_init(struct lbudget *b) {
+    b->steps = 0;
+    b->check_at = 0;
+    b->step_limit = SIZE_MAX;
+    b->depth = 0;
+    b->depth_limit = SIZE_MAX;
+    b->deadline = 0;
+    b->heap_limit = 0;
+    b->bounded = 0;
+    b->tripped = LBUDGET_OK;
+    b->interrupt = 0;
+    b->hangup_fd = -1;
+}
+
+/*
+ * Starts a new evaluation held to 'limits', whatever the limits of
+ * the previous one were. A pending interrupt is dropped.
+ */
+void lbudget_start(struct lisper_ctx *ctx, const struct lbudget_limits *limits) {
+    struct lbudget *b = &ctx->budget;
+    b->step_limit = SIZE_MAX;
+    b->depth_limit = SIZE_MAX;
+    b->deadline = 0;
+    b->heap_limit = 0;
+    b->tripped = LBUDGET_OK;
+    b->interrupt = 0;
+    lbudget_narrow(ctx, limits);
+}
+
+/*
+ * Holds the rest of the evaluation to 'limits' as well, counted from
+ * now. Limits are only ever tightened; the ones in force stay.
+ */
+void lbudget_narrow(struct lisper_ctx *ctx, const struct lbudget_limits *limits) {
+    struct lbudget *b = &ctx->budget;
+
+    size_t steps_left = b->step_limit > b->steps ? b->step_limit - b->steps : 0;
+    if ( limits->steps != 0 && limits->steps < steps_left ) {
+        b->step_limit = b->steps + limits->steps;
+    }
+
+    size_t depth_left = b->depth_limit > b->depth ? b->depth_limit - b->depth : 0;
+    if ( limits->depth != 0 && limits->depth < depth_left ) {
+        b->depth_limit = b->depth + limits->depth;
+    }
+
+    if ( limits->time_ms != 0 ) {
+        long long deadline = lbudget_now() + (long long) limits->time_ms * 1000000LL;
+        if ( b->deadline == 0 || deadline < b->deadline ) {
+            b->deadline = deadline;
+        }
+    }
+
+    if ( limits->heap != 0 ) {
+        size_t heap_limit = lbudget_heap(ctx) + limits->heap;
+        if ( b->heap_limit == 0 || heap_limit < b->heap_limit ) {
+            b->heap_limit = heap_limit;
+        }
+    }
+
+    b->bounded = b->step_limit != SIZE_MAX || b->depth_limit != SIZE_MAX || b->deadline != 0 || b->heap_limit != 0;
+    b->check_at = 0;
+}
+
+/*
+ * Puts back the limits 'saved' by lbudget_narrow's caller. The steps
+ * taken meanwhile count against them, and an interrupt or hangup stays.
+ */
+void lbudget_restore(struct lisper_ctx *ctx, const struct lbudget *saved) {
+    struct lbudget *b = &ctx->budget;
+    b->step_limit = saved->step_limit;
+    b->depth_limit = saved->depth_limit;
+    b->deadline = saved->deadline;
+    b->heap_limit = saved->heap_limit;
+    b->bounded = saved->bounded;
+    if ( b->tripped != LBUDGET_INTERRUPT && b->tripped != LBUDGET_HANGUP ) {
+        b->tripped = saved->tripped;
+    }
+    b->check_at = 0;
+}
+
+/*
+ * Asks the evaluation in progress to stop. Only sets a flag, so it may
+ * be called from a signal handler. Returns 1 if the previous request
+ * has not been seen by the evaluator yet.
+ */
+int lbudget_interrupt(struct lbudget *b) {
+    int pending = b->interrupt;
+    b->interrupt = 1;
+    return pending;
+}
+
+/* the peer of the connection 'fd' has gone */
+static int lbudget_hung_up(int fd) {
+#ifndef _WIN32
+    struct pollfd p = { fd, 0, 0 };
+    return poll(&p, 1, 0) > 0 && (p.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0;
+#else
+    (void) fd;
+    return 0;
+#endif
+}
+
+/*
+ * Slow path of the step counter. Returns NULL if the evaluation may go
+ * on, or the error it stops with.
+ */
+struct lvalue *lbudget_check(struct lisper_ctx *ctx) {
+    struct lbudget *b = &ctx->budget;
+
+    if ( b->tripped == LBUDGET_OK ) {
+        if ( b->interrupt ) {
+            b->interrupt = 0;
+            b->tripped = LBUDGET_INTERRUPT;
+        } else if ( b->steps > b->step_limit ) {
+            b->tripped = LBUDGET_STEPS;
+        } else if ( b->deadline != 0 && lbudget_now() >= b->deadline ) {
+            b->tripped = LBUDGET_TIME;
+        } else if ( b->heap_limit != 0 && lbudget_heap(ctx) > b->heap_limit ) {
+            b->tripped = LBUDGET_HEAP;
+        } else if ( b->hangup_fd >= 0 && lbudget_hung_up(b->hangup_fd) ) {
+            b->tripped = LBUDGET_HANGUP;
+        }
+    }
+
+    /* once tripped, every step comes back here */
+    b->check_at = 0;
+    switch ( b->tripped ) {
+        case LBUDGET_OK:
+            if ( b->step_limit - b->steps < LBUDGET_CHECK_INTERVAL ) {
+                b->check_at = b->step_limit + 1;
+            } else {
+                b->check_at = b->steps + LBUDGET_CHECK_INTERVAL;
+            }
+            return NULL;
+        case LBUDGET_STEPS:
+            return lvalue_err("Evaluation exceeded its step limit.");
+        case LBUDGET_TIME:
+            return lvalue_err("Evaluation exceeded its time limit.");
+        case LBUDGET_HEAP:
+            return lvalue_err("Evaluation exceeded its heap limit.");
+        case LBUDGET_INTERRUPT:
+            return lvalue_err("Evaluation interrupted.");
+        case LBUDGET_HANGUP:
+            return lvalue_err("Evaluation stopped; its client hung up.");
+    }
+    return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef LISPER_BUDGET
+#define LISPER_BUDGET
+
+#include <stdlib.h>
+#include <signal.h>
+
+struct lisper_ctx;
+struct lvalue;
+
+/* steps evaluated between checks of the clock, the heap and interrupts */
+#define LBUDGET_CHECK_INTERVAL 1024
+
+/* limits of an evaluation; 0 is no limit */
+struct lbudget_limits {
+    size_t steps; /* s-expressions evaluated and sequence elements produced */
+    size_t time_ms; /* wall time */
+    size_t heap; /* bytes allocated on top of those in use when the evaluation starts */
+    size_t depth; /* nested calls of interpreted functions */
+};
+
+enum lbudget_trip {
+    LBUDGET_OK,
+    LBUDGET_STEPS,
+    LBUDGET_TIME,
+    LBUDGET_HEAP,
+    LBUDGET_INTERRUPT,
+    LBUDGET_HANGUP
+};
+
+/*
+ * Limits the evaluation in progress is held to. Steps are counted by
+ * the evaluator and compared against 'check_at' alone; the slower
+ * checks run once every LBUDGET_CHECK_INTERVAL steps. Once a limit is
+ * exceeded every step fails, so the evaluation unwinds through the
+ * usual error values.
+ */
+struct lbudget {
+    size_t steps; /* s-expressions evaluated so far */
+    size_t check_at; /* 'steps' at which the limits are checked next */
+    size_t step_limit; /* SIZE_MAX for no limit */
+    size_t depth; /* calls of interpreted functions in progress */
+    size_t depth_limit; /* SIZE_MAX for no limit */
+    long long deadline; /* monotonic nanoseconds; 0 for no limit */
+    size_t heap_limit; /* bytes in use; 0 for no limit */
+    int bounded; /* some limit is set; compiled code is bypassed so it holds */
+    enum lbudget_trip tripped;
+    volatile sig_atomic_t interrupt; /* set by lbudget_interrupt */
+    int hangup_fd; /* connection whose hangup stops the evaluation; -1 for none */
+};
+
+long long lbudget_now(void);
+void lbudget_init(struct lbudget *);
+void lbudget_start(struct lisper_ctx *, const struct lbudget_limits *);
+void lbudget_narrow(struct lisper_ctx *, const struct lbudget_limits *);
+void lbudget_restore(struct lisper_ctx *, const struct lbudget *saved);
+int lbudget_interrupt(struct lbudget *);
+struct lvalue *lbudget_check(struct lisper_ctx *);
+size_t lbudget_heap(struct lisper_ctx *);
+
+#endif
@@ -1,10 +1,24 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include "lisper.h"
 #include "builtin.h"
 #include "grammar.h"
 #include "value.h"
 #include "environment.h"
+#include "context.h"
+#include "memo.h"
+#include "seq.h"
+#include "coro.h"
+#include "parse.h"
+#include "module.h"
+#include "re.h"
+#include "number.h"
+#include "writer.h"
+#include "reader.h"
+#include "symbol.h"
+#include "mempool.h"
+#include "probe.h"
 
 #define LGETCELL(v, celln) v->val.l.cells[celln]
 
@@ -30,227 +44,177 @@
 #define LTWO_ARG_TYPES(lval, func_name, i, first_expect, second_expect) \
     LASSERT(lval, lval->val.l.cells[i]->type == first_expect || lval->val.l.cells[i]->type == second_expect, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s' or '%s'; got '%s'.", func_name, ltype_name(first_expect), ltype_name(second_expect), ltype_name(lval->val.l.cells[i]->type))
 
-#define LENV_BUILTIN(name) lenvironment_add_builtin(e, #name, builtin_##name)
-#define LENV_SYMBUILTIN(sym, name) lenvironment_add_builtin(e, sym, builtin_##name)
+#define LENV_BUILTIN(name) LENV_SYMBUILTIN(#name, name)
+#define LENV_SYMBUILTIN(sym, name) do { \
+    static const struct lbuiltin desc = { sym, builtin_##name, NULL }; \
+    lenvironment_add_builtin(e, &desc); \
+} while (0)
+
+/* builtin of the span calling convention */
+#define LENV_SPANBUILTIN(sym, name) do { \
+    static const struct lbuiltin desc = { sym, NULL, builtin_##name }; \
+    lenvironment_add_builtin(e, &desc); \
+} while (0)
+
+/* argument checks of span builtins; the arguments are borrowed, so nothing is freed */
+#define LSPAN_ASSERT(cond, fmt, ...) \
+    if ( !(cond) ) { return lvalue_err(fmt, ##__VA_ARGS__); }
 
-#define LMATH_TYPE_CHECK(lval, sym) do { \
-    enum ltype expected_arg_type = LGETCELL(lval, 0)->type; \
-    LASSERT(lval, LIS_NUM(expected_arg_type), "Cannot operate on argument at position %i. Non-number type '%s' parsed to operator '%s'.", 1, ltype_name(expected_arg_type), sym); \
-    for ( size_t i = 1; i < lval->val.l.count; i++ ) { \
-        struct lvalue *curr = LGETCELL(lval, i); \
-        LASSERT(lval, expected_arg_type == curr->type, "Argument type mismatch. Expected argument at position %lu to be of type '%s'; got type '%s'.", i + 1, ltype_name(expected_arg_type), ltype_name(curr->type)); \
+#define LSPAN_NUM_ARGS(func_name, numargs) \
+    LSPAN_ASSERT(argc == numargs, "Wrong number of arguments parsed to '%s'. Expected at exactly %lu argument(s); got %lu. ", func_name, (size_t) numargs, argc)
+
+#define LSPAN_MATH_TYPE_CHECK(sym) do { \
+    LSPAN_ASSERT(argc > 0, "Wrong number of arguments parsed to '%s'. Expected at least %lu argument(s); got %lu. ", sym, (size_t) 1, argc); \
+    enum ltype expected_arg_type = argv[0]->type; \
+    LSPAN_ASSERT(LIS_NUM(expected_arg_type), "Cannot operate on argument at position %i. Non-number type '%s' parsed to operator '%s'.", 1, ltype_name(expected_arg_type), sym); \
+    for ( size_t i = 1; i < argc; i++ ) { \
+        LSPAN_ASSERT(expected_arg_type == argv[i]->type, "Argument type mismatch. Expected argument at position %lu to be of type '%s'; got type '%s'.", i + 1, ltype_name(expected_arg_type), ltype_name(argv[i]->type)); \
     } \
 } while (0)
 
-extern struct grammar_elems elems;
-extern struct argument_capture *args;
+/* buckets of the scope of a let */
+#define LET_SCOPE_BUCKETS 8
+/* buckets of the scope of a counting loop */
+#define LOOP_SCOPE_BUCKETS 4
 
-/* env preallocated sizes */
-const size_t lambda_env_prealloc = 50;
-const size_t fun_env_prealloc = 200;
+/* number of results a memoized function keeps by default */
+static const size_t memo_default_capacity = 1024;
 
 /* * math builtins * */
 
-struct lvalue *builtin_add(struct lenvironment *e, struct lvalue *in) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(in, "+");
-    struct lvalue *res = lvalue_pop(in, 0);
+/* integer arithmetic wraps around on overflow, as in compiled code; the sums are taken unsigned */
+#define LWRAP(a, op, b) ((long long) ((unsigned long long) (a) op (unsigned long long) (b)))
 
-    if ( res->type == LVAL_INT ) {
-        while ( in->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(in, 0);
-            res->val.intval += b->val.intval;
-            lvalue_del(b);
-        }
-    } else {
-        while ( in->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(in, 0);
-            res->val.floatval += b->val.floatval;
-            lvalue_del(b);
+struct lvalue *builtin_add(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("+");
+
+    if ( argv[0]->type == LVAL_INT ) {
+        long long res = argv[0]->val.intval;
+        for ( size_t i = 1; i < argc; ++i ) {
+            res = LWRAP(res, +, argv[i]->val.intval);
         }
+        return lvalue_int(res);
     }
 
-    lvalue_del(in);
-    return res;
+    double res = argv[0]->val.floatval;
+    for ( size_t i = 1; i < argc; ++i ) {
+        res += argv[i]->val.floatval;
+    }
+    return lvalue_float(res);
 }
 
-struct lvalue *builtin_sub(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "-");
-    struct lvalue *res = lvalue_pop(a, 0);
+struct lvalue *builtin_sub(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("-");
 
-    if ( res->type == LVAL_INT ) {
-        if ( a->val.l.count == 0 ) {
-            res->val.intval = (-res->val.intval);
-        } else {
-            while ( a->val.l.count > 0 ) {
-                struct lvalue *b = lvalue_pop(a, 0);
-                res->val.intval -= b->val.intval;
-                lvalue_del(b);
-            }
+    if ( argv[0]->type == LVAL_INT ) {
+        long long res = argv[0]->val.intval;
+        if ( argc == 1 ) {
+            res = LWRAP(0, -, res);
         }
-    } else {
-        if ( a->val.l.count == 0 ) {
-            res->val.floatval = (-res->val.floatval);
-        } else {
-            while ( a->val.l.count > 0 ) {
-                struct lvalue *b = lvalue_pop(a, 0);
-                res->val.floatval -= b->val.floatval;
-                lvalue_del(b);
-            }
+        for ( size_t i = 1; i < argc; ++i ) {
+            res = LWRAP(res, -, argv[i]->val.intval);
         }
+        return lvalue_int(res);
     }
 
-    lvalue_del(a);
-    return res;
+    double res = argv[0]->val.floatval;
+    if ( argc == 1 ) {
+        res = -res;
+    }
+    for ( size_t i = 1; i < argc; ++i ) {
+        res -= argv[i]->val.floatval;
+    }
+    return lvalue_float(res);
 }
 
-struct lvalue *builtin_mul(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "*");
-    struct lvalue *res = lvalue_pop(a, 0);
+struct lvalue *builtin_mul(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("*");
 
-    if ( res->type == LVAL_INT ) {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            res->val.intval *= b->val.intval;
-            lvalue_del(b);
-        }
-    } else {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            res->val.floatval *= b->val.floatval;
-            lvalue_del(b);
+    if ( argv[0]->type == LVAL_INT ) {
+        long long res = argv[0]->val.intval;
+        for ( size_t i = 1; i < argc; ++i ) {
+            res = LWRAP(res, *, argv[i]->val.intval);
         }
+        return lvalue_int(res);
     }
 
-    lvalue_del(a);
-    return res;
+    double res = argv[0]->val.floatval;
+    for ( size_t i = 1; i < argc; ++i ) {
+        res *= argv[i]->val.floatval;
+    }
+    return lvalue_float(res);
 }
 
-struct lvalue *builtin_div(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "/");
-    struct lvalue *res = lvalue_pop(a, 0);
-
-    if ( res->type == LVAL_INT ) {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( b->val.intval == 0 ) {
-                lvalue_del(res);
-                lvalue_del(b);
-                res = lvalue_err("Division by zero");
-                break;
-            }
-            res->val.intval /= b->val.intval;
-            lvalue_del(b);
-        }
-    } else {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( b->val.floatval == 0 ) {
-                lvalue_del(res);
-                lvalue_del(b);
-                res = lvalue_err("Division by zero");
-                break;
-            }
-            res->val.floatval /= b->val.floatval;
-            lvalue_del(b);
+struct lvalue *builtin_div(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("/");
+
+    if ( argv[0]->type == LVAL_INT ) {
+        long long res = argv[0]->val.intval;
+        for ( size_t i = 1; i < argc; ++i ) {
+            LSPAN_ASSERT(argv[i]->val.intval != 0, "Division by zero", 0);
+            /* the smallest integer by -1 traps in hardware */
+            res = argv[i]->val.intval == -1 ? LWRAP(0, -, res) : res / argv[i]->val.intval;
         }
+        return lvalue_int(res);
     }
 
-    lvalue_del(a);
-    return res;
+    double res = argv[0]->val.floatval;
+    for ( size_t i = 1; i < argc; ++i ) {
+        LSPAN_ASSERT(argv[i]->val.floatval != 0, "Division by zero", 0);
+        res /= argv[i]->val.floatval;
+    }
+    return lvalue_float(res);
 }
 
+struct lvalue *builtin_mod(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("%");
 
-struct lvalue *builtin_mod(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "%");
-    struct lvalue *res = lvalue_pop(a, 0);
-
-    if ( res->type == LVAL_INT ) {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( b->val.intval == 0 ) {
-                lvalue_del(res);
-                lvalue_del(b);
-                res = lvalue_err("Division by zero");
-                break;
-            }
-            res->val.intval %= b->val.intval;
-            lvalue_del(b);
-        }
-    } else {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( b->val.floatval == 0 ) {
-                lvalue_del(res);
-                lvalue_del(b);
-                res = lvalue_err("Division by zero");
-                break;
-            }
-            res->val.floatval = fmod(res->val.floatval, b->val.floatval);
-            lvalue_del(b);
+    if ( argv[0]->type == LVAL_INT ) {
+        long long res = argv[0]->val.intval;
+        for ( size_t i = 1; i < argc; ++i ) {
+            LSPAN_ASSERT(argv[i]->val.intval != 0, "Division by zero", 0);
+            res = argv[i]->val.intval == -1 ? 0 : res % argv[i]->val.intval;
         }
+        return lvalue_int(res);
     }
 
-    lvalue_del(a);
-    return res;
+    double res = argv[0]->val.floatval;
+    for ( size_t i = 1; i < argc; ++i ) {
+        LSPAN_ASSERT(argv[i]->val.floatval != 0, "Division by zero", 0);
+        res = fmod(res, argv[i]->val.floatval);
+    }
+    return lvalue_float(res);
 }
 
-struct lvalue *builtin_min(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "min");
-    struct lvalue *res = lvalue_pop(a, 0);
-
-    if ( res->type == LVAL_INT ) {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( res->val.intval > b->val.intval ) {
-                res->val.intval = b->val.intval;
-            }
-            lvalue_del(b);
-        }
-    } else {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( res->val.floatval > b->val.floatval ) {
-                res->val.floatval = b->val.floatval;
-            }
-            lvalue_del(b);
+struct lvalue *builtin_min(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("min");
+
+    struct lvalue *res = argv[0];
+    for ( size_t i = 1; i < argc; ++i ) {
+        if ( res->type == LVAL_INT ? argv[i]->val.intval < res->val.intval : argv[i]->val.floatval < res->val.floatval ) {
+            res = argv[i];
         }
     }
-
-    lvalue_del(a);
-    return res;
+    return lvalue_copy(res);
 }
 
-struct lvalue *builtin_max(struct lenvironment *e, struct lvalue *a) {
-    UNUSED(e);
-    LMATH_TYPE_CHECK(a, "max");
-    struct lvalue *res = lvalue_pop(a, 0);
-
-    if ( res->type == LVAL_INT ) {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( res->val.intval < b->val.intval ) {
-                res->val.intval = b->val.intval;
-            }
-            lvalue_del(b);
-        }
-    } else {
-        while ( a->val.l.count > 0 ) {
-            struct lvalue *b = lvalue_pop(a, 0);
-            if ( res->val.floatval < b->val.floatval ) {
-                res->val.floatval = b->val.floatval;
-            }
-            lvalue_del(b);
+struct lvalue *builtin_max(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_MATH_TYPE_CHECK("max");
+
+    struct lvalue *res = argv[0];
+    for ( size_t i = 1; i < argc; ++i ) {
+        if ( res->type == LVAL_INT ? argv[i]->val.intval > res->val.intval : argv[i]->val.floatval > res->val.floatval ) {
+            res = argv[i];
         }
     }
-
-    lvalue_del(a);
-    return res;
+    return lvalue_copy(res);
 }
 
 /* * q-expression specific builtins * */
@@ -282,12 +246,11 @@ struct lvalue *builtin_eval(struct lenvironment *e, struct lvalue *v) {
  * lvalue
  */
 struct lvalue *builtin_read(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
     LNUM_ARGS(v, "read", 1);
     LARG_TYPE(v, "read", 0, LVAL_STR);
 
     mpc_result_t r;
-    if ( mpc_parse("input", LGETCELL(v, 0)->val.strval, elems.Lisper, &r) ) {
+    if ( mpc_parse("input", LGETCELL(v, 0)->val.strval, e->ctx->elems.Lisper, &r) ) {
         struct lvalue *expr = lvalue_read(r.output);
         mpc_ast_delete(r.output);
 
@@ -326,11 +289,11 @@ struct lvalue *builtin_show(struct lenvironment *e, struct lvalue *v) {
  * get a list of input program arguments
  */
 struct lvalue *builtin_args(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
     LNUM_ARGS(v, "args", 1);
 
     struct lvalue *res = lvalue_qexpr();
     struct lvalue *arg; 
+    struct argument_capture *args = &e->ctx->args;
     int argc = args->argc;
     for (int i = 0; i < argc; ++i) {
         char *arg_str = args->argv[i];
@@ -347,19 +310,37 @@ struct lvalue *builtin_args(struct lenvironment *e, struct lvalue *v) {
  * Print a series of lvalues
  */
 struct lvalue *builtin_print(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
+    struct lwriter *w = &e->ctx->out;
 
     for ( size_t i = 0; i < v->val.l.count; ++i ) {
-        lvalue_print(LGETCELL(v, i));
-        putchar(' ');
+        lvalue_write(w, LGETCELL(v, i));
+        lwriter_putc(w, ' ');
     }
 
-    putchar('\n');
+    lwriter_putc(w, '\n');
+    lwriter_flush(w);
     lvalue_del(v);
 
     return lvalue_sexpr();
 }
 
+/**
+ * (to-string x); x as print shows it; strings are returned as they are
+ */
+struct lvalue *builtin_to_string(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_NUM_ARGS("to-string", 1);
+
+    if ( argv[0]->type == LVAL_STR ) {
+        return lvalue_str(argv[0]->val.strval);
+    }
+
+    struct lwriter *w = &ctx->text;
+    lvalue_write(w, argv[0]);
+    struct lvalue *res = lvalue_str((char *) lwriter_cstr(w));
+    lwriter_flush(w);
+    return res;
+}
+
 /**
  * Open a file in one of the following modes:
  * - "r": read-only mode
@@ -423,7 +404,7 @@ struct lvalue *builtin_close(struct lenvironment *e, struct lvalue *v) {
 
     struct lvalue *f = LGETCELL(v, 0);
 
-    if ( fclose(f->val.file->fp) != 0 ) {
+    if ( lfile_close(f->val.file->fp) != 0 ) {
         lvalue_del(v);
         return lvalue_err("Cloud not close file: '%s'", f->val.file->path);
     }
@@ -458,10 +439,12 @@ struct lvalue *builtin_putstr(struct lenvironment *e, struct lvalue *v) {
     struct lvalue *str = LGETCELL(v, 0);
 
     if ( fputs(str->val.strval, f->val.file->fp) == EOF ) {
+        struct lvalue *err = lvalue_err("Could write '%s' to file", str->val.strval);
         lvalue_del(v);
-        return lvalue_err("Could write '%s' to file", str->val.strval);
+        return err;
     }
 
+    lvalue_del(v);
     return lvalue_sexpr();
 }
 
@@ -472,20 +455,19 @@ struct lvalue *builtin_getstr(struct lenvironment *e, struct lvalue *v) {
 
     struct lvalue *f = LGETCELL(v, 0);
 
-    char *s = calloc(16385, sizeof(char));
+    char *s = NULL;
+    size_t cap = 0;
 
-    if ( fgets(s, 16384 * sizeof(char), f->val.file->fp) == NULL ) {
+    if ( lfile_readline(f->val.file->fp, &s, &cap) < 0 ) {
+        free(s);
         lvalue_del(v);
         return lvalue_err("Could not get string from file; could not read string");
     }
 
-    char *resized = realloc(s, strlen(s) + 1);
-    if ( resized == NULL ) {
-        lvalue_del(v);
-        return lvalue_err("Could not get string from file; could not resize string buffer");
-    }
-
-    return lvalue_str(resized);
+    struct lvalue *str = lvalue_str(s);
+    free(s);
+    lvalue_del(v);
+    return str;
 }
 
 struct lvalue *builtin_rewind(struct lenvironment *e, struct lvalue *v) {
@@ -493,8 +475,9 @@ struct lvalue *builtin_rewind(struct lenvironment *e, struct lvalue *v) {
     LNUM_ARGS(v, "rewind", 1);
     LARG_TYPE(v, "rewind", 0, LVAL_FILE);
 
-    rewind(LGETCELL(v, 0)->val.file->fp);
+    lfile_rewind(LGETCELL(v, 0)->val.file->fp);
 
+    lvalue_del(v);
     return lvalue_sexpr();
 }
 
@@ -606,21 +589,15 @@ struct lvalue *builtin_cons(struct lenvironment *e, struct lvalue *v) {
     return collection;
 }
 
-struct lvalue *builtin_len(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
-    LNUM_ARGS(v, "len", 1);
-    LTWO_ARG_TYPES(v, "len", 0, LVAL_QEXPR, LVAL_STR);
+struct lvalue *builtin_len(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("len", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_QEXPR || argv[0]->type == LVAL_STR, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s' or '%s'; got '%s'.", "len", ltype_name(LVAL_QEXPR), ltype_name(LVAL_STR), ltype_name(argv[0]->type));
 
-    struct lvalue *arg = LGETCELL(v, 0);
-    size_t count = 0;
-    if ( arg->type == LVAL_STR ) {
-        count = strlen(arg->val.strval);
-    } else {
-        count = arg->val.l.count;
+    if ( argv[0]->type == LVAL_STR ) {
+        return lvalue_int(strlen(argv[0]->val.strval));
     }
-
-    lvalue_del(v);
-    return lvalue_int(count);
+    return lvalue_int(argv[0]->val.l.count);
 }
 
 struct lvalue *builtin_init(struct lenvironment *e, struct lvalue *v) {
@@ -688,16 +665,263 @@ struct lvalue *builtin_if(struct lenvironment *e, struct lvalue *v) {
     return res;
 }
 
-/* * reflection builtins * */
+/*
+ * Evaluate the q-expression 'code' as a s-expression. The code is
+ * borrowed, so it is neither copied nor used up by an iteration of a loop.
+ */
+static struct lvalue *builtin_run(struct lenvironment *e, struct lvalue *code) {
+    return lvalue_eval_cells(e, code->val.l.count, code->val.l.cells);
+}
 
-struct lvalue *builtin_type(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
-    LNUM_ARGS(v, "type", 1);
+/**
+ * (while {cond} {body}) evaluates body as long as cond is true
+ */
+struct lvalue *builtin_while(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "while", 2);
+    LARG_TYPE(v, "while", 0, LVAL_QEXPR);
+    LARG_TYPE(v, "while", 1, LVAL_QEXPR);
+
+    struct lvalue *cond = LGETCELL(v, 0);
+    struct lvalue *body = LGETCELL(v, 1);
+
+    for ( ;; ) {
+        struct lvalue *c = builtin_run(e, cond);
+        if ( c->type != LVAL_BOOL ) {
+            struct lvalue *err = c;
+            if ( c->type != LVAL_ERR ) {
+                err = lvalue_err("Condition of '%s' must be of type '%s'; got '%s'.", "while", ltype_name(LVAL_BOOL), ltype_name(c->type));
+                lvalue_del(c);
+            }
+            lvalue_del(v);
+            return err;
+        }
+
+        int done = !c->val.intval;
+        lvalue_del(c);
+        if ( done ) {
+            break;
+        }
+
+        struct lvalue *res = builtin_run(e, body);
+        if ( res->type == LVAL_ERR ) {
+            lvalue_del(v);
+            return res;
+        }
+        lvalue_del(res);
+    }
+
+    lvalue_del(v);
+    return lvalue_sexpr();
+}
+
+/*
+ * Counting loop shared by 'dotimes' and 'for-range'. The first argument
+ * is the loop variable followed by the bounds; 'dotimes' gives only the
+ * end, 'for-range' the start, the end and an optional step.
+ * The loop variable is bound in a scope of its own, which ends with the loop.
+ */
+static struct lvalue *builtin_loop(struct lenvironment *e, struct lvalue *v, char *sym, size_t min_bounds, size_t max_bounds) {
+    LNUM_ARGS(v, sym, 2);
+    LARG_TYPE(v, sym, 0, LVAL_QEXPR);
+    LARG_TYPE(v, sym, 1, LVAL_QEXPR);
+
+    struct lvalue *spec = LGETCELL(v, 0);
+    struct lvalue *body = LGETCELL(v, 1);
+    size_t bounds_count = spec->val.l.count - 1;
+
+    LASSERT(v, spec->val.l.count > 0 && LGETCELL(spec, 0)->type == LVAL_SYM, "First element of the loop specification of '%s' must be a symbol.", sym);
+    LASSERT(v, bounds_count >= min_bounds && bounds_count <= max_bounds, "Loop specification of '%s' takes %lu to %lu bound(s); got %lu.", sym, min_bounds, max_bounds, bounds_count);
+
+    /* start, end and step */
+    long long bounds[3] = { 0, 0, 1 };
+    size_t first = (min_bounds == 1) ? 1 : 0;
+
+    for ( size_t i = 0; i < bounds_count; ++i ) {
+        struct lvalue *b = lvalue_eval(e, lvalue_copy(LGETCELL(spec, i + 1)));
+        if ( b->type != LVAL_INT ) {
+            struct lvalue *err = b;
+            if ( b->type != LVAL_ERR ) {
+                err = lvalue_err("Bound %lu of '%s' must be of type '%s'; got '%s'.", i + 1, sym, ltype_name(LVAL_INT), ltype_name(b->type));
+                lvalue_del(b);
+            }
+            lvalue_del(v);
+            return err;
+        }
+        bounds[first + i] = b->val.intval;
+        lvalue_del(b);
+    }
+
+    LASSERT(v, bounds[2] != 0, "Step of '%s' must not be zero.", sym);
+
+    /* the scope is reused by every iteration and only lives as long as this call */
+    struct lenvironment_entry *buckets[LOOP_SCOPE_BUCKETS];
+    struct lenvironment scope;
+    lenvironment_init(&scope, buckets, LOOP_SCOPE_BUCKETS);
+    scope.parent = e;
+
+    struct lvalue *var = LGETCELL(spec, 0);
+    struct lvalue *res = lvalue_sexpr();
+    int up = bounds[2] > 0;
+    /* distances are taken unsigned, which holds the distance of any two integers */
+    unsigned long long step = up ? (unsigned long long) bounds[2] : 0ULL - (unsigned long long) bounds[2];
+    for ( long long i = bounds[0]; up ? i < bounds[1] : i > bounds[1]; ) {
+        struct lvalue *counter = lvalue_int(i);
+        lenvironment_put(&scope, var, counter);
+        lvalue_del(counter);
+
+        lvalue_del(res);
+        res = builtin_run(&scope, body);
+        if ( res->type == LVAL_ERR ) {
+            break;
+        }
 
-    char *t = ltype_name(v->val.l.cells[0]->type);
+        /* the last step would pass the end, and could overflow on the way */
+        unsigned long long left = up ? (unsigned long long) bounds[1] - (unsigned long long) i
+                                     : (unsigned long long) i - (unsigned long long) bounds[1];
+        if ( left <= step ) {
+            break;
+        }
+        i = up ? i + (long long) step : (long long) ((unsigned long long) i - step);
+    }
+
+    lenvironment_clear(&scope);
+    lvalue_del(v);
+    if ( res->type == LVAL_ERR ) {
+        return res;
+    }
+    lvalue_del(res);
+    return lvalue_sexpr();
+}
+
+/**
+ * (dotimes {i n} {body}) evaluates body for i from 0 below n
+ */
+struct lvalue *builtin_dotimes(struct lenvironment *e, struct lvalue *v) {
+    return builtin_loop(e, v, "dotimes", 1, 1);
+}
+
+/**
+ * (for-range {i start end [step]} {body}) evaluates body for i from start below end
+ */
+struct lvalue *builtin_for_range(struct lenvironment *e, struct lvalue *v) {
+    return builtin_loop(e, v, "for-range", 2, 3);
+}
+
+/**
+ * (let {body}) or (let {name value ...} {body}) evaluates body in a new
+ * scope holding the bindings. Each value sees the bindings before it.
+ */
+struct lvalue *builtin_let(struct lenvironment *e, struct lvalue *v) {
+    LASSERT(v, v->val.l.count == 1 || v->val.l.count == 2, "Wrong number of arguments parsed to '%s'. Expected 1 or 2 argument(s); got %lu. ", "let", v->val.l.count);
+    for ( size_t i = 0; i < v->val.l.count; ++i ) {
+        LARG_TYPE(v, "let", i, LVAL_QEXPR);
+    }
+
+    /* the scope only lives as long as this call */
+    struct lenvironment_entry *buckets[LET_SCOPE_BUCKETS];
+    struct lenvironment scope;
+    lenvironment_init(&scope, buckets, LET_SCOPE_BUCKETS);
+    scope.parent = e;
+
+    struct lvalue *res = NULL;
+    if ( v->val.l.count == 2 ) {
+        struct lvalue *bindings = LGETCELL(v, 0);
+        if ( bindings->val.l.count % 2 != 0 ) {
+            res = lvalue_err("Bindings of '%s' must be pairs of name and value; got %lu element(s).", "let", bindings->val.l.count);
+        }
+
+        for ( size_t i = 0; res == NULL && i < bindings->val.l.count; i += 2 ) {
+            struct lvalue *name = LGETCELL(bindings, i);
+            if ( name->type != LVAL_SYM ) {
+                res = lvalue_err("Expected binding name %lu of '%s' to be of type '%s'; got type '%s'.", i / 2 + 1, "let", ltype_name(LVAL_SYM), ltype_name(name->type));
+                break;
+            }
+
+            struct lvalue *val = lvalue_eval(&scope, lvalue_copy(LGETCELL(bindings, i + 1)));
+            if ( val->type == LVAL_ERR ) {
+                res = val;
+                break;
+            }
+            lenvironment_put(&scope, name, val);
+            lvalue_del(val);
+        }
+    }
 
+    if ( res == NULL ) {
+        res = builtin_run(&scope, LGETCELL(v, v->val.l.count - 1));
+    }
+
+    lenvironment_clear(&scope);
     lvalue_del(v);
-    return lvalue_str(t);
+    return res;
+}
+
+/**
+ * (do a b ...) returns the last of its arguments,
+ * which have been evaluated in order
+ */
+struct lvalue *builtin_do(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    if ( v->val.l.count == 0 ) {
+        lvalue_del(v);
+        return lvalue_sexpr();
+    }
+    return lvalue_take(v, v->val.l.count - 1);
+}
+
+/* * reflection builtins * */
+
+struct lvalue *builtin_type(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("type", 1);
+
+    return lvalue_str(ltype_name(argv[0]->type));
+}
+
+#define LIS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/* 's' with its leading white space skipped */
+static const char *builtin_skip_space(const char *s) {
+    while ( LIS_SPACE(*s) ) {
+        s++;
+    }
+    return s;
+}
+
+/**
+ * (parse-int s); the decimal integer in the string s, surrounded by optional white space
+ */
+struct lvalue *builtin_parse_int(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("parse-int", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_STR, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s'; got '%s'.", "parse-int", ltype_name(LVAL_STR), ltype_name(argv[0]->type));
+
+    const char *s = argv[0]->val.strval;
+    const char *end = NULL;
+    long long n = 0;
+    enum lnumber_status status = lnumber_parse_int(builtin_skip_space(s), &end, &n);
+
+    LSPAN_ASSERT(status != LNUMBER_RANGE, "Integer '%s' parsed to 'parse-int' is out of range.", s);
+    LSPAN_ASSERT(status == LNUMBER_OK && *builtin_skip_space(end) == '\0', "Could not parse '%s' as an integer.", s);
+    return lvalue_int(n);
+}
+
+/**
+ * (parse-float s); the decimal number in the string s, surrounded by optional white space
+ */
+struct lvalue *builtin_parse_float(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("parse-float", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_STR, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s'; got '%s'.", "parse-float", ltype_name(LVAL_STR), ltype_name(argv[0]->type));
+
+    const char *s = argv[0]->val.strval;
+    const char *end = NULL;
+    double d = 0.0;
+    enum lnumber_status status = lnumber_parse_float(builtin_skip_space(s), &end, &d);
+
+    LSPAN_ASSERT(status != LNUMBER_RANGE, "Number '%s' parsed to 'parse-float' is out of range.", s);
+    LSPAN_ASSERT(status == LNUMBER_OK && *builtin_skip_space(end) == '\0', "Could not parse '%s' as a number.", s);
+    return lvalue_float(d);
 }
 
 /* * function builtins * */
@@ -721,7 +945,7 @@ struct lvalue *builtin_lambda(struct lenvironment *e, struct lvalue *v) {
     body = lvalue_pop(v, 0);
     lvalue_del(v);
 
-    return lvalue_lambda(formals, body, lambda_env_prealloc);
+    return lvalue_lambda(formals, body);
 }
 
 /**
@@ -756,7 +980,8 @@ struct lvalue *builtin_fn(struct lenvironment *e, struct lvalue*v) {
     formals = lvalue_pop(v, 0);
     body = lvalue_pop(v, 0);
 
-    struct lvalue *fn = lvalue_lambda(formals, body, fun_env_prealloc);
+    struct lvalue *fn = lvalue_lambda(formals, body);
+    fn->val.fun->name = LGETCELL(name, 0)->val.strval;
 
     lenvironment_put(e, LGETCELL(name, 0), fn);
     lvalue_del(fn);
@@ -766,111 +991,725 @@ struct lvalue *builtin_fn(struct lenvironment *e, struct lvalue*v) {
     return lvalue_sexpr();
 }
 
-/* * value definition builtins * */
-
-struct lvalue *builtin_var(struct lenvironment *, struct lvalue *, char *);
+/**
+ * Wrap a function in a bounded least recently used cache of its results,
+ * keyed on the argument list. The optional second argument is the
+ * maximum number of results cached.
+ */
+struct lvalue *builtin_memo(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LASSERT(v, v->val.l.count == 1 || v->val.l.count == 2, "Wrong number of arguments parsed to '%s'. Expected 1 or 2 argument(s); got %lu. ", "memo", v->val.l.count);
+    LASSERT(v, LGETCELL(v, 0)->type == LVAL_FUNCTION || LGETCELL(v, 0)->type == LVAL_PAP || LGETCELL(v, 0)->type == LVAL_BUILTIN,
+        "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s' or '%s'; got '%s'.",
+        "memo", ltype_name(LVAL_FUNCTION), ltype_name(LVAL_BUILTIN), ltype_name(LGETCELL(v, 0)->type));
+
+    size_t capacity = memo_default_capacity;
+    if ( v->val.l.count == 2 ) {
+        LARG_TYPE(v, "memo", 1, LVAL_INT);
+        LASSERT(v, LGETCELL(v, 1)->val.intval >= 0, "Cache capacity parsed to '%s' must not be negative.", "memo");
+        LASSERT(v, (unsigned long long) LGETCELL(v, 1)->val.intval <= LMEMO_MAX_CAPACITY,
+            "Cache capacity parsed to '%s' must be at most %lu.", "memo", LMEMO_MAX_CAPACITY);
+        capacity = (size_t) LGETCELL(v, 1)->val.intval;
+    }
 
-struct lvalue *builtin_def(struct lenvironment *e, struct lvalue *v) {
-    return builtin_var(e, v, "def");
+    struct lvalue *func = lvalue_pop(v, 0);
+    lvalue_del(v);
+    return lvalue_memo(func, capacity);
 }
 
-struct lvalue *builtin_put(struct lenvironment *e, struct lvalue *v) {
-    return builtin_var(e, v, "=");
+/**
+ * Statistics of a memoized function as {hits misses size capacity}
+ */
+struct lvalue *builtin_memo_stats(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LNUM_ARGS(v, "memo-stats", 1);
+    LARG_TYPE(v, "memo-stats", 0, LVAL_MEMO);
+
+    struct lmemo *memo = LGETCELL(v, 0)->val.memo;
+    struct lvalue *res = lvalue_qexpr();
+    lvalue_add(res, lvalue_int(memo->hits));
+    lvalue_add(res, lvalue_int(memo->misses));
+    lvalue_add(res, lvalue_int(memo->size));
+    lvalue_add(res, lvalue_int(memo->capacity));
+
+    lvalue_del(v);
+    return res;
 }
 
-struct lvalue *builtin_var(struct lenvironment *e, struct lvalue *v, char *sym) {
-    LARG_TYPE(v, sym, 0, LVAL_QEXPR);
+/* * memory builtins * */
 
-    struct lvalue *names = LGETCELL(v, 0);
+/**
+ * Gives the memory of the completely free lvalue pools back to the system
+ * and returns how many bytes that was.
+ */
+struct lvalue *builtin_heap_trim(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(argv);
+    LSPAN_NUM_ARGS("heap-trim", 1);
 
-    for ( size_t i = 0; i < names->val.l.count; ++i ) {
-        LASSERT(v, LGETCELL(names, i)->type == LVAL_SYM, "Function '%s' cannot assign value(s) to name(s). Name %lu is of type '%s'; expected type '%s'.", sym, i, ltype_name(LGETCELL(names, i)->type), ltype_name(LVAL_SYM));
-    }
+    return lvalue_int((long long) lisper_ctx_trim(ctx, 1));
+}
 
-    LASSERT(v, names->val.l.count == v->val.l.count - 1, "Function '%s' cannot assign value(s) to name(s). Number of name(s) and value(s) does not match. Saw %lu name(s) expected %lu value(s).", sym, names->val.l.count, v->val.l.count - 1);
+/* * evaluation limit builtins * */
 
-    for ( size_t i = 0; i < names->val.l.count; ++i ) {
-        if ( strcmp(sym, "def") == 0 ) {
-            lenvironment_def(e, LGETCELL(names, i), LGETCELL(v, i + 1));
-        } else if ( strcmp(sym, "=") == 0 ) {
-            lenvironment_put(e, LGETCELL(names, i), LGETCELL(v, i + 1));
+/**
+ * (with-limits {steps n time ms heap bytes depth n} {body}) evaluates body
+ * held to the given limits, on top of the ones already in force. Any of
+ * the limits may be left out. Exceeding one makes body an error.
+ */
+struct lvalue *builtin_with_limits(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "with-limits", 2);
+    LARG_TYPE(v, "with-limits", 0, LVAL_QEXPR);
+    LARG_TYPE(v, "with-limits", 1, LVAL_QEXPR);
+
+    struct lvalue *spec = LGETCELL(v, 0);
+    LASSERT(v, spec->val.l.count % 2 == 0, "Limits parsed to '%s' must be pairs of a name and a value.", "with-limits");
+
+    struct lbudget_limits limits;
+    memset(&limits, 0, sizeof(limits));
+    for ( size_t i = 0; i < spec->val.l.count; i += 2 ) {
+        struct lvalue *name = LGETCELL(spec, i);
+        struct lvalue *val = LGETCELL(spec, i + 1);
+        LASSERT(v, name->type == LVAL_SYM, "Expected limit name %lu of '%s' to be of type '%s'; got type '%s'.", i / 2 + 1, "with-limits", ltype_name(LVAL_SYM), ltype_name(name->type));
+        LASSERT(v, val->type == LVAL_INT && val->val.intval > 0, "Limit '%s' of '%s' must be a positive integer.", name->val.strval, "with-limits");
+
+        size_t n = (size_t) val->val.intval;
+        if ( strcmp(name->val.strval, "steps") == 0 ) {
+            limits.steps = n;
+        } else if ( strcmp(name->val.strval, "time") == 0 ) {
+            limits.time_ms = n;
+        } else if ( strcmp(name->val.strval, "heap") == 0 ) {
+            limits.heap = n;
+        } else if ( strcmp(name->val.strval, "depth") == 0 ) {
+            limits.depth = n;
+        } else {
+            LASSERT(v, 0, "Unknown limit '%s' parsed to '%s'; expected steps, time, heap or depth.", name->val.strval, "with-limits");
         }
     }
 
+    struct lbudget saved = e->ctx->budget;
+    lbudget_narrow(e->ctx, &limits);
+    struct lvalue *res = builtin_run(e, LGETCELL(v, 1));
+    lbudget_restore(e->ctx, &saved);
+
     lvalue_del(v);
-    return lvalue_sexpr();
+    return res;
 }
 
-/* * comparison builtins * */
+/* * timing builtins * */
 
-struct lvalue *builtin_ord(struct lenvironment *e, struct lvalue *v, char *sym);
+/**
+ * Nanoseconds of the monotonic clock; only the difference between two
+ * readings means anything.
+ */
+struct lvalue *builtin_clock_ns(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    UNUSED(argv);
+    LSPAN_NUM_ARGS("clock-ns", 1);
 
-struct lvalue *builtin_lt(struct lenvironment *e, struct lvalue *v) {
-    return builtin_ord(e, v, "<");
+    return lvalue_int(lbudget_now());
 }
 
-struct lvalue *builtin_gt(struct lenvironment *e, struct lvalue *v) {
-    return builtin_ord(e, v, ">");
+/* adds 'name' and 'x' to the report 'q' */
+static void builtin_report(struct lvalue *q, char *name, struct lvalue *x) {
+    lvalue_add(q, lvalue_sym(name));
+    lvalue_add(q, x);
 }
 
-struct lvalue *builtin_le(struct lenvironment *e, struct lvalue *v) {
-    return builtin_ord(e, v, "<=");
-}
+/**
+ * (time {expr}) evaluates expr and returns {value x ns n allocs n}; its
+ * value, the nanoseconds it took and the number of values it allocated.
+ */
+struct lvalue *builtin_time(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "time", 1);
+    LARG_TYPE(v, "time", 0, LVAL_QEXPR);
 
-struct lvalue *builtin_ge(struct lenvironment *e, struct lvalue *v) {
-    return builtin_ord(e, v, ">=");
-}
+    struct mempool *mp = e->ctx->lvalue_mp;
+    struct lvalue *x = lvalue_copy(LGETCELL(v, 0));
+    x->type = LVAL_SEXPR;
+    lvalue_del(v);
 
-struct lvalue *builtin_ord(struct lenvironment *e, struct lvalue *v, char *sym) {
-    UNUSED(e);
-    LNUM_ARGS(v, sym, 2);
+    size_t takes = mp->takes;
+    long long start = lbudget_now();
+    struct lvalue *res = lvalue_eval(e, x);
+    long long ns = lbudget_now() - start;
+    takes = mp->takes - takes;
+    if ( res->type == LVAL_ERR ) {
+        return res;
+    }
 
-    struct lvalue *lhs = v->val.l.cells[0];
-    struct lvalue *rhs = v->val.l.cells[1];
+    struct lvalue *report = lvalue_qexpr();
+    builtin_report(report, "value", res);
+    builtin_report(report, "ns", lvalue_int(ns));
+    builtin_report(report, "allocs", lvalue_int((long long) takes));
+    return report;
+}
 
-    LASSERT(v, LIS_NUM(lhs->type), "Wrong type of argument parsed to '%s'. Expected '%s' or '%s' got '%s'.", sym, ltype_name(LVAL_INT), ltype_name(LVAL_FLOAT), ltype_name(lhs->type));
-    LASSERT(v, LIS_NUM(rhs->type), "Wrong type of argument parsed to '%s'. Expected '%s' or '%s' got '%s'.", sym, ltype_name(LVAL_INT), ltype_name(LVAL_FLOAT), ltype_name(rhs->type));
-    LASSERT(v, lhs->type == rhs->type, "Type of arguments does not match. Argument %i is of type '%s'; argument %i is of type '%s'.", 1, ltype_name(lhs->type), 2, ltype_name(rhs->type));
+static int builtin_compare_ns(const void *a, const void *b) {
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
 
-    long long res = 0;
-    if ( strcmp(sym, "<") == 0 ) {
-        res = (lhs->val.intval < rhs->val.intval);
-    } else if ( strcmp(sym, ">") == 0 ) {
-        res = (lhs->val.intval > rhs->val.intval);
-    } else if ( strcmp(sym, "<=") == 0 ) {
-        res = (lhs->val.intval <= rhs->val.intval);
-    } else if ( strcmp(sym, ">=") == 0 ) {
-        res = (lhs->val.intval >= rhs->val.intval);
+/**
+ * (bench n {expr}) evaluates expr a tenth of n times, at least once, to
+ * warm up, and then n times, timing each run. Returns
+ * {runs n min ns median ns p99 ns allocs n}, where allocs is the mean
+ * number of values a run allocated.
+ */
+struct lvalue *builtin_bench(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "bench", 2);
+    LARG_TYPE(v, "bench", 0, LVAL_INT);
+    LARG_TYPE(v, "bench", 1, LVAL_QEXPR);
+
+    long long runs = LGETCELL(v, 0)->val.intval;
+    LASSERT(v, runs > 0, "Number of runs parsed to '%s' must be positive; got %lli.", "bench", runs);
+    long long *ns = (unsigned long long) runs <= SIZE_MAX / sizeof(long long) ? malloc((size_t) runs * sizeof(long long)) : NULL;
+    LASSERT(v, ns != NULL, "Could not allocate the timings of %lli runs of '%s'.", runs, "bench");
+
+    struct mempool *mp = e->ctx->lvalue_mp;
+    struct lvalue *code = LGETCELL(v, 1);
+    long long warmup = runs / 10 > 0 ? runs / 10 : 1;
+    size_t takes = 0;
+
+    for ( long long i = -warmup; i < runs; ++i ) {
+        struct lvalue *x = lvalue_copy(code);
+        x->type = LVAL_SEXPR;
+
+        size_t taken = mp->takes;
+        long long start = lbudget_now();
+        struct lvalue *res = lvalue_eval(e, x);
+        long long end = lbudget_now();
+        if ( res->type == LVAL_ERR ) {
+            free(ns);
+            lvalue_del(v);
+            return res;
+        }
+        if ( i >= 0 ) {
+            ns[i] = end - start;
+            takes += mp->takes - taken;
+        }
+        lvalue_del(res);
     }
-
     lvalue_del(v);
-    return lvalue_bool(res);
+
+    /* percentiles by nearest rank */
+    qsort(ns, (size_t) runs, sizeof(long long), builtin_compare_ns);
+    struct lvalue *report = lvalue_qexpr();
+    builtin_report(report, "runs", lvalue_int(runs));
+    builtin_report(report, "min", lvalue_int(ns[0]));
+    builtin_report(report, "median", lvalue_int(ns[(runs + 1) / 2 - 1]));
+    builtin_report(report, "p99", lvalue_int(ns[(runs * 99 + 99) / 100 - 1]));
+    builtin_report(report, "allocs", lvalue_int((long long) (takes / (size_t) runs)));
+    free(ns);
+    return report;
 }
 
-struct lvalue *builtin_cmp(struct lenvironment *e, struct lvalue *v, char *sym) {
-    UNUSED(e);
-    LNUM_ARGS(v, sym, 2);
+/* * lazy sequence builtins * */
 
-    struct lvalue *lhs = v->val.l.cells[0];
-    struct lvalue *rhs = v->val.l.cells[1];
+#define LIS_CALLABLE(type) (type == LVAL_FUNCTION || type == LVAL_PAP || type == LVAL_BUILTIN || type == LVAL_MEMO)
 
-    long long res = 0;
-    if ( strcmp(sym, "==") == 0 ) {
-        res = lvalue_eq(lhs, rhs);
-    } else if ( strcmp(sym, "!=") == 0 ) {
-        res = !lvalue_eq(lhs, rhs);
+#define LARG_CALLABLE(lval, func_name, i) \
+    LASSERT(lval, LIS_CALLABLE(lval->val.l.cells[i]->type), "Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", func_name, (size_t) (i + 1), ltype_name(LVAL_FUNCTION), ltype_name(lval->val.l.cells[i]->type))
+
+#define LARG_SEQ(lval, func_name, i) \
+    LTWO_ARG_TYPES(lval, func_name, i, LVAL_SEQ, LVAL_QEXPR)
+
+/* the sequence of a sequence or q-expression value; consumes the value */
+static struct lseq *lseq_of(struct lvalue *x) {
+    if ( x->type == LVAL_QEXPR ) {
+        return lseq_list(x);
+    }
+    struct lseq *seq = lseq_share(x->val.seq);
+    lvalue_del(x);
+    return seq;
+}
+
+/**
+ * (range end), (range start end) or (range start end step);
+ * the integers from start (default 0) towards end, not including it
+ */
+struct lvalue *builtin_range(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LASSERT(v, v->val.l.count >= 1 && v->val.l.count <= 3, "Wrong number of arguments parsed to '%s'. Expected 1 to 3 argument(s); got %lu. ", "range", v->val.l.count);
+    for ( size_t i = 0; i < v->val.l.count; ++i ) {
+        LARG_TYPE(v, "range", i, LVAL_INT);
     }
 
+    long long start = 0, end, step = 1;
+    if ( v->val.l.count == 1 ) {
+        end = LGETCELL(v, 0)->val.intval;
+    } else {
+        start = LGETCELL(v, 0)->val.intval;
+        end = LGETCELL(v, 1)->val.intval;
+    }
+    if ( v->val.l.count == 3 ) {
+        step = LGETCELL(v, 2)->val.intval;
+    }
+    LASSERT(v, step != 0, "Step parsed to '%s' must not be zero.", "range");
+
     lvalue_del(v);
+    return lvalue_seq(lseq_range(start, end, step));
+}
+
+/**
+ * (iterate f x); the endless sequence x, (f x), (f (f x)), ...
+ */
+struct lvalue *builtin_iterate(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LNUM_ARGS(v, "iterate", 2);
+    LARG_CALLABLE(v, "iterate", 0);
+
+    struct lvalue *func = lvalue_pop(v, 0);
+    struct lvalue *seed = lvalue_take(v, 0);
+    return lvalue_seq(lseq_iterate(func, seed));
+}
+
+/**
+ * (lines-of path); the lines of a file without their line breaks.
+ * The file is read as the sequence is consumed.
+ */
+struct lvalue *builtin_lines_of(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LNUM_ARGS(v, "lines-of", 1);
+    LARG_TYPE(v, "lines-of", 0, LVAL_STR);
+
+    return lvalue_seq(lseq_lines(lvalue_take(v, 0)));
+}
+
+static struct lvalue *builtin_transform(struct lvalue *v, char *name, enum lseq_kind kind) {
+    LNUM_ARGS(v, name, 2);
+    LARG_CALLABLE(v, name, 0);
+    LARG_SEQ(v, name, 1);
+
+    struct lvalue *func = lvalue_pop(v, 0);
+    struct lseq *source = lseq_of(lvalue_take(v, 0));
+    return lvalue_seq(lseq_transform(kind, func, source));
+}
+
+/**
+ * (lmap f s); the sequence of (f x) for every x of s
+ */
+struct lvalue *builtin_lmap(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    return builtin_transform(v, "lmap", LSEQ_MAP);
+}
+
+/**
+ * (lfilter f s); the sequence of the x of s for which (f x) is true
+ */
+struct lvalue *builtin_lfilter(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    return builtin_transform(v, "lfilter", LSEQ_FILTER);
+}
+
+/**
+ * (ltake n s); the sequence of the first n elements of s
+ */
+struct lvalue *builtin_ltake(struct lenvironment *e, struct lvalue *v) {
+    UNUSED(e);
+    LNUM_ARGS(v, "ltake", 2);
+    LARG_TYPE(v, "ltake", 0, LVAL_INT);
+    LARG_SEQ(v, "ltake", 1);
+
+    long long count = LGETCELL(v, 0)->val.intval;
+    struct lseq *source = lseq_of(lvalue_take(v, 1));
+    return lvalue_seq(lseq_take(count, source));
+}
+
+/**
+ * (lreduce f init s); folds the elements of s into init with f from the left.
+ * The elements are produced one at a time, so it runs in constant memory.
+ */
+struct lvalue *builtin_lreduce(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "lreduce", 3);
+    LARG_CALLABLE(v, "lreduce", 0);
+    LARG_SEQ(v, "lreduce", 2);
+
+    struct lvalue *func = lvalue_pop(v, 0);
+    struct lvalue *acc = lvalue_pop(v, 0);
+    struct lseq *seq = lseq_of(lvalue_take(v, 0));
+    struct lseq_cursor *cursor = lseq_cursor_new(seq);
+
+    struct lvalue *x;
+    int rc;
+    while ( (rc = lseq_next(e, cursor, &x)) > 0 ) {
+        struct lvalue *args = lvalue_add(lvalue_add(lvalue_sexpr(), acc), x);
+        acc = lvalue_call(e, func, args);
+        if ( acc->type == LVAL_ERR ) {
+            break;
+        }
+    }
+    if ( rc < 0 ) {
+        lvalue_del(acc);
+        acc = x;
+    }
+
+    lseq_cursor_del(cursor);
+    lseq_del(seq);
+    lvalue_del(func);
+    return acc;
+}
+
+/**
+ * (lcollect s); the elements of a finite sequence as a q-expression
+ */
+struct lvalue *builtin_lcollect(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "lcollect", 1);
+    LARG_SEQ(v, "lcollect", 0);
+
+    struct lseq *seq = lseq_of(lvalue_take(v, 0));
+    struct lseq_cursor *cursor = lseq_cursor_new(seq);
+
+    struct lvalue *res = lvalue_qexpr();
+    struct lvalue *x;
+    int rc;
+    while ( (rc = lseq_next(e, cursor, &x)) > 0 ) {
+        lvalue_add(res, x);
+    }
+    if ( rc < 0 ) {
+        lvalue_del(res);
+        res = x;
+    }
+
+    lseq_cursor_del(cursor);
+    lseq_del(seq);
+    return res;
+}
+
+/* * coroutine builtins * */
+
+/**
+ * Calls a function with the given arguments in a new coroutine
+ */
+struct lvalue *builtin_spawn(struct lenvironment *e, struct lvalue *v) {
+    LNUM_LEAST_ARGS(v, "spawn", (size_t) 1);
+    LARG_CALLABLE(v, "spawn", 0);
+
+    struct lvalue *func = lvalue_pop(v, 0);
+    return lco_spawn(e->ctx, func, v);
+}
+
+struct lvalue *builtin_yield(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(argv);
+    LSPAN_NUM_ARGS("yield", 1);
+
+    lco_yield(ctx);
+    return lvalue_sexpr();
+}
+
+/**
+ * Makes a channel buffering the given number of values
+ */
+struct lvalue *builtin_chan(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("chan", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_INT, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s'; got '%s'.", "chan", ltype_name(LVAL_INT), ltype_name(argv[0]->type));
+    LSPAN_ASSERT(argv[0]->val.intval >= 0, "Capacity of '%s' must not be negative; got %lld.", "chan", argv[0]->val.intval);
+
+    struct lchan *chan = lchan_new((size_t) argv[0]->val.intval);
+    LSPAN_ASSERT(chan != NULL, "Could not allocate channel of capacity %lld.", argv[0]->val.intval);
+    return lvalue_chan(chan);
+}
+
+struct lvalue *builtin_send(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_NUM_ARGS("send", 2);
+    LSPAN_ASSERT(argv[0]->type == LVAL_CHAN, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s'; got '%s'.", "send", ltype_name(LVAL_CHAN), ltype_name(argv[0]->type));
+
+    return lchan_send(ctx, argv[0]->val.chan, lvalue_copy(argv[1]));
+}
+
+struct lvalue *builtin_recv(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_NUM_ARGS("recv", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_CHAN, "Wrong type of argument parsed to '%s'. Expected argument to be of type '%s'; got '%s'.", "recv", ltype_name(LVAL_CHAN), ltype_name(argv[0]->type));
+
+    return lchan_recv(ctx, argv[0]->val.chan);
+}
+
+/* * regular expression builtins * */
+
+/* the compiled form of the pattern 'pattern' from the cache of the interpreter */
+static struct lre *builtin_regex(struct lisper_ctx *ctx, const char *func_name, const char *pattern, struct lvalue **err) {
+    const char *msg = NULL;
+    struct lre *re = lre_cache_get(&ctx->re, pattern, &msg);
+    if ( re == NULL ) {
+        *err = lvalue_err("Invalid pattern '%s' parsed to '%s'. %s.", pattern, func_name, msg);
+    }
+    return re;
+}
+
+/* s[from..to) as a string */
+static struct lvalue *builtin_substr(const char *s, long from, long to) {
+    if ( from < 0 ) {
+        return lvalue_str("");
+    }
+    char *sub = malloc((size_t) (to - from) + 1);
+    if ( sub == NULL ) {
+        perror("Could not allocate string");
+        exit(1);
+    }
+    memcpy(sub, s + from, (size_t) (to - from));
+    sub[to - from] = '\0';
+    struct lvalue *str = lvalue_str(sub);
+    free(sub);
+    return str;
+}
+
+struct rebuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void rebuf_append(struct rebuf *b, const char *s, size_t n) {
+    if ( b->len + n + 1 > b->cap ) {
+        b->cap = (b->len + n + 1) * 2;
+        b->data = realloc(b->data, b->cap);
+        if ( b->data == NULL ) {
+            perror("Could not grow string");
+            exit(1);
+        }
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+#define LSPAN_STR_ARGS(func_name, numargs) do { \
+    LSPAN_NUM_ARGS(func_name, numargs); \
+    for ( size_t i = 0; i < argc; i++ ) { \
+        LSPAN_ASSERT(argv[i]->type == LVAL_STR, "Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", func_name, i + 1, ltype_name(LVAL_STR), ltype_name(argv[i]->type)); \
+    } \
+} while (0)
+
+/**
+ * (re-match re s); whether the whole of s matches the pattern re
+ */
+struct lvalue *builtin_re_match(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_STR_ARGS("re-match", 2);
+
+    struct lvalue *err = NULL;
+    struct lre *re = builtin_regex(ctx, "re-match", argv[0]->val.strval, &err);
+    if ( re == NULL ) {
+        return err;
+    }
+
+    const char *s = argv[1]->val.strval;
+    long caps[2 * (LRE_MAX_GROUPS + 1)];
+    return lvalue_bool(lre_search(re, s, strlen(s), 0, 1, caps));
+}
+
+/**
+ * (re-find re s); the first match of re in s followed by its groups,
+ * empty strings for groups that took no part, or {} with no match
+ */
+struct lvalue *builtin_re_find(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_STR_ARGS("re-find", 2);
+
+    struct lvalue *err = NULL;
+    struct lre *re = builtin_regex(ctx, "re-find", argv[0]->val.strval, &err);
+    if ( re == NULL ) {
+        return err;
+    }
+
+    const char *s = argv[1]->val.strval;
+    long caps[2 * (LRE_MAX_GROUPS + 1)];
+    struct lvalue *res = lvalue_qexpr();
+    if ( lre_search(re, s, strlen(s), 0, 0, caps) ) {
+        for ( size_t g = 0; g <= lre_groups(re); ++g ) {
+            lvalue_add(res, builtin_substr(s, caps[2 * g], caps[2 * g + 1]));
+        }
+    }
+    return res;
+}
+
+/**
+ * (re-split re s); the parts of s between the matches of re. Like
+ * re-replace, it ignores empty matches.
+ */
+struct lvalue *builtin_re_split(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_STR_ARGS("re-split", 2);
+
+    struct lvalue *err = NULL;
+    struct lre *re = builtin_regex(ctx, "re-split", argv[0]->val.strval, &err);
+    if ( re == NULL ) {
+        return err;
+    }
+
+    const char *s = argv[1]->val.strval;
+    size_t len = strlen(s);
+    long caps[2 * (LRE_MAX_GROUPS + 1)];
+    struct lvalue *res = lvalue_qexpr();
+    size_t part = 0, from = 0;
+    while ( from <= len && lre_search(re, s, len, from, 0, caps) ) {
+        if ( caps[1] == caps[0] ) {
+            /* an empty match splits nothing; look again one byte on */
+            from = (size_t) caps[0] + 1;
+            continue;
+        }
+        lvalue_add(res, builtin_substr(s, (long) part, caps[0]));
+        part = from = (size_t) caps[1];
+    }
+    lvalue_add(res, builtin_substr(s, (long) part, (long) len));
+    return res;
+}
+
+/**
+ * (re-replace re s replacement); s with every match of re replaced.
+ * \0 to \9 in the replacement stand for the match and its groups, and
+ * \\ for a backslash. Like re-split, it ignores empty matches.
+ */
+struct lvalue *builtin_re_replace(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    LSPAN_STR_ARGS("re-replace", 3);
+
+    struct lvalue *err = NULL;
+    struct lre *re = builtin_regex(ctx, "re-replace", argv[0]->val.strval, &err);
+    if ( re == NULL ) {
+        return err;
+    }
+
+    const char *s = argv[1]->val.strval;
+    const char *repl = argv[2]->val.strval;
+    size_t len = strlen(s);
+    long caps[2 * (LRE_MAX_GROUPS + 1)];
+    struct rebuf out = { NULL, 0, 0 };
+    rebuf_append(&out, "", 0);
+
+    size_t part = 0, from = 0;
+    while ( from <= len && lre_search(re, s, len, from, 0, caps) ) {
+        if ( caps[1] == caps[0] ) {
+            /* an empty match replaces nothing; look again one byte on */
+            from = (size_t) caps[0] + 1;
+            continue;
+        }
+        rebuf_append(&out, s + part, (size_t) caps[0] - part);
+        for ( const char *r = repl; *r != '\0'; ++r ) {
+            if ( r[0] == '\\' && r[1] >= '0' && r[1] <= '9' ) {
+                size_t g = (size_t) (*++r - '0');
+                if ( g <= lre_groups(re) && caps[2 * g] >= 0 ) {
+                    rebuf_append(&out, s + caps[2 * g], (size_t) (caps[2 * g + 1] - caps[2 * g]));
+                }
+            } else if ( r[0] == '\\' && r[1] == '\\' ) {
+                rebuf_append(&out, ++r, 1);
+            } else {
+                rebuf_append(&out, r, 1);
+            }
+        }
+        part = from = (size_t) caps[1];
+    }
+    rebuf_append(&out, s + part, len - part);
+
+    struct lvalue *res = lvalue_str(out.data);
+    free(out.data);
+    return res;
+}
+
+/* * value definition builtins * */
+
+struct lvalue *builtin_var(struct lenvironment *, struct lvalue *, char *);
+
+struct lvalue *builtin_def(struct lenvironment *e, struct lvalue *v) {
+    return builtin_var(e, v, "def");
+}
+
+struct lvalue *builtin_put(struct lenvironment *e, struct lvalue *v) {
+    return builtin_var(e, v, "=");
+}
+
+struct lvalue *builtin_var(struct lenvironment *e, struct lvalue *v, char *sym) {
+    LARG_TYPE(v, sym, 0, LVAL_QEXPR);
+
+    struct lvalue *names = LGETCELL(v, 0);
+
+    for ( size_t i = 0; i < names->val.l.count; ++i ) {
+        LASSERT(v, LGETCELL(names, i)->type == LVAL_SYM, "Function '%s' cannot assign value(s) to name(s). Name %lu is of type '%s'; expected type '%s'.", sym, i, ltype_name(LGETCELL(names, i)->type), ltype_name(LVAL_SYM));
+    }
+
+    LASSERT(v, names->val.l.count == v->val.l.count - 1, "Function '%s' cannot assign value(s) to name(s). Number of name(s) and value(s) does not match. Saw %lu name(s) expected %lu value(s).", sym, names->val.l.count, v->val.l.count - 1);
+
+    for ( size_t i = 0; i < names->val.l.count; ++i ) {
+        /* a lambda is known by the first name it is bound to, in traces and profiles */
+        struct lvalue *val = LGETCELL(v, i + 1);
+        if ( val->type == LVAL_FUNCTION && val->val.fun->name == NULL ) {
+            val->val.fun->name = LGETCELL(names, i)->val.strval;
+        }
+
+        if ( strcmp(sym, "def") == 0 ) {
+            lenvironment_def(e, LGETCELL(names, i), LGETCELL(v, i + 1));
+        } else if ( strcmp(sym, "=") == 0 ) {
+            lenvironment_put(e, LGETCELL(names, i), LGETCELL(v, i + 1));
+        }
+    }
+
+    lvalue_del(v);
+    return lvalue_sexpr();
+}
+
+/* * comparison builtins * */
+
+struct lvalue *builtin_ord(size_t argc, struct lvalue **argv, char *sym);
+
+struct lvalue *builtin_lt(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    return builtin_ord(argc, argv, "<");
+}
+
+struct lvalue *builtin_gt(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    return builtin_ord(argc, argv, ">");
+}
+
+struct lvalue *builtin_le(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    return builtin_ord(argc, argv, "<=");
+}
+
+struct lvalue *builtin_ge(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    return builtin_ord(argc, argv, ">=");
+}
+
+struct lvalue *builtin_ord(size_t argc, struct lvalue **argv, char *sym) {
+    LSPAN_NUM_ARGS(sym, 2);
+
+    struct lvalue *lhs = argv[0];
+    struct lvalue *rhs = argv[1];
+
+    LSPAN_ASSERT(LIS_NUM(lhs->type), "Wrong type of argument parsed to '%s'. Expected '%s' or '%s' got '%s'.", sym, ltype_name(LVAL_INT), ltype_name(LVAL_FLOAT), ltype_name(lhs->type));
+    LSPAN_ASSERT(LIS_NUM(rhs->type), "Wrong type of argument parsed to '%s'. Expected '%s' or '%s' got '%s'.", sym, ltype_name(LVAL_INT), ltype_name(LVAL_FLOAT), ltype_name(rhs->type));
+    LSPAN_ASSERT(lhs->type == rhs->type, "Type of arguments does not match. Argument %i is of type '%s'; argument %i is of type '%s'.", 1, ltype_name(lhs->type), 2, ltype_name(rhs->type));
+
+    /* -1, 0 or 1 as lhs is less than, equal to or greater than rhs */
+    int order = 0;
+    if ( lhs->type == LVAL_INT ) {
+        order = (lhs->val.intval > rhs->val.intval) - (lhs->val.intval < rhs->val.intval);
+    } else {
+        order = (lhs->val.floatval > rhs->val.floatval) - (lhs->val.floatval < rhs->val.floatval);
+    }
+
+    long long res = 0;
+    if ( strcmp(sym, "<") == 0 ) {
+        res = (order < 0);
+    } else if ( strcmp(sym, ">") == 0 ) {
+        res = (order > 0);
+    } else if ( strcmp(sym, "<=") == 0 ) {
+        res = (order <= 0);
+    } else if ( strcmp(sym, ">=") == 0 ) {
+        res = (order >= 0);
+    }
+
     return lvalue_bool(res);
 }
 
-struct lvalue *builtin_eq(struct lenvironment *e, struct lvalue *v) {
-    return builtin_cmp(e, v, "==");
+struct lvalue *builtin_eq(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("==", 2);
+    return lvalue_bool(lvalue_eq(argv[0], argv[1]));
 }
 
-struct lvalue *builtin_ne(struct lenvironment *e, struct lvalue *v) {
-    return builtin_cmp(e, v, "!=");
+struct lvalue *builtin_ne(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("!=", 2);
+    return lvalue_bool(!lvalue_eq(argv[0], argv[1]));
 }
 
 /* logical builtins */
@@ -899,53 +1738,357 @@ struct lvalue *builtin_or(struct lenvironment *e, struct lvalue *v) {
     return lvalue_bool(res);
 }
 
-struct lvalue *builtin_not(struct lenvironment *e, struct lvalue *v) {
-    UNUSED(e);
-    LNUM_ARGS(v, "!", 1);
-    LARG_TYPE(v, "!", 0, LVAL_BOOL);
+struct lvalue *builtin_not(struct lisper_ctx *ctx, size_t argc, struct lvalue **argv) {
+    UNUSED(ctx);
+    LSPAN_NUM_ARGS("!", 1);
+    LSPAN_ASSERT(argv[0]->type == LVAL_BOOL, "Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", "!", (size_t) 1, ltype_name(LVAL_BOOL), ltype_name(argv[0]->type));
+
+    return lvalue_bool(!argv[0]->val.intval);
+}
+
+/* * special forms * */
+
+/*
+ * Evaluate the operands of a special form that needs all of them,
+ * implicitly quoting a leading name symbol when 'quote_name' is set.
+ * Returns the operands or the first error.
+ */
+static struct lvalue *special_operands(struct lenvironment *e, struct lvalue *v, int quote_name) {
+    if ( quote_name && v->val.l.count > 0 && LGETCELL(v, 0)->type == LVAL_SYM ) {
+        v->val.l.cells[0] = lvalue_add(lvalue_qexpr(), LGETCELL(v, 0));
+    }
+
+    for ( size_t i = 0; i < v->val.l.count; i++ ) {
+        v->val.l.cells[i] = lvalue_eval(e, v->val.l.cells[i]);
+    }
+    v->hash = 0;
+
+    for ( size_t i = 0; i < v->val.l.count; i++ ) {
+        if ( LGETCELL(v, i)->type == LVAL_ERR ) {
+            return lvalue_take(v, i);
+        }
+    }
+    return v;
+}
+
+/**
+ * Only the condition and the branch taken are evaluated; the
+ * operands are borrowed, so the branch not taken is never copied.
+ */
+static struct lvalue *special_if_span(struct lenvironment *e, size_t argc, struct lvalue **argv) {
+    LSPAN_NUM_ARGS("if", 3);
+
+    struct lvalue *cond = lvalue_eval_borrowed(e, argv[0]);
+    if ( cond->type == LVAL_ERR ) {
+        return cond;
+    }
+    if ( cond->type != LVAL_BOOL ) {
+        struct lvalue *err = lvalue_err("Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", "if", 1lu, ltype_name(LVAL_BOOL), ltype_name(cond->type));
+        lvalue_del(cond);
+        return err;
+    }
 
-    long long res = !v->val.l.cells[0]->val.intval;
+    struct lvalue *branch = argv[cond->val.intval ? 1 : 2];
+    size_t position = cond->val.intval ? 2 : 3;
+    lvalue_del(cond);
 
+    if ( branch->type == LVAL_QEXPR ) {
+        return lvalue_eval_cells(e, branch->val.l.count, branch->val.l.cells);
+    }
+
+    /* branch computed at runtime; e.g. a name bound to a q-expression */
+    struct lvalue *code = lvalue_eval_borrowed(e, branch);
+    if ( code->type == LVAL_ERR ) {
+        return code;
+    }
+    LASSERT(code, code->type == LVAL_QEXPR, "Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", "if", position, ltype_name(LVAL_QEXPR), ltype_name(code->type));
+    code->type = LVAL_SEXPR;
+    return lvalue_eval(e, code);
+}
+
+static struct lvalue *special_if(struct lenvironment *e, struct lvalue *v) {
+    struct lvalue *res = special_if_span(e, v->val.l.count, v->val.l.cells);
     lvalue_del(v);
-    return lvalue_bool(res);
+    return res;
 }
 
-/* source importation builtins */
+/**
+ * Short-circuiting logical operator; evaluation of the operands
+ * stops at the first one equal to 'stop'.
+ */
+static struct lvalue *special_logic(struct lenvironment *e, size_t argc, struct lvalue **argv, char *sym, long long stop) {
+    LSPAN_NUM_ARGS(sym, 2);
 
-struct lvalue *builtin_load(struct lenvironment *e, struct lvalue *v) {
-    LNUM_ARGS(v, "load", 1);
-    LARG_TYPE(v, "load", 0, LVAL_STR);
+    struct lvalue *res = NULL;
+    for ( size_t i = 0; i < 2; ++i ) {
+        res = lvalue_eval_borrowed(e, argv[i]);
+        if ( res->type == LVAL_ERR ) {
+            break;
+        }
+        if ( res->type != LVAL_BOOL ) {
+            struct lvalue *err = lvalue_err("Wrong type of argument parsed to '%s' at argument position %lu. Expected argument to be of type '%s'; got '%s'.", sym, i + 1, ltype_name(LVAL_BOOL), ltype_name(res->type));
+            lvalue_del(res);
+            res = err;
+            break;
+        }
+        if ( (res->val.intval != 0) == stop ) {
+            break;
+        }
+        if ( i == 0 ) {
+            lvalue_del(res);
+        }
+    }
+    return res;
+}
 
-    mpc_result_t r;
-    if ( mpc_parse_contents(LGETCELL(v, 0)->val.strval, elems.Lisper, &r) ) {
+static struct lvalue *special_and_span(struct lenvironment *e, size_t argc, struct lvalue **argv) {
+    return special_logic(e, argc, argv, "&&", 0);
+}
 
-        struct lvalue *expr = lvalue_read(r.output);
-        mpc_ast_delete(r.output);
+static struct lvalue *special_or_span(struct lenvironment *e, size_t argc, struct lvalue **argv) {
+    return special_logic(e, argc, argv, "||", 1);
+}
+
+static struct lvalue *special_and(struct lenvironment *e, struct lvalue *v) {
+    struct lvalue *res = special_and_span(e, v->val.l.count, v->val.l.cells);
+    lvalue_del(v);
+    return res;
+}
+
+static struct lvalue *special_or(struct lenvironment *e, struct lvalue *v) {
+    struct lvalue *res = special_or_span(e, v->val.l.count, v->val.l.cells);
+    lvalue_del(v);
+    return res;
+}
+
+static struct lvalue *special_def(struct lenvironment *e, struct lvalue *v) {
+    v = special_operands(e, v, 1);
+    return v->type == LVAL_ERR ? v : builtin_def(e, v);
+}
+
+static struct lvalue *special_put(struct lenvironment *e, struct lvalue *v) {
+    v = special_operands(e, v, 1);
+    return v->type == LVAL_ERR ? v : builtin_put(e, v);
+}
 
-        while ( expr->val.l.count ) {
-            struct lvalue *x = lvalue_eval(e, lvalue_pop(expr, 0));
+static struct lvalue *special_fn(struct lenvironment *e, struct lvalue *v) {
+    v = special_operands(e, v, 1);
+    return v->type == LVAL_ERR ? v : builtin_fn(e, v);
+}
+
+static struct lvalue *special_lambda(struct lenvironment *e, struct lvalue *v) {
+    v = special_operands(e, v, 0);
+    return v->type == LVAL_ERR ? v : builtin_lambda(e, v);
+}
 
-            if ( x->type == LVAL_ERR ) {
-                lvalue_println(x);
+/*
+ * The expression to be timed is not evaluated first; it is quoted, unless
+ * it is a q-expression already.
+ */
+static struct lvalue *special_time(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "time", 1);
+
+    if ( LGETCELL(v, 0)->type != LVAL_QEXPR ) {
+        v->val.l.cells[0] = lvalue_add(lvalue_qexpr(), LGETCELL(v, 0));
+        v->hash = 0;
+    }
+    return builtin_time(e, v);
+}
+
+static struct lvalue *special_bench(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "bench", 2);
+
+    v->val.l.cells[0] = lvalue_eval(e, LGETCELL(v, 0));
+    if ( LGETCELL(v, 0)->type == LVAL_ERR ) {
+        return lvalue_take(v, 0);
+    }
+    if ( LGETCELL(v, 1)->type != LVAL_QEXPR ) {
+        v->val.l.cells[1] = lvalue_add(lvalue_qexpr(), LGETCELL(v, 1));
+    }
+    v->hash = 0;
+    return builtin_bench(e, v);
+}
+
+static const struct lspecial_form special_forms[] = {
+    { "if", builtin_if, special_if, special_if_span },
+    { "&&", builtin_and, special_and, special_and_span },
+    { "||", builtin_or, special_or, special_or_span },
+    { "def", builtin_def, special_def, NULL },
+    { "=", builtin_put, special_put, NULL },
+    { "fn", builtin_fn, special_fn, NULL },
+    { "\\", builtin_lambda, special_lambda, NULL },
+    { "time", builtin_time, special_time, NULL },
+    { "bench", builtin_bench, special_bench, NULL },
+};
+
+/*
+ * Tag the interned names of the special forms, so the evaluator
+ * recognizes them by symbol identity.
+ */
+static void register_special_forms(struct lenvironment *e) {
+    for ( size_t i = 0; i < sizeof(special_forms) / sizeof(special_forms[0]); ++i ) {
+        char *name = lsymtab_intern(&e->ctx->symbols, special_forms[i].name);
+        lsymbol_of(name)->special = &special_forms[i];
+    }
+}
+
+/* source importation builtins */
+
+/*
+ * Starts parsing the files of the top-level '(load "path")' and
+ * '(import "path")' expressions of 'forms', so they are parsed on other
+ * threads while the expressions before them are evaluated. Modules that
+ * are imported already or have a cached parse are left alone.
+ */
+static void builtin_load_prefetch(struct lisper_ctx *ctx, struct lvalue *forms) {
+    for ( size_t i = 0; i < forms->val.l.count; ++i ) {
+        struct lvalue *form = forms->val.l.cells[i];
+        if ( form->type != LVAL_SEXPR || form->val.l.count != 2 ||
+             form->val.l.cells[0]->type != LVAL_SYM || form->val.l.cells[1]->type != LVAL_STR ) {
+            continue;
+        }
+        char *name = form->val.l.cells[0]->val.strval;
+        char *path = form->val.l.cells[1]->val.strval;
+        if ( strcmp(name, "load") == 0 ) {
+            lparse_prefetch(ctx, path);
+        } else if ( strcmp(name, "import") == 0 ) {
+            char *module = lmodule_resolve(path);
+            if ( module != NULL && !lmodules_contains(&ctx->modules, module) && !lmodule_cache_valid(module) ) {
+                lparse_prefetch(ctx, module);
             }
-            lvalue_del(x);
+            free(module);
         }
+    }
+}
 
-        lvalue_del(expr);
-        lvalue_del(v);
-
-        return lvalue_sexpr();
-    } else {
+/*
+ * Parses the file at 'path' into a s-expression of its top-level
+ * expressions. Large files are parsed in chunks on several threads.
+ */
+static struct lvalue *builtin_parse_file(struct lisper_ctx *ctx, const char *path, const char *what) {
+    struct lparse_file *f = lparse_file_open(ctx, path);
+    if ( !lparse_file_wait(ctx, f) ) {
         /* parse error */
-        char *err_msg = mpc_err_string(r.error);
-        mpc_err_delete(r.error);
+        char *err_msg = lparse_file_error(f);
+        lparse_file_del(ctx, f);
 
-        struct lvalue *err = lvalue_err("Could not load library %s", err_msg);
+        struct lvalue *err = lvalue_err("Could not %s %s", what, err_msg);
         free(err_msg);
+        return err;
+    }
+
+    struct lvalue *forms = lvalue_sexpr();
+    for ( size_t i = 0; i < f->count; ++i ) {
+        struct lvalue *expr = lvalue_read(f->chunks[i].r.output);
+        mpc_ast_delete(f->chunks[i].r.output);
+        f->chunks[i].r.output = NULL;
+
+        if ( forms->val.l.count == 0 ) {
+            lvalue_del(forms);
+            forms = expr;
+            continue;
+        }
+        /* move the cells over at once rather than pop them one by one */
+        size_t count = forms->val.l.count + expr->val.l.count;
+        struct lvalue **resized = realloc(forms->val.l.cells, count * sizeof(struct lvalue *));
+        if ( resized == NULL ) {
+            perror("Could not resize lvalue cell buffer");
+            exit(1);
+        }
+        memcpy(resized + forms->val.l.count, expr->val.l.cells, expr->val.l.count * sizeof(struct lvalue *));
+        forms->val.l.cells = resized;
+        forms->val.l.count = count;
+        expr->val.l.count = 0;
+        lvalue_del(expr);
+    }
+
+    lparse_file_del(ctx, f);
+    return forms;
+}
+
+/*
+ * Evaluates the top-level expressions of 'forms' in order, and deletes
+ * it. Errors are printed and evaluation goes on with the next expression.
+ */
+static void builtin_eval_forms(struct lenvironment *e, struct lvalue *forms) {
+    builtin_load_prefetch(e->ctx, forms);
+
+    for ( size_t i = 0; i < forms->val.l.count; ++i ) {
+        /* whatever the form left in the region is dropped at once */
+        struct lregion_mark mark = lregion_mark(&e->ctx->region);
+        struct lvalue *x = lvalue_eval(e, forms->val.l.cells[i]);
+        forms->val.l.cells[i] = NULL;
+
+        if ( x->type == LVAL_ERR ) {
+            lvalue_println(x);
+        }
+        lvalue_del(x);
+        lregion_release(&e->ctx->region, mark);
+        lisper_ctx_trim(e->ctx, 0);
+    }
+
+    forms->val.l.count = 0;
+    lvalue_del(forms);
+}
+
+/**
+ * Evaluates the expressions of a file in order. The whole file is
+ * parsed before anything is evaluated.
+ */
+struct lvalue *builtin_load(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "load", 1);
+    LARG_TYPE(v, "load", 0, LVAL_STR);
+
+    const char *path = LGETCELL(v, 0)->val.strval;
+    LPROBE1(load_start, path);
+    struct lvalue *forms = builtin_parse_file(e->ctx, path, "load library");
+    if ( forms->type == LVAL_ERR ) {
         lvalue_del(v);
+        return forms;
+    }
 
-        return err;
+    size_t count = forms->val.l.count;
+    builtin_eval_forms(e, forms);
+    LPROBE2(load_done, path, count);
+    lvalue_del(v);
+    return lvalue_sexpr();
+}
+
+/**
+ * Loads a module once per interpreter; importing it again does nothing.
+ * The parsed expressions are cached on disk next to the module, and
+ * used for as long as the module and the interpreter stay the same.
+ */
+struct lvalue *builtin_import(struct lenvironment *e, struct lvalue *v) {
+    LNUM_ARGS(v, "import", 1);
+    LARG_TYPE(v, "import", 0, LVAL_STR);
+
+    char *path = lmodule_resolve(LGETCELL(v, 0)->val.strval);
+    LASSERT(v, path != NULL, "Could not import '%s'. %s", LGETCELL(v, 0)->val.strval, strerror(errno));
+    lvalue_del(v);
+
+    if ( lmodules_contains(&e->ctx->modules, path) ) {
+        free(path);
+        return lvalue_sexpr();
+    }
+
+    LPROBE1(load_start, path);
+    struct lvalue *forms = lmodule_cache_read(path);
+    if ( forms == NULL ) {
+        forms = builtin_parse_file(e->ctx, path, "import");
+        if ( forms->type == LVAL_ERR ) {
+            free(path);
+            return forms;
+        }
+        lmodule_cache_write(path, forms);
     }
+
+    /* registered before it is evaluated, so an import cycle stops here */
+    lmodules_add(&e->ctx->modules, path);
+    size_t count = forms->val.l.count;
+    builtin_eval_forms(e, forms);
+    LPROBE2(load_done, path, count);
+    return lvalue_sexpr();
 }
 
 void register_builtins(struct lenvironment *e) {
@@ -955,17 +2098,18 @@ void register_builtins(struct lenvironment *e) {
     LENV_BUILTIN(eval);
     LENV_BUILTIN(join);
     LENV_BUILTIN(cons);
-    LENV_BUILTIN(len);
     LENV_BUILTIN(init);
     LENV_BUILTIN(def);
     LENV_BUILTIN(exit);
-    LENV_BUILTIN(max);
-    LENV_BUILTIN(min);
     LENV_BUILTIN(fn);
     LENV_BUILTIN(if);
+    LENV_BUILTIN(while);
+    LENV_BUILTIN(dotimes);
+    LENV_BUILTIN(let);
+    LENV_BUILTIN(do);
     LENV_BUILTIN(args);
-    LENV_BUILTIN(type);
     LENV_BUILTIN(load);
+    LENV_BUILTIN(import);
     LENV_BUILTIN(error);
     LENV_BUILTIN(print);
     LENV_BUILTIN(read);
@@ -976,25 +2120,62 @@ void register_builtins(struct lenvironment *e) {
     LENV_BUILTIN(putstr);
     LENV_BUILTIN(rewind);
     LENV_BUILTIN(getstr);
-
-    LENV_SYMBUILTIN("+", add);
-    LENV_SYMBUILTIN("-", sub);
-    LENV_SYMBUILTIN("*", mul);
-    LENV_SYMBUILTIN("/", div);
-    LENV_SYMBUILTIN("%", mod);
+    LENV_BUILTIN(memo);
+
+    LENV_SYMBUILTIN("memo-stats", memo_stats);
+    LENV_BUILTIN(range);
+    LENV_BUILTIN(iterate);
+    LENV_SYMBUILTIN("lines-of", lines_of);
+    LENV_BUILTIN(lmap);
+    LENV_BUILTIN(lfilter);
+    LENV_BUILTIN(ltake);
+    LENV_BUILTIN(lreduce);
+    LENV_BUILTIN(lcollect);
+    LENV_SYMBUILTIN("for-range", for_range);
+    LENV_SYMBUILTIN("progn", do);
+    LENV_SYMBUILTIN("with-limits", with_limits);
+    LENV_BUILTIN(time);
+    LENV_BUILTIN(bench);
+    LENV_BUILTIN(spawn);
+
+    LENV_SPANBUILTIN("max", max);
+    LENV_SPANBUILTIN("min", min);
+    LENV_SPANBUILTIN("len", len);
+    LENV_SPANBUILTIN("type", type);
+    LENV_SPANBUILTIN("parse-int", parse_int);
+    LENV_SPANBUILTIN("parse-float", parse_float);
+    LENV_SPANBUILTIN("to-string", to_string);
+    LENV_SPANBUILTIN("re-match", re_match);
+    LENV_SPANBUILTIN("re-find", re_find);
+    LENV_SPANBUILTIN("re-split", re_split);
+    LENV_SPANBUILTIN("re-replace", re_replace);
+    LENV_SPANBUILTIN("heap-trim", heap_trim);
+    LENV_SPANBUILTIN("clock-ns", clock_ns);
+    LENV_SPANBUILTIN("yield", yield);
+    LENV_SPANBUILTIN("chan", chan);
+    LENV_SPANBUILTIN("send", send);
+    LENV_SPANBUILTIN("recv", recv);
+
+    LENV_SPANBUILTIN("+", add);
+    LENV_SPANBUILTIN("-", sub);
+    LENV_SPANBUILTIN("*", mul);
+    LENV_SPANBUILTIN("/", div);
+    LENV_SPANBUILTIN("%", mod);
     LENV_SYMBUILTIN("\\", lambda);
     LENV_SYMBUILTIN("=", put);
 
-    LENV_SYMBUILTIN("==", eq);
-    LENV_SYMBUILTIN("!=", ne);
+    LENV_SPANBUILTIN("==", eq);
+    LENV_SPANBUILTIN("!=", ne);
 
     LENV_SYMBUILTIN("||", or);
     LENV_SYMBUILTIN("&&", and);
-    LENV_SYMBUILTIN("!", not);
+    LENV_SPANBUILTIN("!", not);
+
+    LENV_SPANBUILTIN(">", gt);
+    LENV_SPANBUILTIN("<", lt);
+    LENV_SPANBUILTIN(">=", ge);
+    LENV_SPANBUILTIN("<=", le);
 
-    LENV_SYMBUILTIN(">", gt);
-    LENV_SYMBUILTIN("<", lt);
-    LENV_SYMBUILTIN(">=", ge);
-    LENV_SYMBUILTIN("<=", le);
+    register_special_forms(e);
 }
 
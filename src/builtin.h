@@ -4,7 +4,20 @@
 #include "value.h"
 #include "environment.h"
 
+/*
+ * A special form receives its operands unevaluated. It stands in for
+ * 'builtin' at the head of an s-expression for as long as its name is
+ * bound to that builtin.
+ */
+struct lspecial_form {
+    char *name;
+    struct lvalue *(*builtin)(struct lenvironment *, struct lvalue *);
+    struct lvalue *(*eval)(struct lenvironment *, struct lvalue *);
+    struct lvalue *(*span)(struct lenvironment *, size_t, struct lvalue **); /* borrows the operands; or NULL */
+};
+
 struct lvalue *builtin_load(struct lenvironment *, struct lvalue *);
+struct lvalue *builtin_import(struct lenvironment *, struct lvalue *);
 
 void register_builtins(struct lenvironment *e);
 
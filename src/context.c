@@ -0,0 +1,124 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "context.h"
+#include "environment.h"
+#include "builtin.h"
+#include "mempool.h"
+#include "probe.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(_MSC_VER)
+#define LISPER_THREAD_LOCAL __declspec(thread)
+#else
+#define LISPER_THREAD_LOCAL _Thread_local
+#endif
+
+static const size_t hash_size = 500;
+static const size_t lvalue_mempool_size = 10000;
+
+/* the context that lvalue allocations on this thread are served from */
+static LISPER_THREAD_LOCAL struct lisper_ctx *current_ctx = NULL;
+
+/*
+ * Creates a new interpreter context with the builtins registered
+ * and the grammar compiled. The new context is made current for
+ * the calling thread.
+ */
+struct lisper_ctx *lisper_ctx_new(int argc, char **argv) {
+    struct lisper_ctx *ctx = malloc(sizeof(struct lisper_ctx));
+    if ( ctx == NULL ) {
+        return NULL;
+    }
+
+    ctx->args.argc = argc;
+    ctx->args.argv = argv;
+    memset(&ctx->jit, 0, sizeof(ctx->jit));
+    memset(&ctx->perf_map, 0, sizeof(ctx->perf_map));
+    lre_cache_init(&ctx->re);
+    lwriter_init(&ctx->out, stdout);
+    lwriter_init(&ctx->text, NULL);
+    lreaders_init(&ctx->readers);
+    lregion_init(&ctx->region);
+    lco_sched_init(&ctx->co);
+    ctx->parse = NULL;
+    lmodules_init(&ctx->modules);
+    lbudget_init(&ctx->budget);
+    memset(&ctx->limits, 0, sizeof(ctx->limits));
+
+    ctx->lvalue_mp = mempool_init(sizeof(struct lvalue), lvalue_mempool_size);
+    if ( ctx->lvalue_mp == NULL ) {
+        free(ctx);
+        return NULL;
+    }
+
+    lisper_ctx_enter(ctx);
+
+    lsymtab_init(&ctx->symbols);
+    ctx->env = lenvironment_new(hash_size);
+    register_builtins(ctx->env);
+
+    grammar_elems_init(&ctx->elems);
+    grammar_make_lang(&ctx->elems);
+
+    return ctx;
+}
+
+void lisper_ctx_del(struct lisper_ctx *ctx) {
+    if ( ctx == NULL ) {
+        return;
+    }
+    struct lisper_ctx *prev = lisper_ctx_enter(ctx);
+
+    lco_sched_destroy(&ctx->co);
+    lparse_pool_del(ctx->parse); /* its threads parse with the grammar */
+    grammar_elems_destroy(&ctx->elems);
+    lenvironment_del(ctx->env);
+    lregion_destroy(&ctx->region);
+    lre_cache_destroy(&ctx->re);
+    lwriter_destroy(&ctx->text);
+    lwriter_destroy(&ctx->out);
+    lreaders_destroy(&ctx->readers);
+    lmodules_destroy(&ctx->modules);
+    ljit_perf_map_close(ctx);
+    lsymtab_destroy(&ctx->symbols);
+    mempool_del(ctx->lvalue_mp);
+
+    lisper_ctx_enter(prev == ctx ? NULL : prev);
+    free(ctx);
+}
+
+struct lisper_ctx *lisper_ctx_current(void) {
+    return current_ctx;
+}
+
+/*
+ * Make 'ctx' the current context of the calling thread.
+ * Returns the previously current context so it can be restored.
+ */
+struct lisper_ctx *lisper_ctx_enter(struct lisper_ctx *ctx) {
+    struct lisper_ctx *prev = current_ctx;
+    current_ctx = ctx;
+    return prev;
+}
+
+/*
+ * Gives the memory of completely free lvalue pools back to the system.
+ * Unless 'force' is set, this only happens once enough of it is idle,
+ * so it is cheap to call after every top-level form.
+ * Returns the number of bytes released from the pools.
+ */
+size_t lisper_ctx_trim(struct lisper_ctx *ctx, int force) {
+    if ( !force && mempool_idle(ctx->lvalue_mp) < MEMPOOL_TRIM_THRESHOLD ) {
+        return 0;
+    }
+    size_t released = mempool_trim(ctx->lvalue_mp);
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+    LPROBE1(heap_trim, released);
+    return released;
+}
@@ -0,0 +1,52 @@
+#ifndef LISPER_CONTEXT
+#define LISPER_CONTEXT
+
+#include "lisper.h"
+#include "grammar.h"
+#include "symbol.h"
+#include "jit.h"
+#include "re.h"
+#include "writer.h"
+#include "reader.h"
+#include "region.h"
+#include "coro.h"
+#include "parse.h"
+#include "module.h"
+#include "budget.h"
+
+struct lenvironment;
+struct mempool;
+
+/*
+ * A single, independent lisper interpreter.
+ * Everything that used to live in process globals is owned by the
+ * context, so several interpreters may run side by side; one per thread.
+ */
+struct lisper_ctx {
+    struct mempool *lvalue_mp; /* allocator for the lvalues of this interpreter */
+    struct lsymtab symbols; /* interned symbol names */
+    struct lenvironment *env; /* global environment */
+    struct grammar_elems elems; /* parser of the lisper grammar */
+    struct argument_capture args; /* program arguments exposed through the 'args' builtin */
+    struct ljit_stats jit; /* counters of the JIT */
+    struct ljit_perf_map perf_map; /* symbols of the JIT's code for perf */
+    struct lre_cache re; /* compiled regular expressions */
+    struct lwriter out; /* buffered standard output of print */
+    struct lwriter text; /* scratch buffer of to-string */
+    struct lreaders readers; /* input buffers of the files read by lines */
+    struct lregion region; /* bindings of the scopes being evaluated by the current coroutine */
+    struct lco_sched co; /* coroutines of this interpreter */
+    struct lparse_pool *parse; /* threads parsing loaded files; NULL until first load */
+    struct lmodules modules; /* modules imported so far */
+    struct lbudget budget; /* limits of the evaluation in progress */
+    struct lbudget_limits limits; /* limits of each evaluation the program is given */
+};
+
+struct lisper_ctx *lisper_ctx_new(int argc, char **argv);
+void lisper_ctx_del(struct lisper_ctx *);
+
+struct lisper_ctx *lisper_ctx_current(void);
+struct lisper_ctx *lisper_ctx_enter(struct lisper_ctx *);
+size_t lisper_ctx_trim(struct lisper_ctx *, int force);
+
+#endif
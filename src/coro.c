@@ -0,0 +1,520 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, MAP_NORESERVE */
+#elif defined(__APPLE__)
+#define _XOPEN_SOURCE 600 /* ucontext */
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "coro.h"
+#include "context.h"
+#include "value.h"
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__)
+#define LCO_SUPPORTED
+#include <ucontext.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+/*
+ * Coroutines are scheduled cooperatively on the thread of the
+ * interpreter: one runs until it yields or waits on a channel or a file,
+ * and the scheduler then switches to the next runnable one in the order
+ * they became runnable. When nothing is runnable but coroutines wait on
+ * files, the scheduler sleeps in poll until one of the files is readable.
+ *
+ * Scopes take their bindings from the region of the interpreter in last
+ * in, first out order, which only holds within one coroutine. Every
+ * coroutine therefore has a region of its own, swapped into the context
+ * when the coroutine is switched to.
+ */
+
+static void lco_queue_push(struct lco_queue *q, struct lco *co) {
+    co->next = NULL;
+    co->queue = q;
+    if ( q->tail != NULL ) {
+        q->tail->next = co;
+    } else {
+        q->head = co;
+    }
+    q->tail = co;
+}
+
+static struct lco *lco_queue_pop(struct lco_queue *q) {
+    struct lco *co = q->head;
+    if ( co != NULL ) {
+        q->head = co->next;
+        if ( q->head == NULL ) {
+            q->tail = NULL;
+        }
+        co->next = NULL;
+        co->queue = NULL;
+    }
+    return co;
+}
+
+/* takes 'co' out of the queue it waits in */
+static void lco_queue_remove(struct lco *co) {
+    struct lco_queue *q = co->queue;
+    if ( q == NULL ) {
+        return;
+    }
+    struct lco *prev = NULL;
+    struct lco **link = &q->head;
+    while ( *link != co ) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = co->next;
+    if ( q->tail == co ) {
+        q->tail = prev;
+    }
+    co->next = NULL;
+    co->queue = NULL;
+}
+
+static void lco_wake(struct lco_sched *s, struct lco *co) {
+    co->woken = 1;
+    lco_queue_push(&s->ready, co);
+}
+
+#ifdef LCO_SUPPORTED
+
+static void lco_free(struct lco *co) {
+    munmap(co->stack, LCO_STACK_SIZE);
+    lregion_destroy(&co->region);
+    free(co->uc);
+    free(co);
+}
+
+/* frees the coroutine that finished last; it cannot free the stack it ran on itself */
+static void lco_reap(struct lco_sched *s) {
+    struct lco *co = s->dead;
+    if ( co != NULL ) {
+        s->dead = NULL;
+        lco_free(co);
+    }
+}
+
+static void lco_switch(struct lisper_ctx *ctx, struct lco *to) {
+    struct lco_sched *s = &ctx->co;
+    struct lco *from = s->current;
+    if ( to == from ) {
+        return;
+    }
+    from->region = ctx->region;
+    ctx->region = to->region;
+    from->depth = ctx->budget.depth;
+    ctx->budget.depth = to->depth;
+    s->current = to;
+    swapcontext(from->uc, to->uc);
+    lco_reap(s);
+}
+
+/*
+ * Moves the coroutines whose descriptors have become readable to the
+ * ready queue. Waits up to 'timeout' milliseconds for one; -1 waits
+ * for as long as it takes.
+ */
+static void lco_poll(struct lco_sched *s, int timeout) {
+    size_t count = 0;
+    for ( struct lco *co = s->io.head; co != NULL; co = co->next ) {
+        count++;
+    }
+    if ( count == 0 ) {
+        return;
+    }
+    if ( count > s->fds_cap ) {
+        void *resized = realloc(s->fds, count * sizeof(struct pollfd));
+        if ( resized == NULL ) {
+            perror("Could not wait for files");
+            exit(1);
+        }
+        s->fds = resized;
+        s->fds_cap = count;
+    }
+
+    struct pollfd *fds = s->fds;
+    size_t i = 0;
+    for ( struct lco *co = s->io.head; co != NULL; co = co->next, ++i ) {
+        fds[i].fd = co->fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    if ( poll(fds, (nfds_t) count, timeout) <= 0 ) {
+        return;
+    }
+
+    struct lco *co = s->io.head;
+    for ( i = 0; co != NULL; ++i ) {
+        struct lco *next = co->next;
+        if ( fds[i].revents != 0 ) {
+            lco_queue_remove(co);
+            lco_wake(s, co);
+        }
+        co = next;
+    }
+}
+
+/* the next coroutine to run, or NULL if every other one waits on a channel */
+static struct lco *lco_next(struct lco_sched *s) {
+    while ( s->ready.head == NULL && s->io.head != NULL ) {
+        lco_poll(s, -1);
+    }
+    return lco_queue_pop(&s->ready);
+}
+
+/*
+ * Switches away from the current coroutine, which the caller has queued
+ * where it is to be woken from. Returns 0 once woken, or -1 if nothing
+ * is left that could wake it.
+ */
+static int lco_park(struct lisper_ctx *ctx) {
+    struct lco_sched *s = &ctx->co;
+    struct lco *co = s->current;
+    co->woken = 0;
+    struct lco *next = lco_next(s);
+    if ( next == NULL ) {
+        return -1;
+    }
+    lco_switch(ctx, next);
+    return co->woken ? 0 : -1;
+}
+
+/* ends the current coroutine; does not return */
+static void lco_finish(struct lisper_ctx *ctx) {
+    struct lco_sched *s = &ctx->co;
+    struct lco *co = s->current;
+
+    if ( co->prev_all != NULL ) {
+        co->prev_all->next_all = co->next_all;
+    } else {
+        s->all = co->next_all;
+    }
+    if ( co->next_all != NULL ) {
+        co->next_all->prev_all = co->prev_all;
+    }
+    s->dead = co;
+
+    struct lco *next = lco_next(s);
+    if ( next == NULL ) {
+        /* the rest wait on channels nobody is left to use; the program is told so */
+        next = &s->main;
+        lco_queue_remove(next);
+        next->woken = 0;
+    }
+    lco_switch(ctx, next);
+}
+
+static void lco_entry(void) {
+    struct lisper_ctx *ctx = lisper_ctx_current();
+    struct lco_sched *s = &ctx->co;
+    lco_reap(s);
+
+    struct lco *co = s->current;
+    struct lvalue *func = co->func;
+    struct lvalue *args = co->args;
+    co->func = NULL;
+    co->args = NULL;
+
+    struct lvalue *res = lvalue_call(ctx->env, func, args);
+    if ( res->type == LVAL_ERR ) {
+        lvalue_println(res);
+    }
+    lvalue_del(res);
+    lvalue_del(func);
+
+    lco_finish(ctx);
+}
+
+int lco_supported(void) {
+    return 1;
+}
+
+/*
+ * Starts calling 'func' with the arguments of the s-expression 'args'
+ * in a new coroutine, in the global environment. The coroutine runs once
+ * the current one yields or waits. Takes ownership of both values.
+ */
+struct lvalue *lco_spawn(struct lisper_ctx *ctx, struct lvalue *func, struct lvalue *args) {
+    struct lco_sched *s = &ctx->co;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    struct lco *co = calloc(1, sizeof(struct lco));
+    ucontext_t *uc = malloc(sizeof(ucontext_t));
+    unsigned char *stack = mmap(NULL, LCO_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( co == NULL || uc == NULL || s->main.uc == NULL || stack == MAP_FAILED ||
+         mprotect(stack, page, PROT_NONE) != 0 || getcontext(uc) != 0 ) {
+        struct lvalue *err = lvalue_err("Could not spawn coroutine. %s", strerror(errno));
+        if ( stack != MAP_FAILED ) {
+            munmap(stack, LCO_STACK_SIZE);
+        }
+        free(uc);
+        free(co);
+        lvalue_del(func);
+        lvalue_del(args);
+        return err;
+    }
+
+    /* the guard page below the stack faults on overflow instead of corrupting memory */
+    uc->uc_stack.ss_sp = stack + page;
+    uc->uc_stack.ss_size = LCO_STACK_SIZE - page;
+    uc->uc_link = NULL;
+    makecontext(uc, lco_entry, 0);
+
+    co->uc = uc;
+    co->stack = stack;
+    co->func = func;
+    co->args = args;
+    co->fd = -1;
+    lregion_init(&co->region);
+
+    co->next_all = s->all;
+    if ( s->all != NULL ) {
+        s->all->prev_all = co;
+    }
+    s->all = co;
+
+    lco_wake(s, co);
+    return lvalue_sexpr();
+}
+
+/*
+ * Lets the other runnable coroutines run before the current one goes on.
+ */
+void lco_yield(struct lisper_ctx *ctx) {
+    struct lco_sched *s = &ctx->co;
+    if ( s->io.head != NULL ) {
+        lco_poll(s, 0);
+    }
+    if ( s->ready.head == NULL ) {
+        return;
+    }
+    lco_wake(s, s->current);
+    lco_switch(ctx, lco_queue_pop(&s->ready));
+}
+
+/*
+ * Runs the other coroutines until every one has finished or waits on a
+ * channel that nothing is left to use.
+ */
+void lco_wait(struct lisper_ctx *ctx) {
+    struct lco_sched *s = &ctx->co;
+    struct lco *next;
+    while ( (next = lco_next(s)) != NULL ) {
+        lco_wake(s, s->current);
+        lco_switch(ctx, next);
+    }
+}
+
+/*
+ * Called before reading from the descriptor 'fd'. If the read would block
+ * and other coroutines exist, the current one waits for the descriptor to
+ * become readable while they run.
+ */
+void lco_wait_readable(struct lisper_ctx *ctx, int fd) {
+    if ( ctx == NULL || ctx->co.all == NULL || fd < 0 ) {
+        return;
+    }
+    struct pollfd p = { fd, POLLIN, 0 };
+    if ( poll(&p, 1, 0) != 0 ) {
+        return; /* readable, at its end or failed; the read will tell */
+    }
+
+    struct lco *co = ctx->co.current;
+    co->fd = fd;
+    lco_queue_push(&ctx->co.io, co);
+    if ( lco_park(ctx) < 0 ) {
+        lco_queue_remove(co);
+    }
+}
+
+#else
+
+static int lco_park(struct lisper_ctx *ctx) {
+    (void) ctx;
+    return -1;
+}
+
+int lco_supported(void) {
+    return 0;
+}
+
+struct lvalue *lco_spawn(struct lisper_ctx *ctx, struct lvalue *func, struct lvalue *args) {
+    (void) ctx;
+    lvalue_del(func);
+    lvalue_del(args);
+    return lvalue_err("Coroutines are not supported on this platform");
+}
+
+void lco_yield(struct lisper_ctx *ctx) {
+    (void) ctx;
+}
+
+void lco_wait(struct lisper_ctx *ctx) {
+    (void) ctx;
+}
+
+void lco_wait_readable(struct lisper_ctx *ctx, int fd) {
+    (void) ctx;
+    (void) fd;
+}
+
+#endif
+
+void lco_sched_init(struct lco_sched *s) {
+    memset(s, 0, sizeof(struct lco_sched));
+    s->main.fd = -1;
+    s->current = &s->main;
+#ifdef LCO_SUPPORTED
+    s->main.uc = malloc(sizeof(ucontext_t));
+#endif
+}
+
+/*
+ * Frees the coroutines that have not finished. Values living on their
+ * stacks are lost with them.
+ */
+void lco_sched_destroy(struct lco_sched *s) {
+#ifdef LCO_SUPPORTED
+    lco_reap(s);
+    if ( s->current != &s->main ) {
+        /* the region of the context is the current coroutine's; main's is put aside */
+        lregion_destroy(&s->main.region);
+    }
+    struct lco *co = s->all;
+    while ( co != NULL ) {
+        struct lco *next = co->next_all;
+        if ( co->slot != NULL ) {
+            lvalue_del(co->slot);
+        }
+        if ( co->func != NULL ) {
+            lvalue_del(co->func);
+            lvalue_del(co->args);
+        }
+        if ( co != s->current ) {
+            /* the running one keeps its stack; the process is exiting on it */
+            lco_free(co);
+        }
+        co = next;
+    }
+    free(s->fds);
+#endif
+    free(s->main.uc);
+    s->all = NULL;
+}
+
+struct lchan *lchan_new(size_t capacity) {
+    struct lchan *ch = calloc(1, sizeof(struct lchan));
+    if ( ch == NULL ) {
+        return NULL;
+    }
+    if ( capacity > 0 && (ch->buf = malloc(capacity * sizeof(struct lvalue *))) == NULL ) {
+        free(ch);
+        return NULL;
+    }
+    ch->refcount = 1;
+    ch->capacity = capacity;
+    return ch;
+}
+
+struct lchan *lchan_share(struct lchan *ch) {
+    ch->refcount++;
+    return ch;
+}
+
+void lchan_del(struct lchan *ch) {
+    if ( --ch->refcount > 0 ) {
+        return;
+    }
+    for ( size_t i = 0; i < ch->count; ++i ) {
+        lvalue_del(ch->buf[(ch->head + i) % ch->capacity]);
+    }
+    free(ch->buf);
+    free(ch);
+}
+
+static void lchan_push(struct lchan *ch, struct lvalue *v) {
+    ch->buf[(ch->head + ch->count) % ch->capacity] = v;
+    ch->count++;
+}
+
+static struct lvalue *lchan_pop(struct lchan *ch) {
+    struct lvalue *v = ch->buf[ch->head];
+    ch->head = (ch->head + 1) % ch->capacity;
+    ch->count--;
+    return v;
+}
+
+/*
+ * Sends 'v' on the channel, waiting while the channel is full.
+ * Takes ownership of 'v'.
+ */
+struct lvalue *lchan_send(struct lisper_ctx *ctx, struct lchan *ch, struct lvalue *v) {
+    struct lco_sched *s = &ctx->co;
+
+    struct lco *receiver = lco_queue_pop(&ch->receivers);
+    if ( receiver != NULL ) {
+        receiver->slot = v;
+        lco_wake(s, receiver);
+        return lvalue_sexpr();
+    }
+    if ( ch->count < ch->capacity ) {
+        lchan_push(ch, v);
+        return lvalue_sexpr();
+    }
+
+    struct lco *co = s->current;
+    co->slot = v;
+    lco_queue_push(&ch->senders, co);
+    if ( lco_park(ctx) < 0 ) {
+        lco_queue_remove(co);
+        lvalue_del(co->slot);
+        co->slot = NULL;
+        return lvalue_err("Deadlock; nothing is left to receive from the channel");
+    }
+    return lvalue_sexpr();
+}
+
+/*
+ * Receives the next value of the channel, waiting until there is one.
+ */
+struct lvalue *lchan_recv(struct lisper_ctx *ctx, struct lchan *ch) {
+    struct lco_sched *s = &ctx->co;
+    struct lvalue *v;
+
+    if ( ch->count > 0 ) {
+        v = lchan_pop(ch);
+        struct lco *sender = lco_queue_pop(&ch->senders);
+        if ( sender != NULL ) {
+            lchan_push(ch, sender->slot);
+            sender->slot = NULL;
+            lco_wake(s, sender);
+        }
+        return v;
+    }
+    struct lco *sender = lco_queue_pop(&ch->senders);
+    if ( sender != NULL ) {
+        v = sender->slot;
+        sender->slot = NULL;
+        lco_wake(s, sender);
+        return v;
+    }
+
+    struct lco *co = s->current;
+    co->slot = NULL;
+    lco_queue_push(&ch->receivers, co);
+    if ( lco_park(ctx) < 0 ) {
+        lco_queue_remove(co);
+        return lvalue_err("Deadlock; nothing is left to send on the channel");
+    }
+    v = co->slot;
+    co->slot = NULL;
+    return v;
+}
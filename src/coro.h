@@ -0,0 +1,83 @@
+#ifndef LISPER_CORO
+#define LISPER_CORO
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "region.h"
+
+struct lvalue;
+struct lisper_ctx;
+struct lco;
+
+/* bytes of address space reserved for the stack of a coroutine; pages are only committed as they are used */
+#define LCO_STACK_SIZE (8 * 1024 * 1024)
+
+/* first in, first out queue of coroutines, linked through 'next' */
+struct lco_queue {
+    struct lco *head;
+    struct lco *tail;
+};
+
+/*
+ * Coroutine; a call running on a stack of its own, switched to and from
+ * by the scheduler of the interpreter. The program itself is the
+ * coroutine 'main' of the scheduler and runs on the stack of the thread.
+ */
+struct lco {
+    void *uc; /* saved machine context */
+    unsigned char *stack; /* mapping of the stack, guard page first; NULL for main */
+    struct lvalue *func; /* function to call and its arguments, until started */
+    struct lvalue *args;
+    struct lvalue *slot; /* value handed over by a channel */
+    struct lregion region; /* scope bindings while switched out */
+    struct lco_queue *queue; /* queue the coroutine waits in, or NULL */
+    struct lco *next;
+    struct lco *prev_all; /* list of every coroutine that has not finished */
+    struct lco *next_all;
+    int fd; /* descriptor waited on while in the I/O queue */
+    int woken; /* resumed by the event it waited for rather than a deadlock */
+    size_t depth; /* calls of interpreted functions in progress while switched out */
+};
+
+struct lco_sched {
+    struct lco main;
+    struct lco *current;
+    struct lco_queue ready; /* runnable coroutines */
+    struct lco_queue io; /* coroutines waiting for a descriptor to become readable */
+    struct lco *all; /* coroutines besides main */
+    struct lco *dead; /* finished coroutine whose stack is freed once switched away from */
+    void *fds; /* poll set of the I/O queue */
+    size_t fds_cap;
+};
+
+/*
+ * Channel; a first in, first out queue of values between coroutines,
+ * shared by every copy of the channel value. A send blocks while
+ * 'capacity' values are buffered; with capacity 0 it blocks until a
+ * receiver takes the value.
+ */
+struct lchan {
+    size_t refcount;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    struct lvalue **buf;
+    struct lco_queue senders; /* parked with their value in 'slot' */
+    struct lco_queue receivers;
+};
+
+int lco_supported(void);
+void lco_sched_init(struct lco_sched *);
+void lco_sched_destroy(struct lco_sched *);
+struct lvalue *lco_spawn(struct lisper_ctx *, struct lvalue *func, struct lvalue *args);
+void lco_yield(struct lisper_ctx *);
+void lco_wait(struct lisper_ctx *);
+void lco_wait_readable(struct lisper_ctx *, int fd);
+
+struct lchan *lchan_new(size_t capacity);
+struct lchan *lchan_share(struct lchan *);
+void lchan_del(struct lchan *);
+struct lvalue *lchan_send(struct lisper_ctx *, struct lchan *, struct lvalue *);
+struct lvalue *lchan_recv(struct lisper_ctx *, struct lchan *);
+
+#endif
@@ -0,0 +1,856 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <limits.h>
+#include "emitc.h"
+#include "grammar.h"
+#include "value.h"
+#include "environment.h"
+#include "symbol.h"
+#include "builtin.h"
+
+/*
+ * Ahead of time compiler; translates a lisper program into C source that
+ * is linked against liblisper into a standalone executable (see aot.h).
+ *
+ * Every top-level form is emitted as C code building the form, which the
+ * embedded interpreter evaluates at startup, so the compiled program
+ * behaves like the interpreted one; 'eval', 'read' and 'load' on runtime
+ * data keep working. Functions defined at the top level with 'fn' or
+ * 'def' and '\' are in addition translated to C when their body stays in
+ * the subset the JIT compiles: integer parameters and literals, the
+ * integer builtins, comparisons, '!', 'if', '&&', '||' and calls of
+ * compiled functions, including themselves.
+ */
+
+struct emit_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void emit_printf(struct emit_buf *b, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if ( b->len + n + 1 > b->cap ) {
+        size_t cap = b->cap == 0 ? 1024 : b->cap;
+        while ( cap < b->len + n + 1 ) {
+            cap *= 2;
+        }
+        char *data = realloc(b->data, cap);
+        if ( data == NULL ) {
+            perror("Could not grow C source buffer");
+            exit(1);
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(b->data + b->len, n + 1, fmt, args);
+    va_end(args);
+    b->len += n;
+}
+
+/* 's' as a C string literal */
+static void emit_string(struct emit_buf *b, const char *s) {
+    emit_printf(b, "\"");
+    for ( const unsigned char *c = (const unsigned char *) s; *c != '\0'; ++c ) {
+        switch ( *c ) {
+            case '"': emit_printf(b, "\\\""); break;
+            case '\\': emit_printf(b, "\\\\"); break;
+            case '\n': emit_printf(b, "\\n"); break;
+            case '\t': emit_printf(b, "\\t"); break;
+            case '\r': emit_printf(b, "\\r"); break;
+            case '?': emit_printf(b, "\\?"); break; /* no trigraphs */
+            default:
+                if ( *c < 0x20 || *c >= 0x7f ) {
+                    emit_printf(b, "\\%03o", *c);
+                } else {
+                    emit_printf(b, "%c", *c);
+                }
+        }
+    }
+    emit_printf(b, "\"");
+}
+
+static void emit_int(struct emit_buf *b, long long v) {
+    if ( v == LLONG_MIN ) {
+        emit_printf(b, "(%lldLL - 1)", v + 1);
+    } else {
+        emit_printf(b, "%lldLL", v);
+    }
+}
+
+/* C expression constructing the atom 'x' */
+static void emit_atom(struct emit_buf *b, struct lvalue *x) {
+    char num[64];
+    switch ( x->type ) {
+        case LVAL_INT:
+            emit_printf(b, "lvalue_int(");
+            emit_int(b, x->val.intval);
+            emit_printf(b, ")");
+            break;
+        case LVAL_FLOAT:
+            if ( isnan(x->val.floatval) ) {
+                snprintf(num, sizeof(num), "NAN");
+            } else if ( isinf(x->val.floatval) ) {
+                snprintf(num, sizeof(num), "%sHUGE_VAL", x->val.floatval < 0 ? "-" : "");
+            } else {
+                snprintf(num, sizeof(num), "%.17g", x->val.floatval);
+                if ( strpbrk(num, ".e") == NULL ) {
+                    strcat(num, ".0");
+                }
+            }
+            emit_printf(b, "lvalue_float(%s)", num);
+            break;
+        case LVAL_BOOL:
+            emit_printf(b, "lvalue_bool(%d)", x->val.intval != 0);
+            break;
+        case LVAL_STR:
+            emit_printf(b, "lvalue_str(");
+            emit_string(b, x->val.strval);
+            emit_printf(b, ")");
+            break;
+        case LVAL_SYM:
+            emit_printf(b, "lvalue_sym(");
+            emit_string(b, x->val.strval);
+            emit_printf(b, ")");
+            break;
+        default:
+            /* the reader makes errors of numbers out of range */
+            emit_printf(b, "lvalue_err(\"%%s\", ");
+            emit_string(b, x->type == LVAL_ERR ? x->val.strval : "Unexpected value");
+            emit_printf(b, ")");
+            break;
+    }
+}
+
+static int is_list(struct lvalue *x) {
+    return x->type == LVAL_SEXPR || x->type == LVAL_QEXPR;
+}
+
+static size_t list_depth(struct lvalue *x) {
+    size_t depth = 0;
+    for ( size_t i = 0; is_list(x) && i < x->val.l.count; ++i ) {
+        size_t d = list_depth(x->val.l.cells[i]);
+        if ( d > depth ) {
+            depth = d;
+        }
+    }
+    return is_list(x) ? depth + 1 : 0;
+}
+
+/* statements building the list 'x' in v[depth] */
+static void emit_list(struct emit_buf *b, struct lvalue *x, size_t depth) {
+    emit_printf(b, "    v[%zu] = %s();\n", depth, x->type == LVAL_SEXPR ? "lvalue_sexpr" : "lvalue_qexpr");
+    for ( size_t i = 0; i < x->val.l.count; ++i ) {
+        struct lvalue *cell = x->val.l.cells[i];
+        if ( is_list(cell) ) {
+            emit_list(b, cell, depth + 1);
+            emit_printf(b, "    lvalue_add(v[%zu], v[%zu]);\n", depth, depth + 1);
+        } else {
+            emit_printf(b, "    lvalue_add(v[%zu], ", depth);
+            emit_atom(b, cell);
+            emit_printf(b, ");\n");
+        }
+    }
+}
+
+static void emit_form(struct emit_buf *b, struct lvalue *form, size_t index) {
+    emit_printf(b, "static struct lvalue *lspr_form_%zu(void) {\n", index);
+    if ( is_list(form) ) {
+        emit_printf(b, "    struct lvalue *v[%zu];\n", list_depth(form));
+        emit_list(b, form, 0);
+        emit_printf(b, "    return v[0];\n");
+    } else {
+        emit_printf(b, "    return ");
+        emit_atom(b, form);
+        emit_printf(b, ";\n");
+    }
+    emit_printf(b, "}\n\n");
+}
+
+enum emit_kind {
+    EMIT_NONE, /* not compilable */
+    EMIT_INT,
+    EMIT_BOOL,
+    EMIT_LATER /* calls a function not compiled yet */
+};
+
+struct emit_guard {
+    char *name;
+    struct emit_fn *callee; /* compiled function expected to be bound, or NULL for a builtin */
+};
+
+/* a function defined at the top level; a candidate for C code */
+struct emit_fn {
+    size_t form; /* index of the defining form */
+    char *name;
+    struct lvalue *formals;
+    struct lvalue *body;
+    size_t arity;
+    int duplicate; /* the name is defined more than once */
+    int done; /* compiled or given up on */
+    enum emit_kind result; /* kind of the result once compiled */
+    struct emit_buf code;
+    size_t guard_count;
+    struct emit_guard *guards;
+};
+
+struct emit_compiler {
+    struct emit_fn *fns;
+    size_t fn_count;
+    struct emit_fn *fn; /* function being compiled */
+    enum emit_kind self_kind; /* assumed result of recursive calls */
+    struct emit_buf body;
+    size_t temps;
+    int indent;
+    size_t guard_count;
+    size_t guard_cap;
+    struct emit_guard *guards;
+};
+
+static void emit_stmt(struct emit_compiler *c, const char *fmt, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    emit_printf(&c->body, "%*s%s\n", 4 * c->indent, "", line);
+}
+
+static size_t emit_temp(struct emit_compiler *c) {
+    return c->temps++;
+}
+
+static void emit_guard(struct emit_compiler *c, char *name, struct emit_fn *callee) {
+    for ( size_t i = 0; i < c->guard_count; ++i ) {
+        if ( c->guards[i].name == name ) {
+            return;
+        }
+    }
+    if ( c->guard_count == c->guard_cap ) {
+        c->guard_cap = c->guard_cap == 0 ? 8 : c->guard_cap * 2;
+        c->guards = realloc(c->guards, c->guard_cap * sizeof(struct emit_guard));
+        if ( c->guards == NULL ) {
+            perror("Could not grow guard buffer");
+            exit(1);
+        }
+    }
+    c->guards[c->guard_count].name = name;
+    c->guards[c->guard_count].callee = callee;
+    c->guard_count++;
+}
+
+static int emit_param(struct emit_compiler *c, char *name) {
+    for ( size_t i = 0; i < c->fn->arity; ++i ) {
+        if ( c->fn->formals->val.l.cells[i]->val.strval == name ) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/* the candidate 'name' refers to, if it is one */
+static struct emit_fn *emit_lookup(struct emit_compiler *c, char *name) {
+    for ( size_t i = 0; i < c->fn_count; ++i ) {
+        if ( c->fns[i].name == name ) {
+            return &c->fns[i];
+        }
+    }
+    return NULL;
+}
+
+/* outcome of an operand of the wrong kind; a pending call may still compile later */
+static enum emit_kind emit_fail(enum emit_kind k) {
+    return k == EMIT_LATER ? EMIT_LATER : EMIT_NONE;
+}
+
+static int emit_ok(enum emit_kind k) {
+    return k == EMIT_INT || k == EMIT_BOOL;
+}
+
+static enum emit_kind emit_expr(struct emit_compiler *, struct lvalue *, size_t *);
+static enum emit_kind emit_call_form(struct emit_compiler *, struct lvalue **, size_t, size_t *);
+
+/* cells evaluated as a s-expression; a single cell is its own value */
+static enum emit_kind emit_cells(struct emit_compiler *c, struct lvalue **cells, size_t count, size_t *t) {
+    if ( count == 0 ) {
+        return EMIT_NONE;
+    }
+    if ( count == 1 ) {
+        return emit_expr(c, cells[0], t);
+    }
+    return emit_call_form(c, cells, count, t);
+}
+
+static enum emit_kind emit_expr(struct emit_compiler *c, struct lvalue *x, size_t *t) {
+    int param;
+    switch ( x->type ) {
+        case LVAL_INT:
+            *t = emit_temp(c);
+            emit_stmt(c, x->val.intval == LLONG_MIN ? "t%zu = (%lldLL - 1);" : "t%zu = %lldLL;",
+                *t, x->val.intval == LLONG_MIN ? x->val.intval + 1 : x->val.intval);
+            return EMIT_INT;
+        case LVAL_BOOL:
+            *t = emit_temp(c);
+            emit_stmt(c, "t%zu = %d;", *t, x->val.intval != 0);
+            return EMIT_BOOL;
+        case LVAL_SYM:
+            param = emit_param(c, x->val.strval);
+            if ( param < 0 ) {
+                return EMIT_NONE;
+            }
+            *t = emit_temp(c);
+            emit_stmt(c, "t%zu = p%d;", *t, param);
+            return EMIT_INT;
+        case LVAL_SEXPR:
+            return emit_cells(c, x->val.l.cells, x->val.l.count, t);
+        default:
+            break;
+    }
+    return EMIT_NONE;
+}
+
+static enum emit_kind emit_arith(struct emit_compiler *c, char op, struct lvalue **args, size_t argc, size_t *t) {
+    size_t a;
+    enum emit_kind k;
+    if ( argc == 0 ) {
+        return EMIT_NONE;
+    }
+    if ( (k = emit_expr(c, args[0], &a)) != EMIT_INT ) {
+        return emit_fail(k);
+    }
+
+    *t = emit_temp(c);
+    emit_stmt(c, argc == 1 && op == '-' ? "t%zu = laot_neg(t%zu);" : "t%zu = t%zu;", *t, a);
+
+    for ( size_t i = 1; i < argc; ++i ) {
+        size_t b;
+        if ( (k = emit_expr(c, args[i], &b)) != EMIT_INT ) {
+            return emit_fail(k);
+        }
+        switch ( op ) {
+            case '+':
+                emit_stmt(c, "t%zu = laot_add(t%zu, t%zu);", *t, *t, b);
+                break;
+            case '-':
+                emit_stmt(c, "t%zu = laot_sub(t%zu, t%zu);", *t, *t, b);
+                break;
+            case '*':
+                emit_stmt(c, "t%zu = laot_mul(t%zu, t%zu);", *t, *t, b);
+                break;
+            case '/':
+            case '%':
+                emit_stmt(c, "t%zu = laot_%s(t%zu, t%zu, deopt);", *t, op == '/' ? "div" : "mod", *t, b);
+                emit_stmt(c, "if ( *deopt ) {");
+                emit_stmt(c, "    return 0;");
+                emit_stmt(c, "}");
+                break;
+        }
+    }
+    return EMIT_INT;
+}
+
+static enum emit_kind emit_compare(struct emit_compiler *c, const char *op, struct lvalue **args, size_t argc, size_t *t) {
+    size_t a, b;
+    if ( argc != 2 ) {
+        return EMIT_NONE;
+    }
+    enum emit_kind lhs = emit_expr(c, args[0], &a);
+    if ( !emit_ok(lhs) ) {
+        return emit_fail(lhs);
+    }
+    enum emit_kind rhs = emit_expr(c, args[1], &b);
+    if ( !emit_ok(rhs) ) {
+        return emit_fail(rhs);
+    }
+    if ( rhs != lhs || (lhs != EMIT_INT && strcmp(op, "==") != 0 && strcmp(op, "!=") != 0) ) {
+        return EMIT_NONE;
+    }
+    *t = emit_temp(c);
+    emit_stmt(c, "t%zu = t%zu %s t%zu;", *t, a, op, b);
+    return EMIT_BOOL;
+}
+
+static enum emit_kind emit_if(struct emit_compiler *c, struct lvalue **args, size_t argc, size_t *t) {
+    size_t cond, then, otherwise;
+    if ( argc != 3 || args[1]->type != LVAL_QEXPR || args[2]->type != LVAL_QEXPR ) {
+        return EMIT_NONE;
+    }
+    enum emit_kind k = emit_expr(c, args[0], &cond);
+    if ( k != EMIT_BOOL ) {
+        return emit_fail(k);
+    }
+
+    *t = emit_temp(c);
+    emit_stmt(c, "if ( t%zu ) {", cond);
+    c->indent++;
+    enum emit_kind a = emit_cells(c, args[1]->val.l.cells, args[1]->val.l.count, &then);
+    if ( emit_ok(a) ) {
+        emit_stmt(c, "t%zu = t%zu;", *t, then);
+    }
+    c->indent--;
+    emit_stmt(c, "} else {");
+    c->indent++;
+    enum emit_kind b = emit_cells(c, args[2]->val.l.cells, args[2]->val.l.count, &otherwise);
+    if ( emit_ok(b) ) {
+        emit_stmt(c, "t%zu = t%zu;", *t, otherwise);
+    }
+    c->indent--;
+    emit_stmt(c, "}");
+
+    if ( a == EMIT_NONE || b == EMIT_NONE ) {
+        return EMIT_NONE;
+    }
+    if ( a == EMIT_LATER || b == EMIT_LATER ) {
+        return EMIT_LATER;
+    }
+    return a == b ? a : EMIT_NONE;
+}
+
+static enum emit_kind emit_logic(struct emit_compiler *c, int is_and, struct lvalue **args, size_t argc, size_t *t) {
+    size_t a, b;
+    if ( argc != 2 ) {
+        return EMIT_NONE;
+    }
+    enum emit_kind k = emit_expr(c, args[0], &a);
+    if ( k != EMIT_BOOL ) {
+        return emit_fail(k);
+    }
+    /* the first operand decides when it is false for '&&' or true for '||' */
+    *t = emit_temp(c);
+    emit_stmt(c, "t%zu = t%zu;", *t, a);
+    emit_stmt(c, is_and ? "if ( t%zu ) {" : "if ( !t%zu ) {", *t);
+    c->indent++;
+    k = emit_expr(c, args[1], &b);
+    if ( k == EMIT_BOOL ) {
+        emit_stmt(c, "t%zu = t%zu;", *t, b);
+    }
+    c->indent--;
+    emit_stmt(c, "}");
+    return k == EMIT_BOOL ? k : emit_fail(k);
+}
+
+static enum emit_kind emit_call(struct emit_compiler *c, struct emit_fn *callee, struct lvalue **args, size_t argc, size_t *t) {
+    if ( argc != callee->arity ) {
+        return EMIT_NONE;
+    }
+
+    size_t *temps = malloc((argc + 1) * sizeof(size_t));
+    for ( size_t i = 0; i < argc; ++i ) {
+        enum emit_kind k = emit_expr(c, args[i], &temps[i]);
+        if ( k != EMIT_INT ) {
+            free(temps);
+            return emit_fail(k);
+        }
+    }
+
+    struct emit_buf call = { NULL, 0, 0 };
+    *t = emit_temp(c);
+    emit_printf(&call, "t%zu = lspr_fn_%zu(", *t, callee->form);
+    for ( size_t i = 0; i < argc; ++i ) {
+        emit_printf(&call, "t%zu, ", temps[i]);
+    }
+    emit_printf(&call, "deopt);");
+    emit_printf(&c->body, "%*s%s\n", 4 * c->indent, "", call.data);
+    emit_stmt(c, "if ( *deopt ) {");
+    emit_stmt(c, "    return 0;");
+    emit_stmt(c, "}");
+
+    free(call.data);
+    free(temps);
+    return callee == c->fn ? c->self_kind : callee->result;
+}
+
+static enum emit_kind emit_call_form(struct emit_compiler *c, struct lvalue **cells, size_t count, size_t *t) {
+    struct lvalue *op = cells[0];
+    struct lvalue **args = cells + 1;
+    size_t argc = count - 1;
+
+    if ( op->type != LVAL_SYM || emit_param(c, op->val.strval) >= 0 ) {
+        return EMIT_NONE;
+    }
+
+    struct emit_fn *callee = emit_lookup(c, op->val.strval);
+    if ( callee != NULL ) {
+        if ( callee->duplicate || (callee != c->fn && callee->done && !emit_ok(callee->result)) ) {
+            return EMIT_NONE;
+        }
+        if ( callee != c->fn && !callee->done ) {
+            return EMIT_LATER;
+        }
+        emit_guard(c, op->val.strval, callee);
+        return emit_call(c, callee, args, argc, t);
+    }
+
+    /* otherwise a builtin, as bound when the program starts */
+    struct lsymbol *sym = lsymbol_of(op->val.strval);
+    if ( sym->global == NULL || sym->global->envval->type != LVAL_BUILTIN ) {
+        return EMIT_NONE;
+    }
+    const struct lbuiltin *b = sym->global->envval->val.builtin;
+    const char *name = b->name;
+    emit_guard(c, op->val.strval, NULL);
+
+    if ( strcmp(name, "if") == 0 || strcmp(name, "&&") == 0 || strcmp(name, "||") == 0 ) {
+        /* only where the evaluator takes these as special forms */
+        if ( sym->special == NULL || sym->special->builtin != b->call ) {
+            return EMIT_NONE;
+        }
+        if ( strcmp(name, "if") == 0 ) {
+            return emit_if(c, args, argc, t);
+        }
+        return emit_logic(c, strcmp(name, "&&") == 0, args, argc, t);
+    }
+
+    if ( strcmp(name, "+") == 0 || strcmp(name, "-") == 0 || strcmp(name, "*") == 0 ||
+        strcmp(name, "/") == 0 || strcmp(name, "%") == 0 ) {
+        return emit_arith(c, name[0], args, argc, t);
+    }
+
+    if ( strcmp(name, "==") == 0 || strcmp(name, "!=") == 0 || strcmp(name, "<") == 0 ||
+        strcmp(name, ">") == 0 || strcmp(name, "<=") == 0 || strcmp(name, ">=") == 0 ) {
+        return emit_compare(c, name, args, argc, t);
+    }
+
+    if ( strcmp(name, "!") == 0 ) {
+        size_t a;
+        if ( argc != 1 ) {
+            return EMIT_NONE;
+        }
+        enum emit_kind k = emit_expr(c, args[0], &a);
+        if ( k != EMIT_BOOL ) {
+            return emit_fail(k);
+        }
+        *t = emit_temp(c);
+        emit_stmt(c, "t%zu = !t%zu;", *t, a);
+        return EMIT_BOOL;
+    }
+
+    return EMIT_NONE;
+}
+
+static void emit_signature(struct emit_buf *b, struct emit_fn *fn) {
+    emit_printf(b, "static long long lspr_fn_%zu(", fn->form);
+    for ( size_t i = 0; i < fn->arity; ++i ) {
+        emit_printf(b, "long long p%zu, ", i);
+    }
+    emit_printf(b, "char *deopt)");
+}
+
+/* try to compile 'fn' assuming its recursive calls result in 'self_kind' */
+static enum emit_kind emit_compile_as(struct emit_compiler *c, struct emit_fn *fn, enum emit_kind self_kind) {
+    c->fn = fn;
+    c->self_kind = self_kind;
+    c->body.len = 0;
+    if ( c->body.data != NULL ) {
+        c->body.data[0] = '\0';
+    }
+    c->temps = 0;
+    c->indent = 1;
+    c->guard_count = 0;
+
+    size_t t = 0;
+    enum emit_kind result = emit_cells(c, fn->body->val.l.cells, fn->body->val.l.count, &t);
+    if ( result != self_kind ) {
+        return result == EMIT_LATER ? EMIT_LATER : EMIT_NONE;
+    }
+
+    fn->code.len = 0;
+    emit_signature(&fn->code, fn);
+    emit_printf(&fn->code, " {\n");
+    if ( c->temps > 0 ) {
+        emit_printf(&fn->code, "    long long t0");
+        for ( size_t i = 1; i < c->temps; ++i ) {
+            emit_printf(&fn->code, ", t%zu", i);
+        }
+        emit_printf(&fn->code, ";\n");
+    }
+    for ( size_t i = 0; i < fn->arity; ++i ) {
+        emit_printf(&fn->code, "    (void) p%zu;\n", i);
+    }
+    emit_printf(&fn->code, "    (void) deopt;\n");
+    emit_printf(&fn->code, "%s", c->body.data);
+    emit_printf(&fn->code, "    return t%zu;\n}\n\n", t);
+
+    fn->guards = malloc(c->guard_count * sizeof(struct emit_guard));
+    memcpy(fn->guards, c->guards, c->guard_count * sizeof(struct emit_guard));
+    fn->guard_count = c->guard_count;
+    return result;
+}
+
+static enum emit_kind emit_compile(struct emit_compiler *c, struct emit_fn *fn) {
+    /* the result of a recursive call is assumed before the body is known */
+    enum emit_kind k = emit_compile_as(c, fn, EMIT_INT);
+    if ( k == EMIT_NONE ) {
+        k = emit_compile_as(c, fn, EMIT_BOOL);
+    }
+    return k;
+}
+
+/* 'form' as a top-level function definition; 1 if it is one */
+static int emit_definition(struct lvalue *form, struct emit_fn *fn) {
+    if ( form->type != LVAL_SEXPR || form->val.l.count < 3 || form->val.l.cells[0]->type != LVAL_SYM ) {
+        return 0;
+    }
+    struct lvalue **cells = form->val.l.cells;
+    struct lvalue *name, *formals, *body;
+
+    if ( strcmp(cells[0]->val.strval, "fn") == 0 && form->val.l.count == 4 ) {
+        /* (fn {name} {formals...} {body}) */
+        name = cells[1];
+        formals = cells[2];
+        body = cells[3];
+    } else if ( strcmp(cells[0]->val.strval, "def") == 0 && form->val.l.count == 3 &&
+        cells[2]->type == LVAL_SEXPR && cells[2]->val.l.count == 3 &&
+        cells[2]->val.l.cells[0]->type == LVAL_SYM && strcmp(cells[2]->val.l.cells[0]->val.strval, "\\") == 0 ) {
+        /* (def {name} (\ {formals...} {body})) */
+        name = cells[1];
+        formals = cells[2]->val.l.cells[1];
+        body = cells[2]->val.l.cells[2];
+    } else {
+        return 0;
+    }
+
+    /* the special forms take a bare name as well as a quoted one */
+    if ( name->type == LVAL_QEXPR && name->val.l.count == 1 ) {
+        name = name->val.l.cells[0];
+    }
+    if ( name->type != LVAL_SYM || formals->type != LVAL_QEXPR || body->type != LVAL_QEXPR ) {
+        return 0;
+    }
+    for ( size_t i = 0; i < formals->val.l.count; ++i ) {
+        struct lvalue *p = formals->val.l.cells[i];
+        if ( p->type != LVAL_SYM || strcmp(p->val.strval, "&") == 0 ) {
+            return 0;
+        }
+    }
+
+    memset(fn, 0, sizeof(struct emit_fn));
+    fn->name = name->val.strval;
+    fn->formals = formals;
+    fn->body = body;
+    fn->arity = formals->val.l.count;
+    return 1;
+}
+
+static void emit_guards(struct emit_buf *b, struct lvalue *form, struct emit_fn *fn) {
+    /* the builtins defining the function; C code is only attached to the function they make */
+    emit_printf(b, "static struct laot_guard lspr_definers_%zu[] = {\n", fn->form);
+    emit_printf(b, "    { ");
+    emit_string(b, form->val.l.cells[0]->val.strval);
+    emit_printf(b, ", LVAL_BUILTIN, NULL, NULL, NULL },\n");
+    if ( strcmp(form->val.l.cells[0]->val.strval, "def") == 0 ) {
+        emit_printf(b, "    { \"\\\\\", LVAL_BUILTIN, NULL, NULL, NULL },\n");
+    }
+    emit_printf(b, "};\n\n");
+
+    /* the free names of the body, checked on every call */
+    if ( fn->guard_count == 0 ) {
+        return;
+    }
+    emit_printf(b, "static struct laot_guard lspr_guards_%zu[] = {\n", fn->form);
+    for ( size_t i = 0; i < fn->guard_count; ++i ) {
+        struct emit_guard *g = &fn->guards[i];
+        emit_printf(b, "    { ");
+        emit_string(b, g->name);
+        if ( g->callee == NULL ) {
+            emit_printf(b, ", LVAL_BUILTIN, NULL, NULL, NULL },\n");
+        } else {
+            emit_printf(b, ", LVAL_FUNCTION, lspr_native_%zu, NULL, NULL },\n", g->callee->form);
+        }
+    }
+    emit_printf(b, "};\n\n");
+}
+
+static size_t emit_definer_count(struct lvalue *form) {
+    return strcmp(form->val.l.cells[0]->val.strval, "def") == 0 ? 2 : 1;
+}
+
+/* the table of the guards of 'fn', which is only emitted if there are any */
+static const char *emit_guard_table(struct emit_fn *fn, char *buf, size_t size) {
+    if ( fn->guard_count == 0 ) {
+        return "NULL";
+    }
+    snprintf(buf, size, "lspr_guards_%zu", fn->form);
+    return buf;
+}
+
+/* boxing entry of the C code of 'fn'; called in place of the interpreter */
+static void emit_native(struct emit_buf *b, struct emit_fn *fn) {
+    char table[64];
+    emit_printf(b,
+        "static int lspr_native_%zu(struct lisper_ctx *ctx, struct lvalue **bound, size_t bound_count, struct lvalue **args, struct lvalue **res) {\n"
+        "    long long a[%zu];\n"
+        "    char deopt = 0;\n"
+        "    (void) ctx;\n"
+        "    if ( !laot_int_args(bound, bound_count, args, %zu, a) || !laot_guards_hold(%s, %zu) ) {\n"
+        "        return 0;\n"
+        "    }\n"
+        "    long long r = lspr_fn_%zu(",
+        fn->form, fn->arity > 0 ? fn->arity : 1, fn->arity, emit_guard_table(fn, table, sizeof(table)), fn->guard_count,
+        fn->form);
+    for ( size_t i = 0; i < fn->arity; ++i ) {
+        emit_printf(b, "a[%zu], ", i);
+    }
+    emit_printf(b,
+        "&deopt);\n"
+        "    if ( deopt ) {\n"
+        "        return 0;\n"
+        "    }\n"
+        "    *res = %s(r);\n"
+        "    return 1;\n"
+        "}\n\n",
+        fn->result == EMIT_INT ? "lvalue_int" : "lvalue_bool");
+}
+
+static void emit_program(FILE *out, struct lvalue *forms, struct emit_fn *fns, size_t fn_count) {
+    struct emit_buf b = { NULL, 0, 0 };
+    size_t count = forms->val.l.count;
+
+    emit_printf(&b,
+        "/* Generated by 'lisper --emit-c'. Link with liblisper: cc -I<lisper>/src prog.c liblisper.a -lm */\n"
+        "#include <stdio.h>\n"
+        "#include <math.h>\n"
+        "#include \"lisper.h\"\n"
+        "#include \"aot.h\"\n\n");
+
+    size_t compiled = 0;
+    for ( size_t i = 0; i < fn_count; ++i ) {
+        if ( emit_ok(fns[i].result) ) {
+            emit_signature(&b, &fns[i]);
+            emit_printf(&b, ";\n");
+            emit_printf(&b, "static int lspr_native_%zu(struct lisper_ctx *, struct lvalue **, size_t, struct lvalue **, struct lvalue **);\n", fns[i].form);
+            compiled++;
+        }
+    }
+    if ( compiled > 0 ) {
+        emit_printf(&b, "\n");
+    }
+
+    for ( size_t i = 0; i < fn_count; ++i ) {
+        if ( emit_ok(fns[i].result) ) {
+            emit_guards(&b, forms->val.l.cells[fns[i].form], &fns[i]);
+        }
+    }
+    for ( size_t i = 0; i < fn_count; ++i ) {
+        if ( emit_ok(fns[i].result) ) {
+            emit_printf(&b, "%s", fns[i].code.data);
+            emit_native(&b, &fns[i]);
+        }
+    }
+
+    for ( size_t i = 0; i < count; ++i ) {
+        emit_form(&b, forms->val.l.cells[i], i);
+    }
+
+    emit_printf(&b, "static struct laot_form lspr_forms[] = {\n");
+    for ( size_t i = 0, f = 0; i < count; ++i ) {
+        while ( f < fn_count && fns[f].form < i ) {
+            f++;
+        }
+        if ( f < fn_count && fns[f].form == i && emit_ok(fns[f].result) ) {
+            emit_printf(&b, "    { lspr_form_%zu, ", i);
+            emit_string(&b, fns[f].name);
+            char table[64];
+            emit_printf(&b, ", lspr_native_%zu, lspr_definers_%zu, %zu, %s, %zu },\n",
+                i, i, emit_definer_count(forms->val.l.cells[i]), emit_guard_table(&fns[f], table, sizeof(table)),
+                fns[f].guard_count);
+        } else {
+            emit_printf(&b, "    { lspr_form_%zu, NULL, NULL, NULL, 0, NULL, 0 },\n", i);
+        }
+    }
+    if ( count == 0 ) {
+        emit_printf(&b, "    { NULL, NULL, NULL, NULL, 0, NULL, 0 }\n");
+    }
+    emit_printf(&b, "};\n\n");
+
+    emit_printf(&b,
+        "int main(int argc, char **argv) {\n"
+        "    struct lisper_ctx *ctx = lisper_create(argc, argv);\n"
+        "    if ( ctx == NULL ) {\n"
+        "        fprintf(stderr, \"Error: Couldn't create lisper interpreter\\n\");\n"
+        "        return 1;\n"
+        "    }\n"
+        "    int rc = laot_run(ctx, lspr_forms, %zu);\n"
+        "    lisper_destroy(ctx);\n"
+        "    return rc;\n"
+        "}\n",
+        count);
+
+    fwrite(b.data, 1, b.len, out);
+    free(b.data);
+}
+
+/*
+ * Writes the program in params->filename to stdout as C source that
+ * builds into a standalone executable running the program.
+ */
+int exec_emit_c(struct lisper_ctx *ctx, struct lisper_params *params) {
+    mpc_result_t r;
+    if ( !mpc_parse_contents(params->filename, ctx->elems.Lisper, &r) ) {
+        mpc_err_print(r.error);
+        mpc_err_delete(r.error);
+        return 1;
+    }
+    struct lvalue *forms = lvalue_read(r.output);
+    mpc_ast_delete(r.output);
+
+    size_t count = forms->val.l.count;
+    struct emit_fn *fns = malloc((count + 1) * sizeof(struct emit_fn));
+    size_t fn_count = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( emit_definition(forms->val.l.cells[i], &fns[fn_count]) ) {
+            fns[fn_count].form = i;
+            for ( size_t j = 0; j < fn_count; ++j ) {
+                if ( fns[j].name == fns[fn_count].name ) {
+                    fns[j].duplicate = 1;
+                    fns[fn_count].duplicate = 1;
+                }
+            }
+            fn_count++;
+        }
+    }
+
+    struct emit_compiler c;
+    memset(&c, 0, sizeof(c));
+    c.fns = fns;
+    c.fn_count = fn_count;
+
+    /* functions are compiled once the functions they call are */
+    int progress = 1;
+    while ( progress ) {
+        progress = 0;
+        for ( size_t i = 0; i < fn_count; ++i ) {
+            struct emit_fn *fn = &fns[i];
+            if ( fn->done ) {
+                continue;
+            }
+            enum emit_kind k = fn->duplicate ? EMIT_NONE : emit_compile(&c, fn);
+            if ( k != EMIT_LATER ) {
+                fn->done = 1;
+                fn->result = k;
+                progress = 1;
+            }
+        }
+    }
+
+    emit_program(stdout, forms, fns, fn_count);
+
+    for ( size_t i = 0; i < fn_count; ++i ) {
+        free(fns[i].code.data);
+        free(fns[i].guards);
+    }
+    free(fns);
+    free(c.body.data);
+    free(c.guards);
+    lvalue_del(forms);
+    return ferror(stdout) ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#ifndef LISPER_EMITC
+#define LISPER_EMITC
+
+#include "context.h"
+#include "prgparams.h"
+
+int exec_emit_c(struct lisper_ctx *, struct lisper_params *);
+
+#endif
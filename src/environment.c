@@ -4,24 +4,26 @@
 #include "builtin.h"
 #include "value.h"
 #include "compat_string.h"
+#include "context.h"
+#include "symbol.h"
+
+/*
+ * Names of environment entries are interned symbol names,
+ * so they are hashed once and compared by pointer.
+ */
+static size_t lenvironment_index(struct lenvironment *e, char *name) {
+    return lsymbol_of(name)->hash % e->capacity;
+}
 
-size_t lenvironment_hash(size_t capacity, char *key) {
-    size_t i;
-    size_t res = 0;
-    size_t key_size = strlen(key);
-
-    for ( i = 0; i < key_size; ++i ) {
-        res += key[i];
-        if ( i < key_size - 1 ) {
-            res <<= 1;
-        }
-    }
-
-    return res % capacity;
+static int lenvironment_is_global(struct lenvironment *e) {
+    return e->ctx != NULL && e->ctx->env == e;
 }
 
-struct lenvironment_entry *lenvironment_entry_new() {
-    struct lenvironment_entry *entry = malloc(sizeof(struct lenvironment_entry));
+/* an entry of the environment 'e'; the entries of scopes come from the region of the interpreter */
+static struct lenvironment_entry *lenvironment_entry_alloc(struct lenvironment *e) {
+    struct lenvironment_entry *entry = e != NULL && e->region != NULL ?
+        lregion_alloc(e->region, sizeof(struct lenvironment_entry)) :
+        malloc(sizeof(struct lenvironment_entry));
     entry->name = NULL;
     entry->envval = NULL;
     entry->next = NULL;
@@ -29,26 +31,39 @@ struct lenvironment_entry *lenvironment_entry_new() {
     return entry;
 }
 
-void lenvironment_entry_del(struct lenvironment_entry *e) {
-    if ( e->envval != NULL ) {
-        lvalue_del(e->envval);
-    }
-    if ( e->name != NULL ) {
-        free(e->name);
-    }
-    if ( e->next != NULL ) {
-        lenvironment_entry_del(e->next);
+struct lenvironment_entry *lenvironment_entry_new() {
+    return lenvironment_entry_alloc(NULL);
+}
+
+/* entries of a region are left for the release of the region */
+static void lenvironment_entry_del(struct lenvironment_entry *e, int global, int in_region) {
+    while ( e != NULL ) {
+        struct lenvironment_entry *next = e->next;
+        if ( e->envval != NULL ) {
+            lvalue_del(e->envval);
+        }
+        if ( e->name != NULL ) {
+            struct lsymbol *sym = lsymbol_of(e->name);
+            if ( global ) {
+                sym->global = NULL;
+            } else {
+                sym->shadows--;
+            }
+        }
+        if ( !in_region ) {
+            free(e);
+        }
+        e = next;
     }
-    free(e);
 }
 
 struct lenvironment_entry *lenvironment_entry_copy(struct lenvironment_entry *e) {
     struct lenvironment_entry *x = lenvironment_entry_new();
 
     if ( !(e->name == NULL || e->envval == NULL) ) {
-        x->name = calloc(strlen(e->name) + 1, sizeof(char));
-        strcpy(x->name, e->name);
+        x->name = e->name;
         x->envval = lvalue_copy(e->envval);
+        lsymbol_of(x->name)->shadows++;
     }
 
     if ( e->next != NULL ) {
@@ -57,14 +72,45 @@ struct lenvironment_entry *lenvironment_entry_copy(struct lenvironment_entry *e)
     return x;
 }
 
-struct lenvironment *lenvironment_new(size_t capacity) {
-    struct lenvironment *env = malloc(sizeof(struct lenvironment));
+/*
+ * Initialize an environment over caller owned buckets,
+ * e.g. a scope living on the stack of a builtin.
+ * Scopes end in the reverse order they are made, so their
+ * entries are taken from the region of the interpreter and
+ * freed together when the scope is cleared.
+ */
+void lenvironment_init(struct lenvironment *env, struct lenvironment_entry **entries, size_t capacity) {
+    env->ctx = lisper_ctx_current();
     env->parent = NULL;
-    env->entries = malloc(capacity * sizeof(struct lenvironment_entry *));
+    env->entries = entries;
     env->capacity = capacity;
+    env->region = &env->ctx->region;
+    env->mark = lregion_mark(env->region);
     for (size_t i = 0; i < capacity; ++i) {
         env->entries[i] = NULL;
     }
+}
+
+/*
+ * Remove every binding of the environment; the buckets are kept.
+ */
+void lenvironment_clear(struct lenvironment *env) {
+    int global = lenvironment_is_global(env);
+    for ( size_t i = 0; i < env->capacity; ++i ) {
+        if ( env->entries[i] != NULL ) {
+            lenvironment_entry_del(env->entries[i], global, env->region != NULL);
+            env->entries[i] = NULL;
+        }
+    }
+    if ( env->region != NULL ) {
+        lregion_release(env->region, env->mark);
+    }
+}
+
+struct lenvironment *lenvironment_new(size_t capacity) {
+    struct lenvironment *env = malloc(sizeof(struct lenvironment));
+    lenvironment_init(env, malloc(capacity * sizeof(struct lenvironment_entry *)), capacity);
+    env->region = NULL;
     return env;
 }
 
@@ -73,17 +119,14 @@ void lenvironment_del(struct lenvironment *env) {
         return;
     }
     env->parent = NULL;
-    for ( size_t i = 0; i < env->capacity; ++i ) {
-        if ( env->entries[i] != NULL ) {
-            lenvironment_entry_del(env->entries[i]);
-        }
-    }
+    lenvironment_clear(env);
     free(env->entries);
     free(env);
 }
 
 struct lenvironment *lenvironment_copy(struct lenvironment *env) {
     struct lenvironment *new = lenvironment_new(env->capacity);
+    new->ctx = env->ctx;
     new->parent = env->parent;
     for ( size_t i = 0; i < env->capacity; ++i ) {
         if ( env->entries[i] != NULL ) {
@@ -94,9 +137,9 @@ struct lenvironment *lenvironment_copy(struct lenvironment *env) {
     return new;
 }
 
-void lenvironment_add_builtin(struct lenvironment *e, char *name, struct lvalue *( *func)(struct lenvironment *, struct lvalue *)) {
-    struct lvalue *k = lvalue_sym(name);
-    struct lvalue *v = lvalue_builtin(func);
+void lenvironment_add_builtin(struct lenvironment *e, const struct lbuiltin *b) {
+    struct lvalue *k = lvalue_sym(b->name);
+    struct lvalue *v = lvalue_builtin(b);
 
     lenvironment_put(e, k, v);
 
@@ -104,86 +147,55 @@ void lenvironment_add_builtin(struct lenvironment *e, char *name, struct lvalue
     lvalue_del(v);
 }
 
+static struct lenvironment_entry *lenvironment_find(struct lenvironment *e, char *name) {
+    struct lenvironment_entry *iter = e->entries[lenvironment_index(e, name)];
+    while ( iter != NULL && iter->name != name ) {
+        iter = iter->next;
+    }
+    return iter;
+}
+
 struct lvalue *lenvironment_get(struct lenvironment *e, struct lvalue *k) {
+    struct lsymbol *sym = lsymbol_of(k->val.strval);
 
-    size_t i = lenvironment_hash(e->capacity, k->val.strval);
-    struct lenvironment_entry *entry = e->entries[i];
+    if ( sym->shadows == 0 && sym->global != NULL ) {
+        /* inline cache hit; nothing can shadow the global binding */
+        return lvalue_copy(sym->global->envval);
+    }
 
-    if ( entry != NULL ) {
-        if ( strcmp(entry->name, k->val.strval) == 0 ) {
+    for ( ; e != NULL; e = e->parent ) {
+        struct lenvironment_entry *entry = lenvironment_find(e, k->val.strval);
+        if ( entry != NULL ) {
             return lvalue_copy(entry->envval);
         }
-        struct lenvironment_entry *entry_iter = entry->next;
-        /* go through the linked list */
-        while ( entry_iter != NULL ) {
-            if ( strcmp(entry_iter->name, k->val.strval) == 0 ) {
-                /* found in chain */
-                return lvalue_copy(entry_iter->envval);
-            }
-        }
-    } else if ( e->parent != NULL ) {
-        for (
-            struct lenvironment *environment_iter = e->parent;
-            environment_iter != NULL;
-            environment_iter = environment_iter->parent
-        ) {
-            i = lenvironment_hash(environment_iter->capacity, k->val.strval);
-            entry = environment_iter->entries[i];
-            if ( entry != NULL ) {
-                break;
-            }
-        }
-
-        if (entry != NULL) {
-            if ( strcmp(entry->name, k->val.strval) == 0 ) {
-                return lvalue_copy(entry->envval);
-            }
-            struct lenvironment_entry *entry_iter = entry->next;
-            /* go through the linked list */
-            while ( entry_iter != NULL ) {
-                if ( strcmp(entry_iter->name, k->val.strval) == 0 ) {
-                    /* found in chain */
-                    return lvalue_copy(entry_iter->envval);
-                }
-            }
-        }
     }
 
     return lvalue_err("Unbound symbol '%s'", k->val.strval);
 }
 
 void lenvironment_put(struct lenvironment *e, struct lvalue *k, struct lvalue *v) {
-    size_t i = lenvironment_hash(e->capacity, k->val.strval);
+    struct lenvironment_entry *entry = lenvironment_find(e, k->val.strval);
 
-    struct lenvironment_entry *entry = e->entries[i];
-    if ( entry == NULL ) {
-        /* chain is empty */
-        entry = lenvironment_entry_new();
+    if ( entry != NULL ) {
+        /* match in the chain --> override sematics */
+        lvalue_del(entry->envval);
         entry->envval = lvalue_copy(v);
-        entry->name = strdup(k->val.strval);
-        e->entries[i] = entry;
-    } else {
-        /* chain is non-empty */
-        struct lenvironment_entry *iter = entry;
-
-        while ( iter != NULL ) {
-            if ( strcmp(iter->name, k->val.strval) == 0 ) {
-                /* match in the chain --> override sematics */
-                lvalue_del(iter->envval);
-                iter->envval = lvalue_copy(v);
-                return;
-            }
-            iter = iter->next;
-        }
-
-        /* not found in chain --> offer to front */
+        return;
+    }
 
-        struct lenvironment_entry *old = entry;
-        struct lenvironment_entry *new = lenvironment_entry_new();
-        new->envval = lvalue_copy(v);
-        new->name = strdup(k->val.strval);
-        new->next = old;
-        e->entries[i] = new;
+    /* not found in chain --> offer to front */
+    size_t i = lenvironment_index(e, k->val.strval);
+    entry = lenvironment_entry_alloc(e);
+    entry->envval = lvalue_copy(v);
+    entry->name = k->val.strval;
+    entry->next = e->entries[i];
+    e->entries[i] = entry;
+
+    struct lsymbol *sym = lsymbol_of(entry->name);
+    if ( lenvironment_is_global(e) ) {
+        sym->global = entry;
+    } else {
+        sym->shadows++;
     }
 }
 
@@ -208,4 +220,3 @@ void lenvironment_pretty_print(struct lenvironment *e) {
         }
     }
 }
-
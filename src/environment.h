@@ -2,8 +2,11 @@
 #define LISPER_LENV
 
 #include "value.h"
+#include "region.h"
 #include <stdlib.h>
 
+struct lisper_ctx;
+
 struct lenvironment_entry {
     char *name;
     struct lvalue *envval;
@@ -11,18 +14,23 @@ struct lenvironment_entry {
 };
 
 struct lenvironment {
+    struct lisper_ctx *ctx; /* interpreter owning this environment */
     struct lenvironment *parent;
     struct lenvironment_entry **entries;
     size_t capacity;
+    struct lregion *region; /* allocator of the entries of a scope; NULL for malloc'd entries */
+    struct lregion_mark mark; /* end of the region when the scope was made */
 };
 
 struct lenvironment *lenvironment_new(size_t cap);
+void lenvironment_init(struct lenvironment *, struct lenvironment_entry **, size_t);
+void lenvironment_clear(struct lenvironment *);
 void lenvironment_del(struct lenvironment *);
 struct lenvironment *lenvironment_copy(struct lenvironment *);
 struct lvalue *lenvironment_get(struct lenvironment *, struct lvalue *);
 void lenvironment_def(struct lenvironment *, struct lvalue *, struct lvalue *);
 void lenvironment_put(struct lenvironment *, struct lvalue *, struct lvalue *);
-void lenvironment_add_builtin(struct lenvironment *, char *, struct lvalue *(*)(struct lenvironment *, struct lvalue *));
+void lenvironment_add_builtin(struct lenvironment *, const struct lbuiltin *);
 void lenvironment_pretty_print(struct lenvironment *);
 
 #endif
@@ -1,3 +1,6 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include "execute.h"
@@ -6,9 +9,17 @@
 #include "environment.h"
 #include "builtin.h"
 #include "lisper.h"
+#include "context.h"
+#include "reader.h"
+#include "parse.h"
 
-#ifdef _WIN32
 #include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
 /* windows support */
 static char buf[2048];
 
@@ -25,6 +36,7 @@ char *linenoise(char *prompt) {
 void linenoiseHistoryAdd(char* unused) {}
 
 #else
+#include <unistd.h>
 #include "linenoise.h"
 #endif
 
@@ -33,7 +45,8 @@ void goodbye_exit(void) {
     putchar('\n');
 }
 
-int exec_repl(struct lenvironment *env, struct grammar_elems *elems) {
+int exec_repl(struct lisper_ctx *ctx) {
+    struct lenvironment *env = ctx->env;
     char *input = NULL;
     int rc = 0;
     printf("lisper version %s\n", LISPER_VERSION);
@@ -59,7 +72,7 @@ int exec_repl(struct lenvironment *env, struct grammar_elems *elems) {
 
         linenoiseHistoryAdd(input);
 
-        if ( mpc_parse("<stdin>", input, elems->Lisper, &r) ) {
+        if ( mpc_parse("<stdin>", input, ctx->elems.Lisper, &r) ) {
             struct lvalue *read = lvalue_read(r.output);
 #ifdef _DEBUG
             printf("Parsed input:\n");
@@ -70,9 +83,13 @@ int exec_repl(struct lenvironment *env, struct grammar_elems *elems) {
             lenvironment_pretty_print(env);
             printf("Eval result:\n");
 #endif
+            struct lregion_mark mark = lregion_mark(&ctx->region);
+            lbudget_start(ctx, &ctx->limits); /* each input is an evaluation of its own */
             val = lvalue_eval(env, read);
             lvalue_println(val);
             lvalue_del(val);
+            lregion_release(&ctx->region, mark);
+            lisper_ctx_trim(ctx, 0);
             mpc_ast_delete(r.output);
         } else {
             mpc_err_print(r.error);
@@ -85,22 +102,25 @@ int exec_repl(struct lenvironment *env, struct grammar_elems *elems) {
 }
 
 
-int exec_filein(struct lenvironment *env, struct lisper_params *params) {
+int exec_filein(struct lisper_ctx *ctx, struct lisper_params *params) {
     int rc = 0;
+    lbudget_start(ctx, &ctx->limits);
     struct lvalue *args = lvalue_add(lvalue_sexpr(), lvalue_str(params->filename));
-    struct lvalue *x = builtin_load(env, args);
+    struct lvalue *x = builtin_load(ctx->env, args);
     if ( x->type == LVAL_ERR ) {
         lvalue_println(x);
         rc = 1;
     }
     lvalue_del(x);
+    lco_wait(ctx); /* the program ends with its coroutines */
     return rc;
 }
 
-int exec_eval(struct lenvironment *env,struct grammar_elems *elems, struct lisper_params *params) {
+int exec_eval(struct lisper_ctx *ctx, struct lisper_params *params) {
+    struct lenvironment *env = ctx->env;
     int rc = 0;
     mpc_result_t r;
-    if ( mpc_parse("<stdin>", params->command, elems->Lisper, &r) ) {
+    if ( mpc_parse("<stdin>", params->command, ctx->elems.Lisper, &r) ) {
         struct lvalue *read = lvalue_read(r.output);
 #ifdef _DEBUG
         printf("Parsed input:\n");
@@ -111,6 +131,7 @@ int exec_eval(struct lenvironment *env,struct grammar_elems *elems, struct lispe
         lenvironment_pretty_print(env);
         printf("Eval result:\n");
 #endif
+        lbudget_start(ctx, &ctx->limits);
         struct lvalue *val = lvalue_eval(env, read);
         lvalue_println(val);
         if (val->type == LVAL_ERR) {
@@ -118,6 +139,7 @@ int exec_eval(struct lenvironment *env,struct grammar_elems *elems, struct lispe
         }
         lvalue_del(val);
         mpc_ast_delete(r.output);
+        lco_wait(ctx);
     } else {
         mpc_err_print(r.error);
         mpc_err_delete(r.error);
@@ -125,3 +147,227 @@ int exec_eval(struct lenvironment *env,struct grammar_elems *elems, struct lispe
     }
     return rc;
 }
+
+/*
+ * Whether stdin is a terminal that a REPL session can be run on.
+ */
+int exec_interactive(void) {
+    return isatty(fileno(stdin));
+}
+
+/*
+ * Evaluates the top-level expressions in 'text' and prints their results.
+ */
+static int stream_eval(struct lisper_ctx *ctx, char *text) {
+    mpc_result_t r;
+    if ( !mpc_parse("<stdin>", text, ctx->elems.Lisper, &r) ) {
+        mpc_err_print(r.error);
+        mpc_err_delete(r.error);
+        return 1;
+    }
+
+    struct lvalue *expr = lvalue_read(r.output);
+    mpc_ast_delete(r.output);
+
+    for ( size_t i = 0; i < expr->val.l.count; ++i ) {
+        /* like an input of the REPL, each expression is an evaluation of its own */
+        struct lregion_mark mark = lregion_mark(&ctx->region);
+        lbudget_start(ctx, &ctx->limits);
+        struct lvalue *val = lvalue_eval(ctx->env, expr->val.l.cells[i]);
+        expr->val.l.cells[i] = NULL;
+        if ( !(val->type == LVAL_SEXPR && val->val.l.count == 0) ) {
+            lvalue_println(val);
+        }
+        lvalue_del(val);
+        lregion_release(&ctx->region, mark);
+        lisper_ctx_trim(ctx, 0);
+    }
+
+    expr->val.l.count = 0;
+    lvalue_del(expr);
+    return 0;
+}
+
+/*
+ * Non-interactive counterpart of the REPL. Reads the program from 'in'
+ * as it arrives and evaluates each complete top-level expression, so
+ * expressions may span lines and memory use does not grow with the
+ * length of the program. Results other than () are written to stdout.
+ */
+int exec_stream(struct lisper_ctx *ctx, FILE *in) {
+    const size_t chunk_size = 64 * 1024;
+    size_t cap = chunk_size * 2;
+    size_t len = 0;
+    char *buf = malloc(cap + 1);
+    int eof = 0;
+    int rc = 0;
+
+    struct lparse_scanner scanner;
+    memset(&scanner, 0, sizeof(struct lparse_scanner));
+    setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+    while ( buf != NULL ) {
+        size_t start, end;
+        if ( lparse_scan(&scanner, buf, len, eof, &start, &end) ) {
+            char saved = buf[end];
+            buf[end] = '\0';
+            rc |= stream_eval(ctx, buf + start);
+            buf[end] = saved;
+            continue;
+        }
+
+        if ( eof ) {
+            break;
+        }
+
+        /* move the unconsumed tail to the front and read more */
+        size_t head = scanner.started ? scanner.start : scanner.pos; /* first unconsumed byte */
+        memmove(buf, buf + head, len - head);
+        len -= head;
+        scanner.pos -= head;
+        if ( scanner.started ) {
+            scanner.start -= head;
+        }
+
+        if ( cap - len < chunk_size ) {
+            cap *= 2;
+            char *resized = realloc(buf, cap + 1);
+            if ( resized == NULL ) {
+                perror("Could not grow input buffer");
+                rc = 1;
+                break;
+            }
+            buf = resized;
+        }
+
+        size_t n = fread(buf + len, 1, chunk_size, in);
+        len += n;
+        if ( n < chunk_size ) {
+            eof = feof(in) || ferror(in);
+        }
+    }
+
+    fflush(stdout);
+    free(buf);
+    lco_wait(ctx);
+    return rc;
+}
+
+/*
+ * Calls 'func' with every line of 'in' and writes the non-empty results.
+ * Returns non-zero if any call resulted in an error.
+ */
+static int each_line_run(struct lisper_ctx *ctx, struct lvalue *func, FILE *in, const char *name) {
+    char *line = NULL;
+    size_t cap = 0;
+    long len;
+    size_t lineno = 0;
+    int rc = 0;
+
+    /* the one argument of every call is a string reading the line buffer in place */
+    struct lvalue *arg = lvalue_str("");
+    free(arg->val.strval);
+
+    while ( (len = lfile_readline(in, &line, &cap)) >= 0 ) {
+        lineno++;
+        if ( len > 0 && line[len - 1] == '\n' ) {
+            line[--len] = '\0';
+        }
+        arg->val.strval = line;
+
+        /* each record is an evaluation of its own */
+        struct lregion_mark mark = lregion_mark(&ctx->region);
+        lbudget_start(ctx, &ctx->limits);
+        struct lvalue *res = lvalue_call_span(ctx->env, func, 1, &arg);
+
+        switch ( res->type ) {
+            case LVAL_STR:
+                if ( res->val.strval[0] != '\0' ) {
+                    fputs(res->val.strval, stdout);
+                    putchar('\n');
+                }
+                break;
+            case LVAL_SEXPR:
+            case LVAL_QEXPR:
+                if ( res->val.l.count > 0 ) {
+                    lvalue_println(res);
+                }
+                break;
+            case LVAL_ERR:
+                fflush(stdout);
+                fprintf(stderr, "%s:%zu: Error: %s\n", name, lineno, res->val.strval);
+                rc = 1;
+                break;
+            default:
+                lvalue_println(res);
+                break;
+        }
+        lvalue_del(res);
+        lregion_release(&ctx->region, mark);
+        lisper_ctx_trim(ctx, 0);
+    }
+
+    arg->val.strval = line;
+    lvalue_del(arg); /* and the line buffer with it */
+    return rc;
+}
+
+/*
+ * awk-like record processing. Loads the script once and then calls the
+ * named function with each line of the input files (or stdin) as a
+ * string. Non-empty results are written to stdout, one per line.
+ */
+int exec_each_line(struct lisper_ctx *ctx, struct lisper_params *params) {
+    lbudget_start(ctx, &ctx->limits);
+    struct lvalue *x = builtin_load(ctx->env, lvalue_add(lvalue_sexpr(), lvalue_str(params->each_line_script)));
+    if ( x->type == LVAL_ERR ) {
+        lvalue_println(x);
+        lvalue_del(x);
+        return 1;
+    }
+    lvalue_del(x);
+
+    struct lvalue *sym = lvalue_sym(params->each_line_func);
+    struct lvalue *func = lenvironment_get(ctx->env, sym);
+    lvalue_del(sym);
+
+    if ( func->type != LVAL_FUNCTION && func->type != LVAL_PAP && func->type != LVAL_BUILTIN && func->type != LVAL_MEMO ) {
+        if ( func->type == LVAL_ERR ) {
+            lvalue_println(func);
+        } else {
+            printf("Error: '%s' is a %s; expected a function\n", params->each_line_func, ltype_name(func->type));
+        }
+        lvalue_del(func);
+        return 1;
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+    int rc = 0;
+    if ( params->input_count == 0 ) {
+        rc = each_line_run(ctx, func, stdin, "<stdin>");
+    }
+
+    for ( int i = 0; i < params->input_count; ++i ) {
+        char *path = params->inputs[i];
+        if ( strcmp(path, "-") == 0 ) {
+            rc |= each_line_run(ctx, func, stdin, "<stdin>");
+            continue;
+        }
+
+        FILE *in = fopen(path, "r");
+        if ( in == NULL ) {
+            fflush(stdout);
+            fprintf(stderr, "Error: Could not open file '%s'. %s\n", path, strerror(errno));
+            rc = 1;
+            continue;
+        }
+        setvbuf(in, NULL, _IOFBF, 64 * 1024);
+        rc |= each_line_run(ctx, func, in, path);
+        lfile_close(in);
+    }
+
+    fflush(stdout);
+    lvalue_del(func);
+    return rc;
+}
@@ -1,14 +1,20 @@
 #ifndef LISPER_EXEC
 #define LISPER_EXEC
 
-#include "environment.h"
-#include "grammar.h"
+#include <stdio.h>
+#include "context.h"
 #include "prgparams.h"
 
-int exec_repl(struct lenvironment *, struct grammar_elems *);
+int exec_repl(struct lisper_ctx *);
 
-int exec_filein(struct lenvironment *, struct lisper_params *);
+int exec_filein(struct lisper_ctx *, struct lisper_params *);
 
-int exec_eval(struct lenvironment *env, struct grammar_elems *elems, struct lisper_params *params);
+int exec_eval(struct lisper_ctx *ctx, struct lisper_params *params);
+
+int exec_stream(struct lisper_ctx *, FILE *);
+
+int exec_each_line(struct lisper_ctx *, struct lisper_params *);
+
+int exec_interactive(void);
 
 #endif
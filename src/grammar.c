@@ -3,8 +3,7 @@
 
 void grammar_elems_init(struct grammar_elems *elems) {
     elems->Boolean = mpc_new("boolean");
-    elems->Integer = mpc_new("integer");
-    elems->Float = mpc_new("float");
+    elems->Number = mpc_new("number");
     elems->String = mpc_new("string");
     elems->Comment = mpc_new("comment");
     elems->Symbol = mpc_new("symbol");
@@ -15,10 +14,9 @@ void grammar_elems_init(struct grammar_elems *elems) {
 }
 
 void grammar_elems_destroy(struct grammar_elems *elems) {
-    mpc_cleanup(10,
+    mpc_cleanup(9,
         elems->Boolean,
-        elems->Integer,
-        elems->Float,
+        elems->Number,
         elems->Comment,
         elems->String,
         elems->Symbol,
@@ -33,18 +31,16 @@ void grammar_make_lang(struct grammar_elems *elems) {
     mpca_lang(MPCA_LANG_DEFAULT,
         "string     : /\"(\\\\.|[^\"])*\"/ ;"
         "boolean    : \"true\" | \"false\" ;"
-        "float      : /([-+])?[0-9]+(\\.[0-9]*)?[eE][0-9]+/ | /([-+])?[0-9]+\\.[0-9]*/ ;"
-        "integer    : /([-+])?[0-9]+/ ;"
+        "number     : /[-+]?[0-9]+(\\.[0-9]*)?([eE][-+]?[0-9]+)?/ ;"
         "symbol     : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&%|.]+/ ;"
         "comment    : /;[^\\r\\n]*/ ;"
         "qexpr      : '{' <expr>* '}' ;"
         "sexpr      : '(' <expr>* ')' ;"
-        "expr       : <string> | <boolean> | <float> | <integer> | <symbol>"
+        "expr       : <string> | <boolean> | <number> | <symbol>"
                    "| <sexpr>  | <qexpr>   | <comment> ;"
         "lisper     : /^/ <expr>* /$/ ;",
         elems->Boolean,
-        elems->Integer,
-        elems->Float,
+        elems->Number,
         elems->String,
         elems->Symbol,
         elems->Comment,
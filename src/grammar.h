@@ -5,8 +5,7 @@
 
 struct grammar_elems {
     mpc_parser_t* Boolean;
-    mpc_parser_t* Integer;
-    mpc_parser_t* Float;
+    mpc_parser_t* Number; /* integers and floats, told apart by the reader */
     mpc_parser_t* String;
     mpc_parser_t* Symbol;
     mpc_parser_t* Comment;
@@ -0,0 +1,853 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+#include "context.h"
+#include "value.h"
+#include "environment.h"
+#include "symbol.h"
+#include "builtin.h"
+#include "probe.h"
+
+#if defined(LISPER_ENABLE_JIT) && defined(__x86_64__) && defined(__linux__)
+
+/*
+ * Template JIT for x86-64.
+ *
+ * A function called often enough has its body compiled, one template of
+ * machine code per form, if the body only consists of integer, float and
+ * boolean literals, parameters, the pure arithmetic and comparison
+ * builtins, 'if', '&&', '||' and calls of the function itself. The code is
+ * specialized to the types of the arguments of the call that made the
+ * function hot, each an integer or a float, and is only entered when the
+ * arguments have those types.
+ *
+ * The code was specialized to the bindings of the names it calls. These
+ * are guarded on every entry, and when a guard fails the interpreter runs
+ * the call instead. Code that cannot go on (division by zero) deopts: it
+ * raises a flag and unwinds, and the interpreter reruns the call from the
+ * start. As the compiled subset is pure, rerunning is safe.
+ *
+ * Compiled code is called as 'long long f(const long long *args, char *deopt)'
+ * and keeps 'args' in rbx and 'deopt' in r12. Intermediate values live on
+ * the machine stack and results are returned in rax; a float is carried
+ * as its bits and only moved to xmm0 and xmm1 to be operated on.
+ */
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LJIT_MAX_ARGS 8
+#define LJIT_MAX_GUARDS 32
+
+/* invocations of a function before it is compiled */
+static const size_t jit_threshold = 100;
+
+enum ljit_kind {
+    LJIT_NONE, /* not compilable */
+    LJIT_INT,
+    LJIT_BOOL,
+    LJIT_FLOAT
+};
+
+/* a name whose binding the code was specialized to */
+struct ljit_guard {
+    struct lsymbol *sym;
+    enum ltype type;
+    const void *expected; /* builtin descriptor or function */
+};
+
+struct ljit {
+    union {
+        void *code;
+        long long (*entry)(const long long *, char *);
+    } fn;
+    size_t mapped; /* size of the executable mapping */
+    size_t length; /* bytes of machine code */
+    enum ljit_kind result;
+    enum ljit_kind params[LJIT_MAX_ARGS]; /* types of the arguments the code takes */
+    size_t guard_count;
+    struct ljit_guard guards[LJIT_MAX_GUARDS];
+};
+
+struct ljit_compiler {
+    struct lfunction *func;
+    enum ljit_kind self_kind; /* assumed result of recursive calls */
+    const enum ljit_kind *params; /* types of the parameters */
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    int oom;
+    size_t depth; /* values pushed on the machine stack */
+    size_t *deopts; /* rel32 operands jumping to the deopt exit */
+    size_t deopt_count;
+    size_t deopt_cap;
+    size_t guard_count;
+    struct ljit_guard guards[LJIT_MAX_GUARDS];
+};
+
+static void ljit_emit(struct ljit_compiler *c, const unsigned char *bytes, size_t n) {
+    if ( c->len + n > c->cap ) {
+        size_t cap = c->cap == 0 ? 256 : c->cap;
+        while ( cap < c->len + n ) {
+            cap *= 2;
+        }
+        unsigned char *buf = realloc(c->buf, cap);
+        if ( buf == NULL ) {
+            c->oom = 1;
+            return;
+        }
+        c->buf = buf;
+        c->cap = cap;
+    }
+    memcpy(c->buf + c->len, bytes, n);
+    c->len += n;
+}
+
+#define LJIT_EMIT(c, ...) do { \
+    const unsigned char bytes_[] = { __VA_ARGS__ }; \
+    ljit_emit(c, bytes_, sizeof(bytes_)); \
+} while (0)
+
+static void ljit_emit_imm32(struct ljit_compiler *c, int32_t v) {
+    uint32_t u = (uint32_t) v;
+    LJIT_EMIT(c, u & 0xff, (u >> 8) & 0xff, (u >> 16) & 0xff, (u >> 24) & 0xff);
+}
+
+static void ljit_emit_imm64(struct ljit_compiler *c, long long v) {
+    uint64_t u = (uint64_t) v;
+    for ( int i = 0; i < 8; ++i ) {
+        LJIT_EMIT(c, (u >> (8 * i)) & 0xff);
+    }
+}
+
+/* emit a jump with a rel32 operand to be patched; returns the operand position */
+static size_t ljit_emit_jump(struct ljit_compiler *c, const unsigned char *opcode, size_t n) {
+    ljit_emit(c, opcode, n);
+    size_t at = c->len;
+    ljit_emit_imm32(c, 0);
+    return at;
+}
+
+static void ljit_patch(struct ljit_compiler *c, size_t at, size_t target) {
+    if ( c->oom ) {
+        return;
+    }
+    uint32_t rel = (uint32_t) (int32_t) ((long long) target - (long long) (at + 4));
+    for ( int i = 0; i < 4; ++i ) {
+        c->buf[at + i] = (rel >> (8 * i)) & 0xff;
+    }
+}
+
+static const unsigned char op_jz[] = { 0x0f, 0x84 };
+static const unsigned char op_jnz[] = { 0x0f, 0x85 };
+static const unsigned char op_jmp[] = { 0xe9 };
+
+/* conditional jump to the deopt exit */
+static void ljit_emit_deopt_if(struct ljit_compiler *c, const unsigned char *opcode) {
+    size_t at = ljit_emit_jump(c, opcode, 2);
+    if ( c->deopt_count == c->deopt_cap ) {
+        size_t cap = c->deopt_cap == 0 ? 8 : c->deopt_cap * 2;
+        size_t *deopts = realloc(c->deopts, cap * sizeof(size_t));
+        if ( deopts == NULL ) {
+            c->oom = 1;
+            return;
+        }
+        c->deopts = deopts;
+        c->deopt_cap = cap;
+    }
+    c->deopts[c->deopt_count++] = at;
+}
+
+static void ljit_push(struct ljit_compiler *c) {
+    LJIT_EMIT(c, 0x50); /* push rax */
+    c->depth++;
+}
+
+/* pop the left operand into rax, leaving the right one in rcx */
+static void ljit_pop_operands(struct ljit_compiler *c) {
+    LJIT_EMIT(c, 0x48, 0x89, 0xc1); /* mov rcx, rax */
+    LJIT_EMIT(c, 0x58); /* pop rax */
+    c->depth--;
+}
+
+/* move float operands from rax and rcx to xmm0 and xmm1 */
+static void ljit_float_operands(struct ljit_compiler *c) {
+    LJIT_EMIT(c, 0x66, 0x48, 0x0f, 0x6e, 0xc0); /* movq xmm0, rax */
+    LJIT_EMIT(c, 0x66, 0x48, 0x0f, 0x6e, 0xc9); /* movq xmm1, rcx */
+}
+
+static int ljit_param(struct ljit_compiler *c, char *name) {
+    struct lvalue *formals = c->func->formals;
+    for ( size_t i = 0; i < c->func->arity; ++i ) {
+        if ( formals->val.l.cells[i]->val.strval == name ) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+static int ljit_guard(struct ljit_compiler *c, struct lsymbol *sym, enum ltype type, const void *expected) {
+    for ( size_t i = 0; i < c->guard_count; ++i ) {
+        if ( c->guards[i].sym == sym ) {
+            return 1;
+        }
+    }
+    if ( c->guard_count == LJIT_MAX_GUARDS ) {
+        return 0;
+    }
+    c->guards[c->guard_count].sym = sym;
+    c->guards[c->guard_count].type = type;
+    c->guards[c->guard_count].expected = expected;
+    c->guard_count++;
+    return 1;
+}
+
+static enum ljit_kind ljit_compile_expr(struct ljit_compiler *, struct lvalue *);
+static enum ljit_kind ljit_compile_form(struct ljit_compiler *, struct lvalue **, size_t);
+
+/* cells evaluated as a s-expression; a single cell is its own value */
+static enum ljit_kind ljit_compile_cells(struct ljit_compiler *c, struct lvalue **cells, size_t count) {
+    if ( count == 0 ) {
+        return LJIT_NONE;
+    }
+    if ( count == 1 ) {
+        return ljit_compile_expr(c, cells[0]);
+    }
+    return ljit_compile_form(c, cells, count);
+}
+
+static enum ljit_kind ljit_compile_expr(struct ljit_compiler *c, struct lvalue *x) {
+    int param;
+    switch ( x->type ) {
+        case LVAL_INT:
+            LJIT_EMIT(c, 0x48, 0xb8); /* mov rax, imm64 */
+            ljit_emit_imm64(c, x->val.intval);
+            return LJIT_INT;
+        case LVAL_BOOL:
+            LJIT_EMIT(c, 0x48, 0xb8);
+            ljit_emit_imm64(c, x->val.intval != 0);
+            return LJIT_BOOL;
+        case LVAL_FLOAT: {
+            long long bits;
+            memcpy(&bits, &x->val.floatval, sizeof(bits));
+            LJIT_EMIT(c, 0x48, 0xb8);
+            ljit_emit_imm64(c, bits);
+            return LJIT_FLOAT;
+        }
+        case LVAL_SYM:
+            param = ljit_param(c, x->val.strval);
+            if ( param < 0 ) {
+                return LJIT_NONE;
+            }
+            LJIT_EMIT(c, 0x48, 0x8b, 0x83); /* mov rax, [rbx + disp32] */
+            ljit_emit_imm32(c, param * 8);
+            return c->params[param];
+        case LVAL_SEXPR:
+            return ljit_compile_cells(c, x->val.l.cells, x->val.l.count);
+        default:
+            break;
+    }
+    return LJIT_NONE;
+}
+
+/* 'op' of the floats in xmm0 and xmm1, in rax */
+static void ljit_emit_float_arith(struct ljit_compiler *c, char op) {
+    ljit_float_operands(c);
+    switch ( op ) {
+        case '+':
+            LJIT_EMIT(c, 0xf2, 0x0f, 0x58, 0xc1); /* addsd xmm0, xmm1 */
+            break;
+        case '-':
+            LJIT_EMIT(c, 0xf2, 0x0f, 0x5c, 0xc1); /* subsd xmm0, xmm1 */
+            break;
+        case '*':
+            LJIT_EMIT(c, 0xf2, 0x0f, 0x59, 0xc1); /* mulsd xmm0, xmm1 */
+            break;
+        case '/':
+            LJIT_EMIT(c, 0xf2, 0x0f, 0x5e, 0xc1); /* divsd xmm0, xmm1 */
+            break;
+    }
+    LJIT_EMIT(c, 0x66, 0x48, 0x0f, 0x7e, 0xc0); /* movq rax, xmm0 */
+}
+
+static enum ljit_kind ljit_compile_arith(struct ljit_compiler *c, char op, struct lvalue **args, size_t argc) {
+    if ( argc == 0 ) {
+        return LJIT_NONE;
+    }
+    /* the operands are all of the type of the first; fmod is left to the interpreter */
+    enum ljit_kind kind = ljit_compile_expr(c, args[0]);
+    if ( (kind != LJIT_INT && kind != LJIT_FLOAT) || (kind == LJIT_FLOAT && op == '%') ) {
+        return LJIT_NONE;
+    }
+    if ( argc == 1 && op == '-' ) {
+        if ( kind == LJIT_INT ) {
+            LJIT_EMIT(c, 0x48, 0xf7, 0xd8); /* neg rax */
+        } else {
+            LJIT_EMIT(c, 0x48, 0x0f, 0xba, 0xf8, 0x3f); /* btc rax, 63 */
+        }
+    }
+
+    for ( size_t i = 1; i < argc; ++i ) {
+        ljit_push(c);
+        if ( ljit_compile_expr(c, args[i]) != kind ) {
+            return LJIT_NONE;
+        }
+        ljit_pop_operands(c);
+
+        if ( kind == LJIT_FLOAT ) {
+            if ( op == '/' ) {
+                /* division by either zero is an error of the interpreter */
+                LJIT_EMIT(c, 0x48, 0x89, 0xca); /* mov rdx, rcx */
+                LJIT_EMIT(c, 0x48, 0xd1, 0xe2); /* shl rdx, 1 */
+                ljit_emit_deopt_if(c, op_jz);
+            }
+            ljit_emit_float_arith(c, op);
+            continue;
+        }
+
+        size_t to_div, to_done;
+        switch ( op ) {
+            case '+':
+                LJIT_EMIT(c, 0x48, 0x01, 0xc8); /* add rax, rcx */
+                break;
+            case '-':
+                LJIT_EMIT(c, 0x48, 0x29, 0xc8); /* sub rax, rcx */
+                break;
+            case '*':
+                LJIT_EMIT(c, 0x48, 0x0f, 0xaf, 0xc1); /* imul rax, rcx */
+                break;
+            case '/':
+            case '%':
+                LJIT_EMIT(c, 0x48, 0x85, 0xc9); /* test rcx, rcx */
+                ljit_emit_deopt_if(c, op_jz);
+                /* by -1 without idiv, which traps on the smallest integer */
+                LJIT_EMIT(c, 0x48, 0x83, 0xf9, 0xff); /* cmp rcx, -1 */
+                to_div = ljit_emit_jump(c, op_jnz, 2);
+                if ( op == '/' ) {
+                    LJIT_EMIT(c, 0x48, 0xf7, 0xd8); /* neg rax */
+                } else {
+                    LJIT_EMIT(c, 0x31, 0xc0); /* xor eax, eax */
+                }
+                to_done = ljit_emit_jump(c, op_jmp, 1);
+                ljit_patch(c, to_div, c->len);
+                LJIT_EMIT(c, 0x48, 0x99); /* cqo */
+                LJIT_EMIT(c, 0x48, 0xf7, 0xf9); /* idiv rcx */
+                if ( op == '%' ) {
+                    LJIT_EMIT(c, 0x48, 0x89, 0xd0); /* mov rax, rdx */
+                }
+                ljit_patch(c, to_done, c->len);
+                break;
+        }
+    }
+    return kind;
+}
+
+/*
+ * Comparison of the floats in xmm0 and xmm1 as the interpreter makes it:
+ * nothing is equal to NaN, '<' and '>' are false with a NaN, and so
+ * '>=' and '<=', the negations of '<' and '>', are true.
+ */
+static void ljit_emit_float_compare(struct ljit_compiler *c, const char *op) {
+    ljit_float_operands(c);
+    if ( strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ) {
+        int eq = op[0] == '=';
+        LJIT_EMIT(c, 0x66, 0x0f, 0x2e, 0xc1); /* ucomisd xmm0, xmm1 */
+        LJIT_EMIT(c, 0x0f, eq ? 0x94 : 0x95, 0xc0); /* sete al or setne al */
+        LJIT_EMIT(c, 0x0f, eq ? 0x9b : 0x9a, 0xc1); /* setnp cl or setp cl */
+        if ( eq ) {
+            LJIT_EMIT(c, 0x20, 0xc8); /* and al, cl */
+        } else {
+            LJIT_EMIT(c, 0x08, 0xc8); /* or al, cl */
+        }
+    } else {
+        /* '<' and '>=' compare the right operand to the left one */
+        int swap = op[0] == '<' ? op[1] == '\0' : op[1] == '=';
+        int strict = op[1] == '\0';
+        if ( swap ) {
+            LJIT_EMIT(c, 0x66, 0x0f, 0x2e, 0xc8); /* ucomisd xmm1, xmm0 */
+        } else {
+            LJIT_EMIT(c, 0x66, 0x0f, 0x2e, 0xc1); /* ucomisd xmm0, xmm1 */
+        }
+        /* seta: ordered and greater; setbe: its negation */
+        LJIT_EMIT(c, 0x0f, strict ? 0x97 : 0x96, 0xc0);
+    }
+    LJIT_EMIT(c, 0x0f, 0xb6, 0xc0); /* movzx eax, al */
+}
+
+static enum ljit_kind ljit_compile_compare(struct ljit_compiler *c, const char *op, struct lvalue **args, size_t argc) {
+    if ( argc != 2 ) {
+        return LJIT_NONE;
+    }
+
+    enum ljit_kind lhs = ljit_compile_expr(c, args[0]);
+    if ( lhs == LJIT_NONE ) {
+        return LJIT_NONE;
+    }
+    ljit_push(c);
+    enum ljit_kind rhs = ljit_compile_expr(c, args[1]);
+    if ( rhs != lhs ) {
+        return LJIT_NONE;
+    }
+    ljit_pop_operands(c);
+
+    if ( lhs == LJIT_FLOAT ) {
+        ljit_emit_float_compare(c, op);
+        return LJIT_BOOL;
+    }
+
+    unsigned char setcc;
+    if ( strcmp(op, "==") == 0 ) {
+        setcc = 0x94;
+    } else if ( strcmp(op, "!=") == 0 ) {
+        setcc = 0x95;
+    } else if ( lhs != LJIT_INT ) {
+        return LJIT_NONE;
+    } else if ( strcmp(op, "<") == 0 ) {
+        setcc = 0x9c;
+    } else if ( strcmp(op, ">") == 0 ) {
+        setcc = 0x9f;
+    } else if ( strcmp(op, "<=") == 0 ) {
+        setcc = 0x9e;
+    } else {
+        setcc = 0x9d;
+    }
+
+    LJIT_EMIT(c, 0x48, 0x39, 0xc8); /* cmp rax, rcx */
+    LJIT_EMIT(c, 0x0f, setcc, 0xc0); /* setcc al */
+    LJIT_EMIT(c, 0x0f, 0xb6, 0xc0); /* movzx eax, al */
+    return LJIT_BOOL;
+}
+
+static enum ljit_kind ljit_compile_if(struct ljit_compiler *c, struct lvalue **args, size_t argc) {
+    if ( argc != 3 || args[1]->type != LVAL_QEXPR || args[2]->type != LVAL_QEXPR ) {
+        return LJIT_NONE;
+    }
+    if ( ljit_compile_expr(c, args[0]) != LJIT_BOOL ) {
+        return LJIT_NONE;
+    }
+
+    LJIT_EMIT(c, 0x48, 0x85, 0xc0); /* test rax, rax */
+    size_t to_else = ljit_emit_jump(c, op_jz, 2);
+    enum ljit_kind then = ljit_compile_cells(c, args[1]->val.l.cells, args[1]->val.l.count);
+    size_t to_end = ljit_emit_jump(c, op_jmp, 1);
+    ljit_patch(c, to_else, c->len);
+    enum ljit_kind otherwise = ljit_compile_cells(c, args[2]->val.l.cells, args[2]->val.l.count);
+    ljit_patch(c, to_end, c->len);
+
+    return then == otherwise ? then : LJIT_NONE;
+}
+
+static enum ljit_kind ljit_compile_logic(struct ljit_compiler *c, int is_and, struct lvalue **args, size_t argc) {
+    if ( argc != 2 || ljit_compile_expr(c, args[0]) != LJIT_BOOL ) {
+        return LJIT_NONE;
+    }
+    /* the first operand decides when it is false for '&&' or true for '||' */
+    LJIT_EMIT(c, 0x48, 0x85, 0xc0); /* test rax, rax */
+    size_t to_end = ljit_emit_jump(c, is_and ? op_jz : op_jnz, 2);
+    if ( ljit_compile_expr(c, args[1]) != LJIT_BOOL ) {
+        return LJIT_NONE;
+    }
+    ljit_patch(c, to_end, c->len);
+    return LJIT_BOOL;
+}
+
+static enum ljit_kind ljit_compile_self_call(struct ljit_compiler *c, struct lvalue **args, size_t argc) {
+    if ( argc != c->func->arity ) {
+        return LJIT_NONE;
+    }
+
+    /* arguments are pushed last to first, so the first ends up at rsp */
+    for ( size_t i = argc; i-- > 0; ) {
+        if ( ljit_compile_expr(c, args[i]) != c->params[i] ) {
+            return LJIT_NONE;
+        }
+        ljit_push(c);
+    }
+
+    LJIT_EMIT(c, 0x48, 0x89, 0xe7); /* mov rdi, rsp */
+    LJIT_EMIT(c, 0x4c, 0x89, 0xe6); /* mov rsi, r12 */
+
+    /* the frame is 16 byte aligned with an even number of pushed values */
+    int pad = c->depth % 2;
+    if ( pad ) {
+        LJIT_EMIT(c, 0x48, 0x83, 0xec, 0x08); /* sub rsp, 8 */
+    }
+    LJIT_EMIT(c, 0xe8); /* call rel32 to the entry */
+    ljit_emit_imm32(c, (int32_t) -(long long) (c->len + 4));
+    if ( pad ) {
+        LJIT_EMIT(c, 0x48, 0x83, 0xc4, 0x08); /* add rsp, 8 */
+    }
+    if ( argc > 0 ) {
+        LJIT_EMIT(c, 0x48, 0x81, 0xc4); /* add rsp, imm32 */
+        ljit_emit_imm32(c, (int32_t) (argc * 8));
+        c->depth -= argc;
+    }
+
+    LJIT_EMIT(c, 0x41, 0x80, 0x3c, 0x24, 0x00); /* cmp byte [r12], 0 */
+    ljit_emit_deopt_if(c, op_jnz);
+    return c->self_kind;
+}
+
+static enum ljit_kind ljit_compile_form(struct ljit_compiler *c, struct lvalue **cells, size_t count) {
+    struct lvalue *op = cells[0];
+    struct lvalue **args = cells + 1;
+    size_t argc = count - 1;
+
+    if ( op->type != LVAL_SYM || ljit_param(c, op->val.strval) >= 0 ) {
+        return LJIT_NONE;
+    }
+
+    struct lsymbol *sym = lsymbol_of(op->val.strval);
+    if ( sym->global == NULL ) {
+        return LJIT_NONE;
+    }
+    struct lvalue *bound = sym->global->envval;
+
+    if ( bound->type == LVAL_FUNCTION && bound->val.fun == c->func ) {
+        if ( !ljit_guard(c, sym, LVAL_FUNCTION, bound->val.fun) ) {
+            return LJIT_NONE;
+        }
+        return ljit_compile_self_call(c, args, argc);
+    }
+
+    if ( bound->type != LVAL_BUILTIN || !ljit_guard(c, sym, LVAL_BUILTIN, bound->val.builtin) ) {
+        return LJIT_NONE;
+    }
+
+    const struct lbuiltin *b = bound->val.builtin;
+    const char *name = b->name;
+
+    if ( strcmp(name, "if") == 0 || strcmp(name, "&&") == 0 || strcmp(name, "||") == 0 ) {
+        /* only where the evaluator takes these as special forms */
+        if ( sym->special == NULL || sym->special->builtin != b->call ) {
+            return LJIT_NONE;
+        }
+        if ( strcmp(name, "if") == 0 ) {
+            return ljit_compile_if(c, args, argc);
+        }
+        return ljit_compile_logic(c, strcmp(name, "&&") == 0, args, argc);
+    }
+
+    if ( strcmp(name, "+") == 0 || strcmp(name, "-") == 0 || strcmp(name, "*") == 0 ||
+        strcmp(name, "/") == 0 || strcmp(name, "%") == 0 ) {
+        return ljit_compile_arith(c, name[0], args, argc);
+    }
+
+    if ( strcmp(name, "==") == 0 || strcmp(name, "!=") == 0 || strcmp(name, "<") == 0 ||
+        strcmp(name, ">") == 0 || strcmp(name, "<=") == 0 || strcmp(name, ">=") == 0 ) {
+        return ljit_compile_compare(c, name, args, argc);
+    }
+
+    if ( strcmp(name, "!") == 0 ) {
+        if ( argc != 1 || ljit_compile_expr(c, args[0]) != LJIT_BOOL ) {
+            return LJIT_NONE;
+        }
+        LJIT_EMIT(c, 0x83, 0xf0, 0x01); /* xor eax, 1 */
+        return LJIT_BOOL;
+    }
+
+    return LJIT_NONE;
+}
+
+/* copy the finished code into an executable mapping */
+static struct ljit *ljit_install(struct ljit_compiler *c, enum ljit_kind result) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t mapped = (c->len + page - 1) / page * page;
+
+    void *mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( mem == MAP_FAILED ) {
+        return NULL;
+    }
+    memcpy(mem, c->buf, c->len);
+    if ( mprotect(mem, mapped, PROT_READ | PROT_EXEC) != 0 ) {
+        munmap(mem, mapped);
+        return NULL;
+    }
+
+    struct ljit *jit = malloc(sizeof(struct ljit));
+    if ( jit == NULL ) {
+        munmap(mem, mapped);
+        return NULL;
+    }
+    jit->fn.code = mem;
+    jit->mapped = mapped;
+    jit->length = c->len;
+    jit->result = result;
+    memcpy(jit->params, c->params, c->func->arity * sizeof(enum ljit_kind));
+    jit->guard_count = c->guard_count;
+    memcpy(jit->guards, c->guards, c->guard_count * sizeof(struct ljit_guard));
+    return jit;
+}
+
+static struct ljit *ljit_compile_as(struct lfunction *func, const enum ljit_kind *params, enum ljit_kind self_kind) {
+    struct ljit_compiler c;
+    memset(&c, 0, sizeof(c));
+    c.func = func;
+    c.self_kind = self_kind;
+    c.params = params;
+
+    LJIT_EMIT(&c, 0x55); /* push rbp */
+    LJIT_EMIT(&c, 0x48, 0x89, 0xe5); /* mov rbp, rsp */
+    LJIT_EMIT(&c, 0x53); /* push rbx */
+    LJIT_EMIT(&c, 0x41, 0x54); /* push r12 */
+    LJIT_EMIT(&c, 0x48, 0x89, 0xfb); /* mov rbx, rdi */
+    LJIT_EMIT(&c, 0x49, 0x89, 0xf4); /* mov r12, rsi */
+
+    enum ljit_kind result = ljit_compile_cells(&c, func->body->val.l.cells, func->body->val.l.count);
+
+    size_t epilogue = c.len;
+    LJIT_EMIT(&c, 0x48, 0x8d, 0x65, 0xf0); /* lea rsp, [rbp - 16] */
+    LJIT_EMIT(&c, 0x41, 0x5c); /* pop r12 */
+    LJIT_EMIT(&c, 0x5b); /* pop rbx */
+    LJIT_EMIT(&c, 0x5d); /* pop rbp */
+    LJIT_EMIT(&c, 0xc3); /* ret */
+
+    size_t deopt = c.len;
+    LJIT_EMIT(&c, 0x41, 0xc6, 0x04, 0x24, 0x01); /* mov byte [r12], 1 */
+    ljit_patch(&c, ljit_emit_jump(&c, op_jmp, 1), epilogue);
+    for ( size_t i = 0; i < c.deopt_count; ++i ) {
+        ljit_patch(&c, c.deopts[i], deopt);
+    }
+
+    struct ljit *jit = NULL;
+    if ( !c.oom && result == self_kind && c.depth == 0 ) {
+        jit = ljit_install(&c, result);
+    }
+    free(c.buf);
+    free(c.deopts);
+    return jit;
+}
+
+/* the kind 'arg' is passed to compiled code as, if any */
+static enum ljit_kind ljit_arg_kind(struct lvalue *arg) {
+    switch ( arg->type ) {
+        case LVAL_INT:
+            return LJIT_INT;
+        case LVAL_FLOAT:
+            return LJIT_FLOAT;
+        default:
+            return LJIT_NONE;
+    }
+}
+
+/* compile 'func' for arguments of the types of those of the hot call */
+static struct ljit *ljit_compile(struct lfunction *func, struct lvalue **bound, size_t bound_count, struct lvalue **args) {
+    if ( func->variadic || func->arity > LJIT_MAX_ARGS ) {
+        return NULL;
+    }
+    enum ljit_kind params[LJIT_MAX_ARGS];
+    for ( size_t i = 0; i < func->arity; ++i ) {
+        params[i] = ljit_arg_kind(i < bound_count ? bound[i] : args[i - bound_count]);
+        if ( params[i] == LJIT_NONE ) {
+            return NULL;
+        }
+    }
+
+    /* the result of a recursive call is assumed before the body is known */
+    static const enum ljit_kind results[] = { LJIT_INT, LJIT_FLOAT, LJIT_BOOL };
+    struct ljit *jit = NULL;
+    for ( size_t i = 0; jit == NULL && i < sizeof(results) / sizeof(results[0]); ++i ) {
+        jit = ljit_compile_as(func, params, results[i]);
+    }
+    return jit;
+}
+
+/* perf's map of the JIT of 'pid' */
+static FILE *ljit_perf_map_file(long pid, const char *mode) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", pid);
+    return fopen(path, mode);
+}
+
+/*
+ * Starts writing the symbols of the machine code compiled from now on
+ * to /tmp/perf-<pid>.map, where perf looks them up. Returns 0 if the
+ * map could not be created.
+ */
+int ljit_perf_map_open(struct lisper_ctx *ctx) {
+    if ( ctx->perf_map.fp != NULL ) {
+        return 1;
+    }
+    ctx->perf_map.pid = (long) getpid();
+    ctx->perf_map.fp = ljit_perf_map_file(ctx->perf_map.pid, "w");
+    return ctx->perf_map.fp != NULL;
+}
+
+void ljit_perf_map_close(struct lisper_ctx *ctx) {
+    if ( ctx->perf_map.fp != NULL ) {
+        fclose(ctx->perf_map.fp);
+        ctx->perf_map.fp = NULL;
+    }
+}
+
+/*
+ * Describes the code of 'func' in the map. A forked child, such as a
+ * server worker, keeps the code of its parent at the same addresses, so
+ * its own map starts as a copy of the parent's.
+ */
+static void ljit_perf_map_add(struct lisper_ctx *ctx, struct lfunction *func) {
+    struct ljit_perf_map *map = &ctx->perf_map;
+    if ( map->fp == NULL ) {
+        return;
+    }
+
+    long pid = (long) getpid();
+    if ( map->pid != pid ) {
+        fclose(map->fp);
+        map->fp = ljit_perf_map_file(pid, "w");
+        if ( map->fp == NULL ) {
+            return;
+        }
+        FILE *parent = ljit_perf_map_file(map->pid, "r");
+        if ( parent != NULL ) {
+            char buf[4096];
+            size_t n;
+            while ( (n = fread(buf, 1, sizeof(buf), parent)) > 0 ) {
+                fwrite(buf, 1, n, map->fp);
+            }
+            fclose(parent);
+        }
+        map->pid = pid;
+    }
+
+    /* lambdas are told apart by the address of their code */
+    if ( func->name != NULL ) {
+        fprintf(map->fp, "%lx %zx lisper:%s\n", (unsigned long) (uintptr_t) func->jit->fn.code, func->jit->length, func->name);
+    } else {
+        fprintf(map->fp, "%lx %zx lisper:lambda\n", (unsigned long) (uintptr_t) func->jit->fn.code, func->jit->length);
+    }
+    fflush(map->fp);
+}
+
+static int ljit_guards_hold(struct ljit *jit) {
+    for ( size_t i = 0; i < jit->guard_count; ++i ) {
+        struct ljit_guard *g = &jit->guards[i];
+        if ( g->sym->shadows != 0 || g->sym->global == NULL ) {
+            return 0;
+        }
+        struct lvalue *v = g->sym->global->envval;
+        if ( v->type != g->type ) {
+            return 0;
+        }
+        const void *actual = v->type == LVAL_BUILTIN ? (const void *) v->val.builtin : (const void *) v->val.fun;
+        if ( actual != g->expected ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Run a call of 'func' with the arguments 'bound' followed by 'args' as
+ * machine code, compiling the function once it is hot. Returns 1 with the
+ * result in 'res' if it did, and 0 if the interpreter has to run the call.
+ */
+int ljit_call(struct lisper_ctx *ctx, struct lfunction *func, struct lvalue **bound, size_t bound_count, struct lvalue **args, struct lvalue **res) {
+    if ( func->jit == NULL ) {
+        if ( ++func->calls != jit_threshold ) {
+            return 0;
+        }
+        func->jit = ljit_compile(func, bound, bound_count, args);
+        if ( func->jit == NULL ) {
+            ctx->jit.rejected++;
+            return 0;
+        }
+        ctx->jit.compiled++;
+        ctx->jit.code_bytes += func->jit->length;
+        ljit_perf_map_add(ctx, func);
+        LPROBE3(jit_compile, func->name, func->jit->fn.code, func->jit->length);
+    }
+
+    struct ljit *jit = func->jit;
+    long long argv[LJIT_MAX_ARGS];
+    for ( size_t i = 0; i < func->arity; ++i ) {
+        struct lvalue *arg = i < bound_count ? bound[i] : args[i - bound_count];
+        if ( ljit_arg_kind(arg) != jit->params[i] ) {
+            ctx->jit.guard_misses++;
+            return 0;
+        }
+        if ( arg->type == LVAL_FLOAT ) {
+            memcpy(&argv[i], &arg->val.floatval, sizeof(argv[i]));
+        } else {
+            argv[i] = arg->val.intval;
+        }
+    }
+
+    if ( !ljit_guards_hold(jit) ) {
+        ctx->jit.guard_misses++;
+        return 0;
+    }
+
+    char deopt = 0;
+    long long r = jit->fn.entry(argv, &deopt);
+    if ( deopt ) {
+        ctx->jit.deopts++;
+        return 0;
+    }
+
+    ctx->jit.native_calls++;
+    if ( jit->result == LJIT_FLOAT ) {
+        double d;
+        memcpy(&d, &r, sizeof(d));
+        *res = lvalue_float(d);
+    } else {
+        *res = jit->result == LJIT_INT ? lvalue_int(r) : lvalue_bool(r);
+    }
+    return 1;
+}
+
+void ljit_free(struct ljit *jit) {
+    if ( jit == NULL ) {
+        return;
+    }
+    munmap(jit->fn.code, jit->mapped);
+    free(jit);
+}
+
+void ljit_stats_print(struct lisper_ctx *ctx, FILE *out) {
+    struct ljit_stats *s = &ctx->jit;
+    fprintf(out, "jit: %zu function(s) compiled, %zu rejected, %zu byte(s) of machine code\n",
+        s->compiled, s->rejected, s->code_bytes);
+    fprintf(out, "jit: %zu native call(s), %zu guard miss(es), %zu deopt(s)\n",
+        s->native_calls, s->guard_misses, s->deopts);
+}
+
+#else
+
+/* built without the JIT; every call is interpreted */
+
+int ljit_call(struct lisper_ctx *ctx, struct lfunction *func, struct lvalue **bound, size_t bound_count, struct lvalue **args, struct lvalue **res) {
+    (void) ctx;
+    (void) func;
+    (void) bound;
+    (void) bound_count;
+    (void) args;
+    (void) res;
+    return 0;
+}
+
+void ljit_free(struct ljit *jit) {
+    (void) jit;
+}
+
+void ljit_stats_print(struct lisper_ctx *ctx, FILE *out) {
+    (void) ctx;
+    fprintf(out, "jit: not available in this build\n");
+}
+
+/* no machine code is generated, so there is nothing to map */
+
+int ljit_perf_map_open(struct lisper_ctx *ctx) {
+    (void) ctx;
+    return 1;
+}
+
+void ljit_perf_map_close(struct lisper_ctx *ctx) {
+    (void) ctx;
+}
+
+#endif
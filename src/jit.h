@@ -0,0 +1,34 @@
+#ifndef LISPER_JIT
+#define LISPER_JIT
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct lisper_ctx;
+struct lfunction;
+struct lvalue;
+struct ljit;
+
+/* counters of the JIT of an interpreter; reported by --jit-stats */
+struct ljit_stats {
+    size_t compiled; /* functions compiled to machine code */
+    size_t rejected; /* hot functions outside of the compilable subset */
+    size_t code_bytes; /* machine code emitted */
+    size_t native_calls; /* calls run as machine code */
+    size_t guard_misses; /* calls left to the interpreter by a failed guard or argument type */
+    size_t deopts; /* native calls abandoned and rerun by the interpreter */
+};
+
+/* symbols of the machine code of an interpreter for perf; off unless opened */
+struct ljit_perf_map {
+    FILE *fp; /* /tmp/perf-<pid>.map or NULL */
+    long pid; /* process the map describes; a forked child starts its own */
+};
+
+int ljit_call(struct lisper_ctx *, struct lfunction *, struct lvalue **, size_t, struct lvalue **, struct lvalue **);
+void ljit_free(struct ljit *);
+void ljit_stats_print(struct lisper_ctx *, FILE *);
+int ljit_perf_map_open(struct lisper_ctx *);
+void ljit_perf_map_close(struct lisper_ctx *);
+
+#endif
@@ -1,21 +1,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
+#include <string.h>
 #include "lisper.h"
-#include "grammar.h"
-#include "environment.h"
-#include "value.h"
-#include "builtin.h"
+#include "context.h"
+#include "jit.h"
 #include "execute.h"
-#include "mempool.h"
+#include "server.h"
+#include "emitc.h"
 #include "prgparams.h"
 
-struct grammar_elems elems; /* grammar elems can be reused */
-struct lenvironment *env = NULL; /* Global environment */
-const size_t hash_size = 500;
-struct mempool *lvalue_mp = NULL;
-const size_t lvalue_mempool_size = 10000;
-struct argument_capture *args;
+struct lisper_ctx *ctx = NULL; /* interpreter of the lisper program */
+int report_jit_stats = 0; /* --jit-stats */
 
 
 void signal_handler(int signum) {
@@ -23,37 +19,35 @@ void signal_handler(int signum) {
     if ( signum == SIGINT ) {
         exit(0);
     } else {
-        grammar_elems_destroy(&elems);
-        lenvironment_del(env);
+        lisper_destroy(ctx);
+        ctx = NULL;
+    }
+}
+
+/*
+ * SIGINT of a REPL session stops the evaluation in progress instead.
+ * When an evaluation has not got to see the previous one yet, as in
+ * compiled code, the session is ended after all.
+ */
+void interrupt_handler(int signum) {
+    if ( ctx == NULL || lisper_interrupt(ctx) ) {
+        signal_handler(signum);
     }
 }
 
 void exit_handler(void) {
-    grammar_elems_destroy(&elems);
-    lenvironment_del(env);
-    mempool_del(lvalue_mp);
+    if ( report_jit_stats && ctx != NULL ) {
+        fflush(stdout);
+        ljit_stats_print(ctx, stderr);
+    }
+    lisper_destroy(ctx);
+    ctx = NULL;
 }
 
 int main(int argc, char **argv) {
 
-    struct argument_capture capture;
     struct lisper_params params;
 
-    capture.argc = argc;
-    capture.argv = argv;
-
-    args = &capture;
-
-    lvalue_mp = mempool_init(sizeof(struct lvalue), lvalue_mempool_size);
-    env = lenvironment_new(hash_size);
-    register_builtins(env);
-
-    grammar_elems_init(&elems);
-    grammar_make_lang(&elems);
-
-    signal(SIGINT, signal_handler);
-    atexit(exit_handler);
-
     if ( parse_prg_params(argc, argv, &params) != 0 ) {
         fprintf(stderr, "Error: Couldn't parse lisper program arguments\n");
         exit_with_help(1);
@@ -64,15 +58,44 @@ int main(int argc, char **argv) {
         exit_with_help(1);
     }
 
+    if ( params.connect != NULL ) {
+        /* the server does the work; no interpreter needed in this process */
+        return exec_connect(&params, argc, argv);
+    }
+
+    ctx = lisper_create(argc, argv);
+    if ( ctx == NULL ) {
+        fprintf(stderr, "Error: Couldn't create lisper interpreter\n");
+        return 1;
+    }
+
+    report_jit_stats = params.jit_stats;
+    if ( params.perf_map && !ljit_perf_map_open(ctx) ) {
+        perror("Error: Couldn't create the perf map");
+    }
+    ctx->limits = params.limits;
+    signal(SIGINT, signal_handler);
+    atexit(exit_handler);
+
     int rc = 0;
-    if ( params.filename != NULL ) {
-       rc = exec_filein(env, &params);
+    if ( params.emit_c ) {
+       rc = exec_emit_c(ctx, &params);
+    } else if ( params.serve != NULL ) {
+       rc = exec_serve(ctx, &params);
+    } else if ( params.each_line_script != NULL ) {
+       rc = exec_each_line(ctx, &params);
+    } else if ( params.filename != NULL && strcmp(params.filename, "-") == 0 ) {
+       rc = exec_stream(ctx, stdin);
+    } else if ( params.filename != NULL ) {
+       rc = exec_filein(ctx, &params);
     } else if ( params.command != NULL ) {
-       rc = exec_eval(env, &elems, &params);
+       rc = exec_eval(ctx, &params);
+    } else if ( !exec_interactive() ) {
+       rc = exec_stream(ctx, stdin);
     } else {
-       rc = exec_repl(env, &elems);
+       signal(SIGINT, interrupt_handler);
+       rc = exec_repl(ctx);
     }
 
     return rc;
 }
-
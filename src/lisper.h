@@ -1,6 +1,8 @@
 #ifndef LISPER_H
 #define LISPER_H
 
+#include <stddef.h>
+
 #define LISPER_VERSION "0.2.1"
 
 struct argument_capture {
@@ -8,4 +10,30 @@ struct argument_capture {
     char **argv;
 };
 
+struct lisper_ctx;
+struct lvalue;
+
+/*
+ * Embedding API.
+ *
+ * Every context is an independent interpreter with its own allocator,
+ * global environment and parser. A context must only be used by one
+ * thread at a time, and lvalues belong to the context that created them.
+ * lvalue constructors (see value.h) allocate from the context that was
+ * last created or passed to lisper_use on the calling thread.
+ *
+ * Each load, eval and call is an evaluation of its own. lisper_interrupt
+ * makes the one in progress stop with an error; it only sets a flag, so
+ * it may be called from a signal handler or another thread.
+ */
+struct lisper_ctx *lisper_create(int argc, char **argv);
+void lisper_destroy(struct lisper_ctx *);
+struct lisper_ctx *lisper_use(struct lisper_ctx *);
+
+struct lvalue *lisper_load(struct lisper_ctx *, const char *path);
+struct lvalue *lisper_eval(struct lisper_ctx *, const char *source);
+struct lvalue *lisper_call(struct lisper_ctx *, const char *name, size_t argc, struct lvalue **argv);
+void lisper_value_del(struct lisper_ctx *, struct lvalue *);
+int lisper_interrupt(struct lisper_ctx *);
+
 #endif
@@ -0,0 +1,183 @@
+
+#include <stdlib.h>
+#include "memo.h"
+#include "value.h"
+
+/*
+ * Constructor for a memo cache of 'func' holding at most 'capacity'
+ * results. Takes ownership of 'func'.
+ */
+struct lmemo *lmemo_new(struct lvalue *func, size_t capacity) {
+    struct lmemo *memo = malloc(sizeof(struct lmemo));
+    if ( memo == NULL ) {
+        return NULL;
+    }
+
+    memo->buckets = calloc(LMEMO_INITIAL_BUCKETS, sizeof(struct lmemo_entry *));
+    if ( memo->buckets == NULL ) {
+        free(memo);
+        return NULL;
+    }
+
+    memo->refcount = 1;
+    memo->func = func;
+    memo->bucket_count = LMEMO_INITIAL_BUCKETS;
+    memo->capacity = capacity;
+    memo->size = 0;
+    memo->newest = NULL;
+    memo->oldest = NULL;
+    memo->hits = 0;
+    memo->misses = 0;
+    return memo;
+}
+
+struct lmemo *lmemo_share(struct lmemo *memo) {
+    memo->refcount++;
+    return memo;
+}
+
+static void lmemo_entry_del(struct lmemo_entry *entry) {
+    lvalue_del(entry->key);
+    lvalue_del(entry->result);
+    free(entry);
+}
+
+void lmemo_del(struct lmemo *memo) {
+    if ( --memo->refcount > 0 ) {
+        return;
+    }
+
+    struct lmemo_entry *iter = memo->newest;
+    while ( iter != NULL ) {
+        struct lmemo_entry *older = iter->older;
+        lmemo_entry_del(iter);
+        iter = older;
+    }
+
+    lvalue_del(memo->func);
+    free(memo->buckets);
+    free(memo);
+}
+
+static void lmemo_unlink(struct lmemo *memo, struct lmemo_entry *entry) {
+    if ( entry->newer != NULL ) {
+        entry->newer->older = entry->older;
+    } else {
+        memo->newest = entry->older;
+    }
+    if ( entry->older != NULL ) {
+        entry->older->newer = entry->newer;
+    } else {
+        memo->oldest = entry->newer;
+    }
+}
+
+static void lmemo_push(struct lmemo *memo, struct lmemo_entry *entry) {
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    if ( memo->newest != NULL ) {
+        memo->newest->newer = entry;
+    }
+    memo->newest = entry;
+    if ( memo->oldest == NULL ) {
+        memo->oldest = entry;
+    }
+}
+
+static void lmemo_evict(struct lmemo *memo) {
+    struct lmemo_entry *victim = memo->oldest;
+    struct lmemo_entry **link = &memo->buckets[victim->hash & (memo->bucket_count - 1)];
+
+    while ( *link != victim ) {
+        link = &(*link)->chain;
+    }
+    *link = victim->chain;
+
+    lmemo_unlink(memo, victim);
+    lmemo_entry_del(victim);
+    memo->size--;
+}
+
+/*
+ * Doubles the buckets once there are more results than buckets. The
+ * table stays as it is if the memory is not there; chains only get longer.
+ */
+static void lmemo_grow(struct lmemo *memo) {
+    if ( memo->size <= memo->bucket_count ) {
+        return;
+    }
+    size_t count = memo->bucket_count * 2;
+    struct lmemo_entry **buckets = calloc(count, sizeof(struct lmemo_entry *));
+    if ( buckets == NULL ) {
+        return;
+    }
+    for ( struct lmemo_entry *entry = memo->newest; entry != NULL; entry = entry->older ) {
+        struct lmemo_entry **bucket = &buckets[entry->hash & (count - 1)];
+        entry->chain = *bucket;
+        *bucket = entry;
+    }
+    free(memo->buckets);
+    memo->buckets = buckets;
+    memo->bucket_count = count;
+}
+
+/*
+ * Call the memoized function with the argument s-expression 'args',
+ * answering from the cache when the same arguments have been seen.
+ * Errors are not cached.
+ */
+struct lvalue *lmemo_call(struct lenvironment *e, struct lmemo *memo, struct lvalue *args) {
+    size_t hash = lvalue_hash(args);
+    struct lmemo_entry *entry = memo->buckets[hash & (memo->bucket_count - 1)];
+
+    for ( ; entry != NULL; entry = entry->chain ) {
+        if ( entry->hash == hash && lvalue_eq(entry->key, args) ) {
+            memo->hits++;
+            if ( memo->newest != entry ) {
+                lmemo_unlink(memo, entry);
+                lmemo_push(memo, entry);
+            }
+            lvalue_del(args);
+            return lvalue_copy(entry->result);
+        }
+    }
+
+    memo->misses++;
+
+    /* keep the memo alive; the call may redefine the name it is bound to */
+    lmemo_share(memo);
+
+    struct lvalue *key = lvalue_copy(args);
+    struct lvalue *res = lvalue_call(e, memo->func, args);
+
+    if ( res->type == LVAL_ERR || memo->capacity == 0 ) {
+        lvalue_del(key);
+        lmemo_del(memo);
+        return res;
+    }
+
+    if ( memo->size == memo->capacity ) {
+        lmemo_evict(memo);
+    }
+
+    entry = malloc(sizeof(struct lmemo_entry));
+    if ( entry == NULL ) {
+        /* the result is still returned, just not kept */
+        lvalue_del(key);
+        lmemo_del(memo);
+        return res;
+    }
+    entry->hash = hash;
+    entry->key = key;
+    entry->result = lvalue_copy(res);
+
+    struct lmemo_entry **bucket = &memo->buckets[hash & (memo->bucket_count - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    lmemo_push(memo, entry);
+    memo->size++;
+    lmemo_grow(memo);
+
+    lmemo_del(memo);
+    return res;
+}
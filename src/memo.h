@@ -0,0 +1,46 @@
+#ifndef LISPER_MEMO
+#define LISPER_MEMO
+
+#include <stdlib.h>
+
+struct lvalue;
+struct lenvironment;
+
+/* largest number of results a memo may be asked to keep */
+#define LMEMO_MAX_CAPACITY ((size_t) 1 << 24)
+
+/* buckets of a new memo; the table doubles as results arrive */
+#define LMEMO_INITIAL_BUCKETS 16
+
+struct lmemo_entry {
+    size_t hash;
+    struct lvalue *key; /* argument list the result was computed for */
+    struct lvalue *result;
+    struct lmemo_entry *chain; /* next entry in the same bucket */
+    struct lmemo_entry *newer; /* least recently used order */
+    struct lmemo_entry *older;
+};
+
+/*
+ * Bounded least recently used cache of the results of a function.
+ * Shared between all copies of a memoized function value.
+ */
+struct lmemo {
+    size_t refcount;
+    struct lvalue *func; /* the memoized function */
+    struct lmemo_entry **buckets;
+    size_t bucket_count;
+    size_t capacity; /* maximum number of cached results */
+    size_t size;
+    struct lmemo_entry *newest;
+    struct lmemo_entry *oldest;
+    size_t hits;
+    size_t misses;
+};
+
+struct lmemo *lmemo_new(struct lvalue *func, size_t capacity);
+struct lmemo *lmemo_share(struct lmemo *);
+void lmemo_del(struct lmemo *);
+struct lvalue *lmemo_call(struct lenvironment *, struct lmemo *, struct lvalue *);
+
+#endif
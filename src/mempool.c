@@ -1,6 +1,83 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise */
+#endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "mempool.h"
+#include "probe.h"
+
+/*
+ * Tag in the header of a taken block, which holds its pool. The header of
+ * a free block holds the next free block, which is pointer aligned, so a
+ * block freed twice is told apart.
+ */
+#define MEMPOOL_TAKEN ((uintptr_t) 1)
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define MEMPOOL_MMAP
+#endif
+
+/*
+ * Maps at least 'size' bytes for the blocks of a pool, so the pages can
+ * be handed back to the system on their own. Big pools are aligned to
+ * and backed by huge pages, to spare the TLB on large heaps.
+ */
+static unsigned char *mempool_map(size_t size, size_t *mapped) {
+#ifdef MEMPOOL_MMAP
+    if ( size >= MEMPOOL_HUGE_SIZE ) {
+        size = (size + MEMPOOL_HUGE_SIZE - 1) & ~(size_t) (MEMPOOL_HUGE_SIZE - 1);
+        size_t span = size + MEMPOOL_HUGE_SIZE;
+        unsigned char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if ( raw == MAP_FAILED ) {
+            return NULL;
+        }
+        uintptr_t aligned = ((uintptr_t) raw + MEMPOOL_HUGE_SIZE - 1) & ~(uintptr_t) (MEMPOOL_HUGE_SIZE - 1);
+        size_t head = (size_t) (aligned - (uintptr_t) raw);
+        if ( head > 0 ) {
+            munmap(raw, head);
+        }
+        if ( span - head - size > 0 ) {
+            munmap((unsigned char *) aligned + size, span - head - size);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise((void *) aligned, size, MADV_HUGEPAGE);
+#endif
+        *mapped = size;
+        return (unsigned char *) aligned;
+    }
+    unsigned char *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( mem == MAP_FAILED ) {
+        return NULL;
+    }
+    *mapped = size;
+    return mem;
+#else
+    *mapped = size;
+    return malloc(size);
+#endif
+}
+
+static void mempool_unmap(unsigned char *mem, size_t mapped) {
+#ifdef MEMPOOL_MMAP
+    munmap(mem, mapped);
+#else
+    (void) mapped;
+    free(mem);
+#endif
+}
+
+/* gives the pages of a pool back to the system while keeping the mapping */
+static int mempool_discard(unsigned char *mem, size_t mapped) {
+#ifdef MEMPOOL_MMAP
+    return madvise(mem, mapped, MADV_DONTNEED) == 0;
+#else
+    (void) mem;
+    (void) mapped;
+    return 0;
+#endif
+}
 
 /*
  * Constructor for the mempool.
@@ -8,6 +85,8 @@
  * that the mempool represents a pool of; and the 'cap' parameter is
  * the maximum number of such items that the pool is enable to supply
  * any consumers with.
+ * Blocks are handed out from the start of the pool the first time, so
+ * pages are only touched once they are used.
  */
 struct mempool *mempool_init(size_t itemsize, size_t poolsize) {
     struct mempool *mp = malloc(sizeof(struct mempool));
@@ -15,24 +94,21 @@ struct mempool *mempool_init(size_t itemsize, size_t poolsize) {
         return NULL;
     }
     size_t pointersize = sizeof(unsigned char *);
-    size_t blocksize = (((itemsize / pointersize) + 1) * pointersize) + pointersize;
-    mp->capacity = poolsize * blocksize;
+    mp->blocksize = (((itemsize / pointersize) + 1) * pointersize) + pointersize;
     mp->itemsize = itemsize;
-    mp->memspace = malloc(mp->capacity);
+    mp->memspace = mempool_map(poolsize * mp->blocksize, &mp->mapped);
     if ( mp->memspace == NULL ) {
+        free(mp);
         return NULL;
     }
+    mp->capacity = mp->mapped - mp->mapped % mp->blocksize;
     mp->next = NULL;
-    mp->free = (unsigned char **) (mp->memspace);
+    mp->chain = mp;
+    mp->avail = NULL;
+    mp->free = NULL;
+    mp->fresh = 0;
     mp->takencount = 0;
-
-    unsigned char **iter = mp->free;
-    for ( size_t i = 1; i < poolsize; ++i ) {
-        void *next = (mp->memspace + i * blocksize);
-        *iter = next; // make current free pointer point to start of next block
-        iter = (unsigned char **) next; // advance to next free pointer
-    }
-    *iter = NULL;
+    mp->takes = 0;
 
     return mp;
 }
@@ -46,39 +122,66 @@ void mempool_del(struct mempool *mp) {
     struct mempool *iter = mp;
     while ( iter != NULL ) {
         struct mempool *next = iter->next;
-        free(iter->memspace);
+        mempool_unmap(iter->memspace, iter->mapped);
         free(iter);
         iter = next;
     }
 }
 
+static int mempool_has_free(struct mempool *mp) {
+    return mp->free != NULL || (mp->fresh + 1) * mp->blocksize <= mp->capacity;
+}
+
+/* a block of the single pool 'mp', or NULL when it is full */
+static void *mempool_take_from(struct mempool *mp) {
+    unsigned char **head;
+    if ( mp->free != NULL ) {
+        head = mp->free;
+        mp->free = (void *) *head;
+    } else if ( (mp->fresh + 1) * mp->blocksize <= mp->capacity ) {
+        head = (unsigned char **) (mp->memspace + mp->fresh++ * mp->blocksize);
+    } else {
+        return NULL;
+    }
+    *head = (void *) ((uintptr_t) mp | MEMPOOL_TAKEN); // a taken block points to its pool
+    mp->takencount++;
+    return (void *) (head + 1); // actual memory is next to free pointer
+}
+
 /*
  * Takes itemsize memory from the memory pool.
  */
 void *mempool_take(struct mempool *mp) {
-    if ( mp->free != NULL ) {
-        unsigned char **head = mp->free;
-        void *res = (void *) (head + 1); // actual memory is next to free pointer
-        mp->takencount++;
-        mp->free = (void *) *head;
+    mp->takes++;
+    void *res = mempool_take_from(mp);
+    if ( res != NULL ) {
+        return res;
+    }
+    if ( mp->avail != NULL && (res = mempool_take_from(mp->avail)) != NULL ) {
         return res;
     }
 
+    size_t taken = mp->takencount;
     struct mempool *iter = mp;
-    while ( iter->next != NULL && iter->free == NULL ) { // search chain of pools
+    while ( iter->next != NULL ) { // search chain of pools
         iter = iter->next;
+        taken += iter->takencount;
+        if ( mempool_has_free(iter) ) {
+            mp->avail = iter;
+            return mempool_take_from(iter);
+        }
     }
 
-    if ( iter->next == NULL && iter->free == NULL ) { // every pool on the chain is full
-        iter->next = mempool_init(mp->itemsize, mp->takencount);
-        iter = iter->next;
+    // every pool on the chain is full; the new one is as large as all of them
+    iter->next = mempool_init(mp->itemsize, taken);
+    if ( iter->next == NULL ) {
+        perror("Could not grow memory pool");
+        exit(1);
     }
-
-    unsigned char **head = iter->free;
-    void *res = (void *) (head + 1);
-    iter->takencount++;
-    iter->free = (void *) *head;
-    return res;
+    iter->next->chain = mp;
+    LPROBE2(pool_grow, mp->itemsize, taken);
+    mp->avail = iter->next;
+    return mempool_take_from(iter->next);
 }
 
 /*
@@ -91,19 +194,84 @@ int mempool_hasaddr(struct mempool *mp, void *mem) {
 /*
  * Puts itemsize size memory back into the pool,
  * by putting it on the freelist.
+ * The header of a taken block names the pool on the chain
+ * it came from, so the chain is not searched. Returns 1 and leaves
+ * the block alone if it is free already or not of the chain of 'mp'.
  */
 int mempool_recycle(struct mempool *mp, void *mem) {
-    struct mempool *iter = mp;
-    while ( iter != NULL && !mempool_hasaddr(iter, mem) ) {
-        iter = iter->next;
+    if ( mp == NULL ) {
+        return 1;
+    }
+    unsigned char **header = ( (unsigned char **) mem ) - 1; // next free pointer is to the left of the data
+    uintptr_t tagged = (uintptr_t) *header;
+    if ( (tagged & MEMPOOL_TAKEN) == 0 ) {
+        return 1; /* free already */
+    }
+    struct mempool *owner = (struct mempool *) (tagged & ~MEMPOOL_TAKEN);
+    if ( owner->chain != mp || !mempool_hasaddr(owner, mem) ||
+         ((unsigned char *) header - owner->memspace) % owner->blocksize != 0 ) {
+        return 1; /* a block of another chain of pools */
+    }
+    *header = (void *) owner->free;
+    owner->takencount--;
+    owner->free = header;
+    if ( owner != mp ) {
+        mp->avail = owner;
+    }
+    return 0;
+}
+
+/* bytes of the blocks taken from the pools on the chain */
+size_t mempool_used(struct mempool *mp) {
+    size_t used = 0;
+    for ( struct mempool *iter = mp; iter != NULL; iter = iter->next ) {
+        used += iter->takencount * iter->blocksize;
     }
-    if ( iter ) {
-        unsigned char **header = ( (unsigned char **) mem ) - 1; // next free pointer is to the left of the data
-        *header = (void *) iter->free;
-        iter->takencount--;
-        iter->free = header;
-        return 0;
+    return used;
+}
+
+/*
+ * Bytes of the pools on the chain that have no block taken but still
+ * hold pages.
+ */
+size_t mempool_idle(struct mempool *mp) {
+    size_t idle = 0;
+    for ( struct mempool *iter = mp; iter != NULL; iter = iter->next ) {
+        if ( iter->takencount == 0 ) {
+            idle += iter == mp ? iter->fresh * iter->blocksize : iter->mapped;
+        }
     }
-    return 1;
+    return idle;
 }
 
+/*
+ * Returns the pools without a taken block to the system: the first
+ * pool keeps its mapping and drops its pages, the others are unmapped.
+ * Returns the number of bytes given back.
+ */
+size_t mempool_trim(struct mempool *mp) {
+    size_t released = 0;
+
+    if ( mp->takencount == 0 && mp->fresh > 0 && mempool_discard(mp->memspace, mp->mapped) ) {
+        released += mp->fresh * mp->blocksize;
+        mp->free = NULL;
+        mp->fresh = 0;
+    }
+
+    struct mempool *prev = mp;
+    while ( prev->next != NULL ) {
+        struct mempool *iter = prev->next;
+        if ( iter->takencount != 0 ) {
+            prev = iter;
+            continue;
+        }
+        prev->next = iter->next;
+        if ( mp->avail == iter ) {
+            mp->avail = NULL;
+        }
+        released += iter->mapped;
+        mempool_unmap(iter->memspace, iter->mapped);
+        free(iter);
+    }
+    return released;
+}
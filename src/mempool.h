@@ -3,15 +3,28 @@
 
 #include <stdlib.h>
 
+/* pools of at least this many bytes are backed by transparent huge pages where available */
+#define MEMPOOL_HUGE_SIZE (2 * 1024 * 1024)
+
+/* bytes of completely free pools kept before they are trimmed automatically */
+#define MEMPOOL_TRIM_THRESHOLD (32 * 1024 * 1024)
+
 struct mempool {
     unsigned char *memspace; /* pointer to byte-sized array that contains all the blocks */
     unsigned char **free; /* free list pointer. Points either to the next free block
         or null if no more blocks are free*/
     size_t itemsize; /* byte size of the indiviual types contained in a block */
+    size_t blocksize; /* byte size of a block; the item and the pointer in front of it */
     size_t capacity; /* byte capacity of the mempool */
+    size_t fresh; /* blocks at the start of memspace handed out since the pool was made or trimmed;
+        the rest have never been touched and are not on the free list */
     size_t takencount; /* how many blocks has been taken */
+    size_t mapped; /* bytes mapped for memspace */
     struct mempool *next; /* next mempool pointer allows for
         allocation of more mempools when the capacity has been reached */
+    struct mempool *chain; /* first pool of the chain this pool is on */
+    struct mempool *avail; /* on the first pool: a pool of the chain last seen with free blocks */
+    size_t takes; /* on the first pool: blocks ever taken from the chain */
 };
 
 struct mempool *mempool_init(size_t itemsize, size_t capacity);
@@ -19,6 +32,8 @@ void mempool_del(struct mempool *mp);
 int mempool_hasaddr(struct mempool *mp, void *mem);
 void *mempool_take(struct mempool *mp);
 int mempool_recycle(struct mempool *mp, void *mem);
+size_t mempool_trim(struct mempool *mp);
+size_t mempool_used(struct mempool *mp);
+size_t mempool_idle(struct mempool *mp);
 
 #endif
-
@@ -0,0 +1,445 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* realpath, st_mtim */
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "module.h"
+#include "lisper.h"
+#include "value.h"
+#include "writer.h"
+
+#if defined(_WIN32)
+#define LMODULE_MTIME_NSEC(st) 0
+#elif defined(__APPLE__)
+#define LMODULE_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define LMODULE_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+void lmodules_init(struct lmodules *m) {
+    m->paths = NULL;
+    m->count = 0;
+    m->cap = 0;
+}
+
+void lmodules_destroy(struct lmodules *m) {
+    for ( size_t i = 0; i < m->count; ++i ) {
+        free(m->paths[i]);
+    }
+    free(m->paths);
+    lmodules_init(m);
+}
+
+int lmodules_contains(struct lmodules *m, const char *path) {
+    for ( size_t i = 0; i < m->count; ++i ) {
+        if ( strcmp(m->paths[i], path) == 0 ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* takes ownership of 'path' */
+void lmodules_add(struct lmodules *m, char *path) {
+    if ( m->count == m->cap ) {
+        m->cap = m->cap ? m->cap * 2 : 16;
+        char **resized = realloc(m->paths, m->cap * sizeof(char *));
+        if ( resized == NULL ) {
+            perror("Could not resize module list");
+            exit(1);
+        }
+        m->paths = resized;
+    }
+    m->paths[m->count++] = path;
+}
+
+/*
+ * Canonical absolute path of a module, so a module is recognized
+ * however it is named. Returns NULL with errno set if there is no
+ * such file.
+ */
+char *lmodule_resolve(const char *path) {
+#if defined(_WIN32)
+    return _fullpath(NULL, path, 0);
+#else
+    return realpath(path, NULL);
+#endif
+}
+
+/* what a cache file must have been made from to be used */
+struct lmodule_key {
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtime_nsec;
+};
+
+static int lmodule_key_of(const char *path, struct lmodule_key *key) {
+    struct stat st;
+    if ( stat(path, &st) != 0 ) {
+        return 0;
+    }
+    key->size = (uint64_t) st.st_size;
+    key->mtime = (int64_t) st.st_mtime;
+    key->mtime_nsec = (int64_t) LMODULE_MTIME_NSEC(st);
+    return 1;
+}
+
+static char *lmodule_cache_path(const char *path) {
+    char *cache = malloc(strlen(path) + sizeof(LMODULE_CACHE_SUFFIX));
+    if ( cache == NULL ) {
+        perror("Could not allocate cache path");
+        exit(1);
+    }
+    strcpy(cache, path);
+    strcat(cache, LMODULE_CACHE_SUFFIX);
+    return cache;
+}
+
+/* tags of the values in a cache file */
+enum {
+    LMODULE_TAG_INT = 'i',
+    LMODULE_TAG_FLOAT = 'f',
+    LMODULE_TAG_BOOL = 'b',
+    LMODULE_TAG_SYM = 's',
+    LMODULE_TAG_STR = '"',
+    LMODULE_TAG_ERR = 'e',
+    LMODULE_TAG_SEXPR = '(',
+    LMODULE_TAG_QEXPR = '{'
+};
+
+/*
+ * Cache files hold a header with the key and the version of the
+ * interpreter, followed by the expressions as tagged values. Numbers
+ * are little endian so the layout does not depend on the machine.
+ */
+
+static void lmodule_put_u64(struct lwriter *w, uint64_t n) {
+    char bytes[8];
+    for ( int i = 0; i < 8; ++i ) {
+        bytes[i] = (char) (n >> (8 * i));
+    }
+    lwriter_write(w, bytes, 8);
+}
+
+static void lmodule_put_u32(struct lwriter *w, uint32_t n) {
+    char bytes[4];
+    for ( int i = 0; i < 4; ++i ) {
+        bytes[i] = (char) (n >> (8 * i));
+    }
+    lwriter_write(w, bytes, 4);
+}
+
+/* length, bytes and a terminator, so strings are read in place */
+static void lmodule_put_str(struct lwriter *w, const char *s) {
+    size_t len = strlen(s);
+    lmodule_put_u32(w, (uint32_t) len);
+    lwriter_write(w, s, len + 1);
+}
+
+/* returns 0 if 'v' is not a value the reader can make */
+static int lmodule_put_value(struct lwriter *w, struct lvalue *v) {
+    switch ( v->type ) {
+        case LVAL_INT:
+            lwriter_putc(w, LMODULE_TAG_INT);
+            lmodule_put_u64(w, (uint64_t) v->val.intval);
+            return 1;
+        case LVAL_FLOAT: {
+            uint64_t bits;
+            memcpy(&bits, &v->val.floatval, sizeof(bits));
+            lwriter_putc(w, LMODULE_TAG_FLOAT);
+            lmodule_put_u64(w, bits);
+            return 1;
+        }
+        case LVAL_BOOL:
+            lwriter_putc(w, LMODULE_TAG_BOOL);
+            lwriter_putc(w, v->val.intval ? 1 : 0);
+            return 1;
+        case LVAL_SYM:
+            lwriter_putc(w, LMODULE_TAG_SYM);
+            lmodule_put_str(w, v->val.strval);
+            return 1;
+        case LVAL_STR:
+            lwriter_putc(w, LMODULE_TAG_STR);
+            lmodule_put_str(w, v->val.strval);
+            return 1;
+        case LVAL_ERR:
+            lwriter_putc(w, LMODULE_TAG_ERR);
+            lmodule_put_str(w, v->val.strval);
+            return 1;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            lwriter_putc(w, v->type == LVAL_SEXPR ? LMODULE_TAG_SEXPR : LMODULE_TAG_QEXPR);
+            lmodule_put_u32(w, (uint32_t) v->val.l.count);
+            for ( size_t i = 0; i < v->val.l.count; ++i ) {
+                if ( !lmodule_put_value(w, v->val.l.cells[i]) ) {
+                    return 0;
+                }
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void lmodule_put_header(struct lwriter *w, const char *path, const struct lmodule_key *key) {
+    lwriter_write(w, "LSPC", 4);
+    lmodule_put_u32(w, LMODULE_CACHE_FORMAT);
+    lmodule_put_str(w, LISPER_VERSION);
+    lmodule_put_str(w, path);
+    lmodule_put_u64(w, key->size);
+    lmodule_put_u64(w, (uint64_t) key->mtime);
+    lmodule_put_u64(w, (uint64_t) key->mtime_nsec);
+}
+
+/*
+ * Stores the parsed expressions of the module at 'path'. The cache is
+ * written to a temporary file and renamed into place, so a reader never
+ * sees half of it. Failing to write it is not an error; the module is
+ * just parsed again next time.
+ */
+void lmodule_cache_write(const char *path, struct lvalue *forms) {
+    struct lmodule_key key;
+    if ( !lmodule_key_of(path, &key) ) {
+        return;
+    }
+
+    struct lwriter w;
+    lwriter_init(&w, NULL);
+    lmodule_put_header(&w, path, &key);
+    if ( !lmodule_put_value(&w, forms) ) {
+        lwriter_destroy(&w);
+        return;
+    }
+
+    char *cache = lmodule_cache_path(path);
+    char *tmp = malloc(strlen(cache) + 32);
+    if ( tmp == NULL ) {
+        perror("Could not allocate cache path");
+        exit(1);
+    }
+#if defined(_WIN32)
+    sprintf(tmp, "%s.tmp", cache);
+#else
+    sprintf(tmp, "%s.%ld.tmp", cache, (long) getpid());
+#endif
+
+    FILE *fp = fopen(tmp, "wb");
+    if ( fp != NULL ) {
+        int ok = fwrite(w.data, 1, w.len, fp) == w.len;
+        ok = (fclose(fp) == 0) && ok;
+#if defined(_WIN32)
+        if ( ok ) {
+            remove(cache);
+        }
+#endif
+        if ( !ok || rename(tmp, cache) != 0 ) {
+            remove(tmp);
+        }
+    }
+
+    free(tmp);
+    free(cache);
+    lwriter_destroy(&w);
+}
+
+/* bytes of a cache file left to read */
+struct lmodule_in {
+    const unsigned char *p;
+    const unsigned char *end;
+};
+
+static int lmodule_get_u64(struct lmodule_in *in, uint64_t *n) {
+    if ( in->end - in->p < 8 ) {
+        return 0;
+    }
+    *n = 0;
+    for ( int i = 0; i < 8; ++i ) {
+        *n |= (uint64_t) in->p[i] << (8 * i);
+    }
+    in->p += 8;
+    return 1;
+}
+
+static int lmodule_get_u32(struct lmodule_in *in, uint32_t *n) {
+    if ( in->end - in->p < 4 ) {
+        return 0;
+    }
+    *n = 0;
+    for ( int i = 0; i < 4; ++i ) {
+        *n |= (uint32_t) in->p[i] << (8 * i);
+    }
+    in->p += 4;
+    return 1;
+}
+
+static char *lmodule_get_str(struct lmodule_in *in) {
+    uint32_t len;
+    if ( !lmodule_get_u32(in, &len) || (size_t) (in->end - in->p) <= len || in->p[len] != '\0' ) {
+        return NULL;
+    }
+    char *s = (char *) in->p;
+    in->p += len + 1;
+    return s;
+}
+
+/* returns NULL if the cache is corrupt */
+static struct lvalue *lmodule_get_value(struct lmodule_in *in) {
+    if ( in->p == in->end ) {
+        return NULL;
+    }
+    uint64_t n;
+    char *s;
+    switch ( *in->p++ ) {
+        case LMODULE_TAG_INT:
+            return lmodule_get_u64(in, &n) ? lvalue_int((long long) n) : NULL;
+        case LMODULE_TAG_FLOAT: {
+            if ( !lmodule_get_u64(in, &n) ) {
+                return NULL;
+            }
+            double d;
+            memcpy(&d, &n, sizeof(d));
+            return lvalue_float(d);
+        }
+        case LMODULE_TAG_BOOL:
+            if ( in->p == in->end ) {
+                return NULL;
+            }
+            return lvalue_bool(*in->p++ != 0);
+        case LMODULE_TAG_SYM:
+            return (s = lmodule_get_str(in)) != NULL ? lvalue_sym(s) : NULL;
+        case LMODULE_TAG_STR:
+            return (s = lmodule_get_str(in)) != NULL ? lvalue_str(s) : NULL;
+        case LMODULE_TAG_ERR:
+            return (s = lmodule_get_str(in)) != NULL ? lvalue_err("%s", s) : NULL;
+        case LMODULE_TAG_SEXPR:
+        case LMODULE_TAG_QEXPR: {
+            int quoted = in->p[-1] == LMODULE_TAG_QEXPR;
+            uint32_t count;
+            if ( !lmodule_get_u32(in, &count) || count > (size_t) (in->end - in->p) ) {
+                /* every value takes at least a byte */
+                return NULL;
+            }
+            struct lvalue *v = quoted ? lvalue_qexpr() : lvalue_sexpr();
+            if ( count > 0 ) {
+                v->val.l.cells = malloc(count * sizeof(struct lvalue *));
+                if ( v->val.l.cells == NULL ) {
+                    perror("Could not allocate lvalue cell buffer");
+                    exit(1);
+                }
+            }
+            while ( v->val.l.count < count ) {
+                struct lvalue *x = lmodule_get_value(in);
+                if ( x == NULL ) {
+                    lvalue_del(v);
+                    return NULL;
+                }
+                v->val.l.cells[v->val.l.count++] = x;
+            }
+            if ( quoted ) {
+                lvalue_hash(v);
+            }
+            return v;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static int lmodule_get_header(struct lmodule_in *in, const char *path, const struct lmodule_key *key) {
+    uint32_t format;
+    uint64_t size, mtime, mtime_nsec;
+    char *version, *source;
+    if ( in->end - in->p < 4 || memcmp(in->p, "LSPC", 4) != 0 ) {
+        return 0;
+    }
+    in->p += 4;
+    return lmodule_get_u32(in, &format) && format == LMODULE_CACHE_FORMAT &&
+        (version = lmodule_get_str(in)) != NULL && strcmp(version, LISPER_VERSION) == 0 &&
+        (source = lmodule_get_str(in)) != NULL && strcmp(source, path) == 0 &&
+        lmodule_get_u64(in, &size) && size == key->size &&
+        lmodule_get_u64(in, &mtime) && (int64_t) mtime == key->mtime &&
+        lmodule_get_u64(in, &mtime_nsec) && (int64_t) mtime_nsec == key->mtime_nsec;
+}
+
+/*
+ * Reads the cache file of the module at 'path', or just as much of it
+ * as 'limit' allows. Returns NULL if there is no cache or it is not the
+ * cache of the module as it is now.
+ */
+static unsigned char *lmodule_cache_load(const char *path, size_t limit, struct lmodule_in *in) {
+    struct lmodule_key key;
+    if ( !lmodule_key_of(path, &key) ) {
+        return NULL;
+    }
+    char *cache = lmodule_cache_path(path);
+    FILE *fp = fopen(cache, "rb");
+    free(cache);
+    if ( fp == NULL ) {
+        return NULL;
+    }
+
+    unsigned char *data = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    size_t n;
+    do {
+        if ( len == cap ) {
+            cap = cap ? cap * 2 : 4096;
+            unsigned char *resized = realloc(data, cap);
+            if ( resized == NULL ) {
+                perror("Could not read module cache");
+                exit(1);
+            }
+            data = resized;
+        }
+        size_t want = cap - len;
+        if ( limit > 0 && want > limit - len ) {
+            want = limit - len;
+        }
+        n = fread(data + len, 1, want, fp);
+        len += n;
+    } while ( n > 0 && (limit == 0 || len < limit) );
+    fclose(fp);
+
+    in->p = data;
+    in->end = data + len;
+    if ( !lmodule_get_header(in, path, &key) ) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/* whether the module at 'path' has a cache that can be used */
+int lmodule_cache_valid(const char *path) {
+    struct lmodule_in in;
+    unsigned char *data = lmodule_cache_load(path, 64 + 2 * strlen(path) + sizeof(LISPER_VERSION), &in);
+    int valid = data != NULL;
+    free(data);
+    return valid;
+}
+
+/*
+ * The expressions of the module at 'path' as a s-expression, read from
+ * its cache. Returns NULL if the module has to be parsed.
+ */
+struct lvalue *lmodule_cache_read(const char *path) {
+    struct lmodule_in in;
+    unsigned char *data = lmodule_cache_load(path, 0, &in);
+    if ( data == NULL ) {
+        return NULL;
+    }
+    struct lvalue *forms = lmodule_get_value(&in);
+    if ( forms != NULL && (forms->type != LVAL_SEXPR || in.p != in.end) ) {
+        lvalue_del(forms);
+        forms = NULL;
+    }
+    free(data);
+    return forms;
+}
@@ -0,0 +1,37 @@
+#ifndef LISPER_MODULE
+#define LISPER_MODULE
+
+#include <stdlib.h>
+
+struct lvalue;
+
+/* suffix of the cached parse of a module, next to its source */
+#define LMODULE_CACHE_SUFFIX ".lspc"
+
+/* version of the layout of cache files */
+#define LMODULE_CACHE_FORMAT 1
+
+/* canonical paths of the modules imported into an interpreter */
+struct lmodules {
+    char **paths;
+    size_t count;
+    size_t cap;
+};
+
+void lmodules_init(struct lmodules *);
+void lmodules_destroy(struct lmodules *);
+int lmodules_contains(struct lmodules *, const char *path);
+void lmodules_add(struct lmodules *, char *path);
+
+char *lmodule_resolve(const char *path);
+
+/*
+ * On-disk cache of the parsed expressions of a module, keyed by the
+ * path, size and modification time of the source and the version of
+ * the interpreter.
+ */
+int lmodule_cache_valid(const char *path);
+struct lvalue *lmodule_cache_read(const char *path);
+void lmodule_cache_write(const char *path, struct lvalue *forms);
+
+#endif
@@ -362,7 +362,7 @@ static char mpc_input_buffer_get(mpc_input_t *i) {
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
+  if (i->type == MPC_INPUT_STRING && i->string[i->state.pos] == '\0') { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
   if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
   return 0;
@@ -1318,8 +1318,31 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
     return 0;
   }
   
-  res = mpc_parse_file(filename, f, p, r);
+  /* a string input backtracks without seeking the file */
+  char *contents = NULL;
+  size_t len = 0, cap = 0, n;
+  do {
+    if (len + 4096 + 1 > cap) {
+      char *grown;
+      cap = (len + 4096 + 1) * 2;
+      grown = realloc(contents, cap);
+      if (grown == NULL) {
+        free(contents);
+        fclose(f);
+        r->output = NULL;
+        r->error = mpc_err_file(filename, "Unable to read file!");
+        return 0;
+      }
+      contents = grown;
+    }
+    n = fread(contents + len, 1, cap - len - 1, f);
+    len += n;
+  } while (n > 0);
+  contents[len] = '\0';
   fclose(f);
+
+  res = mpc_parse(filename, contents, p, r);
+  free(contents);
   return res;
 }
 
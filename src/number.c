@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "number.h"
+
+/* the powers of ten a double holds exactly */
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* integers up to 2^53 are exact in a double */
+#define LNUMBER_MAX_EXACT (1ULL << 53)
+
+/* significant digits kept of a float; 19 always fit in 64 bits */
+#define LNUMBER_MAX_DIGITS 19
+
+#define LNUMBER_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+enum lnumber_status lnumber_parse_int(const char *s, const char **end, long long *out) {
+    const char *p = s;
+    int negative = 0;
+    if ( *p == '-' || *p == '+' ) {
+        negative = *p++ == '-';
+    }
+    if ( !LNUMBER_IS_DIGIT(*p) ) {
+        *end = s;
+        return LNUMBER_INVALID;
+    }
+
+    /* the magnitude of LLONG_MIN is one more than LLONG_MAX */
+    unsigned long long limit = (unsigned long long) LLONG_MAX + (negative ? 1 : 0);
+    unsigned long long n = 0;
+    int overflow = 0;
+    for ( ; LNUMBER_IS_DIGIT(*p); ++p ) {
+        unsigned digit = (unsigned) (*p - '0');
+        if ( n > (limit - digit) / 10 ) {
+            overflow = 1;
+        }
+        n = n * 10 + digit;
+    }
+    *end = p;
+    if ( overflow ) {
+        return LNUMBER_RANGE;
+    }
+
+    *out = negative ? (long long) (0 - n) : (long long) n;
+    return LNUMBER_OK;
+}
+
+/* the value of a float too long or too large for the fast path, from the C library */
+static enum lnumber_status lnumber_parse_slow(const char *s, size_t len, double *out) {
+    char small[64];
+    char *copy = len < sizeof(small) ? small : malloc(len + 1);
+    if ( copy == NULL ) {
+        perror("Could not allocate number");
+        exit(1);
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+
+    /* the reader never sets a locale, so the decimal point is '.' */
+    double d = strtod(copy, NULL);
+    if ( copy != small ) {
+        free(copy);
+    }
+
+    if ( isinf(d) ) {
+        return LNUMBER_RANGE;
+    }
+    *out = d;
+    return LNUMBER_OK;
+}
+
+/*
+ * Floats of up to 19 significant digits and small exponents are computed
+ * with a single correctly rounded multiplication or division of two
+ * exact doubles; the rest, rare in practice, goes through strtod, which
+ * rounds correctly as well.
+ */
+enum lnumber_status lnumber_parse_float(const char *s, const char **end, double *out) {
+    const char *p = s;
+    int negative = 0;
+    if ( *p == '-' || *p == '+' ) {
+        negative = *p++ == '-';
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0; /* significant digits in 'mantissa' */
+    int truncated = 0;
+    int seen = 0;
+    long exp10 = 0;
+
+    for ( ; LNUMBER_IS_DIGIT(*p); ++p, seen = 1 ) {
+        if ( digits < LNUMBER_MAX_DIGITS ) {
+            mantissa = mantissa * 10 + (unsigned) (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exp10++;
+            truncated |= *p != '0';
+        }
+    }
+    if ( *p == '.' ) {
+        for ( ++p; LNUMBER_IS_DIGIT(*p); ++p, seen = 1 ) {
+            if ( digits < LNUMBER_MAX_DIGITS ) {
+                mantissa = mantissa * 10 + (unsigned) (*p - '0');
+                digits += mantissa != 0;
+                exp10--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    if ( !seen ) {
+        *end = s;
+        return LNUMBER_INVALID;
+    }
+
+    if ( *p == 'e' || *p == 'E' ) {
+        const char *q = p + 1;
+        int exp_negative = 0;
+        if ( *q == '-' || *q == '+' ) {
+            exp_negative = *q++ == '-';
+        }
+        if ( LNUMBER_IS_DIGIT(*q) ) {
+            long e = 0;
+            for ( ; LNUMBER_IS_DIGIT(*q); ++q ) {
+                if ( e < 100000 ) {
+                    e = e * 10 + (*q - '0');
+                }
+            }
+            exp10 += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+    *end = p;
+
+    if ( mantissa == 0 ) {
+        *out = negative ? -0.0 : 0.0;
+        return LNUMBER_OK;
+    }
+
+    if ( !truncated && mantissa <= LNUMBER_MAX_EXACT ) {
+        double d = (double) mantissa;
+        /* move exponent into the mantissa while it stays exact: 123e25 is 123000e22 */
+        while ( exp10 > 22 && d * 10 <= (double) LNUMBER_MAX_EXACT ) {
+            d *= 10;
+            exp10--;
+        }
+        if ( exp10 >= 0 && exp10 <= 22 ) {
+            *out = negative ? -(d * exact_pow10[exp10]) : d * exact_pow10[exp10];
+            return LNUMBER_OK;
+        }
+        if ( exp10 < 0 && exp10 >= -22 ) {
+            *out = negative ? -(d / exact_pow10[-exp10]) : d / exact_pow10[-exp10];
+            return LNUMBER_OK;
+        }
+    }
+
+    return lnumber_parse_slow(s, (size_t) (p - s), out);
+}
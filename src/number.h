@@ -0,0 +1,18 @@
+#ifndef LISPER_NUMBER
+#define LISPER_NUMBER
+
+enum lnumber_status {
+    LNUMBER_OK,
+    LNUMBER_INVALID, /* no digits where a number was expected */
+    LNUMBER_RANGE /* the number does not fit in the type */
+};
+
+/*
+ * Decimal number parsing independent of the locale. Both parse the
+ * longest number at the start of 's' and point 'end' past it; on
+ * LNUMBER_INVALID 'end' is 's'.
+ */
+enum lnumber_status lnumber_parse_int(const char *s, const char **end, long long *out);
+enum lnumber_status lnumber_parse_float(const char *s, const char **end, double *out);
+
+#endif
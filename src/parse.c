@@ -0,0 +1,531 @@
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* sysconf */
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "parse.h"
+#include "context.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LPARSE_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* most worker threads an interpreter starts for parsing */
+#define LPARSE_MAX_WORKERS 16
+
+/* most files parsed ahead of their load at a time */
+#define LPARSE_MAX_PREFETCH 64
+
+/*
+ * Worker threads parsing the chunks of source files. Files with chunks
+ * left to parse are queued in the order they were opened; a thread
+ * waiting for a file parses its chunks itself rather than sleep.
+ *
+ * Only the syntax trees are built off the main thread. Reading them into
+ * values interns symbols and allocates from the interpreter, so that is
+ * left to the thread that loads the file.
+ */
+struct lparse_pool {
+#ifdef LPARSE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t work; /* chunks were queued or the pool is stopping */
+    pthread_cond_t done; /* a chunk was parsed */
+    pthread_t workers[LPARSE_MAX_WORKERS];
+    pid_t owner; /* process that started the workers; a forked child has none */
+#endif
+    size_t nworkers;
+    int stop;
+    mpc_parser_t *lang;
+    struct lparse_file *head; /* files with chunks not taken yet */
+    struct lparse_file *tail;
+    struct lparse_file *prefetched;
+    size_t prefetch_count;
+};
+
+static int is_form_delimiter(char c) {
+    return c == '(' || c == ')' || c == '{' || c == '}' || c == '"' || c == ';' ||
+        c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/*
+ * Scans buf[0..len) from where the last scan stopped. Returns 1 and
+ * the half-open range of the expression when a complete top-level
+ * expression has been seen, and 0 when more input is needed.
+ */
+int lparse_scan(struct lparse_scanner *s, const char *buf, size_t len, int eof, size_t *start, size_t *end) {
+    for ( ; s->pos < len; s->pos++ ) {
+        char c = buf[s->pos];
+
+        if ( s->in_comment ) {
+            if ( c == '\n' ) {
+                s->in_comment = 0;
+            }
+        } else if ( s->in_string ) {
+            if ( s->escaped ) {
+                s->escaped = 0;
+            } else if ( c == '\\' ) {
+                s->escaped = 1;
+            } else if ( c == '"' ) {
+                s->in_string = 0;
+                if ( s->depth == 0 ) {
+                    s->pos++;
+                    break;
+                }
+            }
+        } else if ( s->in_atom ) {
+            if ( is_form_delimiter(c) ) {
+                break;
+            }
+        } else if ( c == ';' ) {
+            s->in_comment = 1;
+        } else if ( c == '"' ) {
+            if ( !s->started ) {
+                s->started = 1;
+                s->start = s->pos;
+            }
+            s->in_string = 1;
+        } else if ( c == '(' || c == '{' ) {
+            if ( !s->started ) {
+                s->started = 1;
+                s->start = s->pos;
+            }
+            s->depth++;
+        } else if ( c == ')' || c == '}' ) {
+            if ( !s->started ) {
+                /* unbalanced; let the parser report it */
+                s->started = 1;
+                s->start = s->pos;
+            }
+            if ( s->depth > 0 ) {
+                s->depth--;
+            }
+            if ( s->depth == 0 ) {
+                s->pos++;
+                break;
+            }
+        } else if ( !is_form_delimiter(c) && !s->started ) {
+            s->started = 1;
+            s->start = s->pos;
+            s->in_atom = 1;
+        }
+    }
+
+    int complete = s->started && (s->pos < len || eof ||
+        (s->depth == 0 && !s->in_string && !s->in_atom));
+    if ( !complete ) {
+        return 0;
+    }
+
+    *start = s->start;
+    *end = s->pos;
+    s->started = 0;
+    s->depth = 0;
+    s->in_atom = 0;
+    s->in_string = 0;
+    s->escaped = 0;
+    return 1;
+}
+
+#ifdef LPARSE_THREADS
+#define LPARSE_LOCK(pool) pthread_mutex_lock(&(pool)->lock)
+#define LPARSE_UNLOCK(pool) pthread_mutex_unlock(&(pool)->lock)
+#else
+#define LPARSE_LOCK(pool) (void) (pool)
+#define LPARSE_UNLOCK(pool) (void) (pool)
+#endif
+
+/* worker threads of the pool running in this process */
+static size_t lparse_workers(struct lparse_pool *pool) {
+#ifdef LPARSE_THREADS
+    if ( pool->owner != getpid() ) {
+        return 0;
+    }
+#endif
+    return pool->nworkers;
+}
+
+static void lparse_unqueue(struct lparse_pool *pool, struct lparse_file *f) {
+    struct lparse_file *prev = NULL;
+    for ( struct lparse_file *iter = pool->head; iter != NULL; prev = iter, iter = iter->queued ) {
+        if ( iter == f ) {
+            if ( prev != NULL ) {
+                prev->queued = f->queued;
+            } else {
+                pool->head = f->queued;
+            }
+            if ( pool->tail == f ) {
+                pool->tail = prev;
+            }
+            f->queued = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Takes the next chunk to parse of '*fp', or of the first queued file
+ * if '*fp' is NULL. Called with the lock held.
+ */
+static struct lparse_chunk *lparse_claim(struct lparse_pool *pool, struct lparse_file **fp) {
+    struct lparse_file *f = *fp != NULL ? *fp : pool->head;
+    if ( f == NULL || f->claimed == f->count ) {
+        return NULL;
+    }
+    struct lparse_chunk *c = &f->chunks[f->claimed++];
+    if ( f->claimed == f->count ) {
+        lparse_unqueue(pool, f);
+    }
+    *fp = f;
+    return c;
+}
+
+static void lparse_chunk_parse(struct lparse_pool *pool, struct lparse_file *f, struct lparse_chunk *c) {
+    c->ok = mpc_nparse(f->path, f->text + c->start, c->len, pool->lang, &c->r);
+    if ( !c->ok ) {
+        /* report the line in the file rather than in the chunk */
+        c->r.error->state.row += c->line;
+    }
+}
+
+#ifdef LPARSE_THREADS
+static void *lparse_worker(void *arg) {
+    struct lparse_pool *pool = arg;
+    LPARSE_LOCK(pool);
+    for (;;) {
+        while ( !pool->stop && pool->head == NULL ) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if ( pool->stop ) {
+            break;
+        }
+        struct lparse_file *f = NULL;
+        struct lparse_chunk *c = lparse_claim(pool, &f);
+        LPARSE_UNLOCK(pool);
+        lparse_chunk_parse(pool, f, c);
+        LPARSE_LOCK(pool);
+        c->parsed = 1;
+        f->pending--;
+        pthread_cond_broadcast(&pool->done);
+    }
+    LPARSE_UNLOCK(pool);
+    return NULL;
+}
+#endif
+
+static void lparse_file_free(struct lparse_file *);
+
+/*
+ * A forked child has none of the workers. Parses they had taken are
+ * never finished, so the files ahead are dropped and the child parses
+ * on its own.
+ */
+static void lparse_pool_adopt(struct lparse_pool *pool) {
+#ifdef LPARSE_THREADS
+    if ( pool->owner == getpid() ) {
+        return;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->owner = getpid();
+    pool->nworkers = 0;
+#endif
+    pool->head = NULL;
+    pool->tail = NULL;
+    while ( pool->prefetched != NULL ) {
+        struct lparse_file *f = pool->prefetched;
+        pool->prefetched = f->next;
+        lparse_file_free(f);
+    }
+    pool->prefetch_count = 0;
+}
+
+/* the pool of the interpreter, started on first use */
+static struct lparse_pool *lparse_pool_get(struct lisper_ctx *ctx) {
+    if ( ctx->parse != NULL ) {
+        lparse_pool_adopt(ctx->parse);
+        return ctx->parse;
+    }
+    struct lparse_pool *pool = calloc(1, sizeof(struct lparse_pool));
+    if ( pool == NULL ) {
+        perror("Could not allocate parser");
+        exit(1);
+    }
+    pool->lang = ctx->elems.Lisper;
+
+#ifdef LPARSE_THREADS
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->owner = getpid();
+
+    /* the loading thread parses as well */
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t wanted = cores > 1 ? (size_t) cores - 1 : 0;
+    if ( wanted > LPARSE_MAX_WORKERS ) {
+        wanted = LPARSE_MAX_WORKERS;
+    }
+    while ( pool->nworkers < wanted &&
+            pthread_create(&pool->workers[pool->nworkers], NULL, lparse_worker, pool) == 0 ) {
+        pool->nworkers++;
+    }
+#endif
+
+    ctx->parse = pool;
+    return pool;
+}
+
+static void lparse_file_free(struct lparse_file *f) {
+    for ( size_t i = 0; i < f->count; ++i ) {
+        struct lparse_chunk *c = &f->chunks[i];
+        if ( !c->parsed ) {
+            continue;
+        }
+        if ( c->ok && c->r.output != NULL ) {
+            mpc_ast_delete(c->r.output);
+        } else if ( !c->ok ) {
+            mpc_err_delete(c->r.error);
+        }
+    }
+    free(f->chunks);
+    free(f->text);
+    free(f->path);
+    free(f);
+}
+
+static struct lparse_file *lparse_file_read(const char *path) {
+    struct lparse_file *f = calloc(1, sizeof(struct lparse_file));
+    if ( f == NULL || (f->path = malloc(strlen(path) + 1)) == NULL ) {
+        perror("Could not allocate parse");
+        exit(1);
+    }
+    strcpy(f->path, path);
+
+    FILE *fp = fopen(path, "rb");
+    if ( fp == NULL ) {
+        return f;
+    }
+    size_t cap = 0;
+    size_t n;
+    do {
+        if ( f->len + 4096 + 1 > cap ) {
+            cap = (f->len + 4096 + 1) * 2;
+            char *resized = realloc(f->text, cap);
+            if ( resized == NULL ) {
+                perror("Could not read file");
+                exit(1);
+            }
+            f->text = resized;
+        }
+        n = fread(f->text + f->len, 1, cap - f->len - 1, fp);
+        f->len += n;
+    } while ( n > 0 );
+    f->text[f->len] = '\0';
+    fclose(fp);
+    f->readable = 1;
+    return f;
+}
+
+static void lparse_add_chunk(struct lparse_file *f, size_t start, size_t end, long *line) {
+    struct lparse_chunk *c = &f->chunks[f->count++];
+    memset(c, 0, sizeof(struct lparse_chunk));
+    c->start = start;
+    c->len = end - start;
+    c->line = *line;
+    for ( const char *p = f->text + start; (p = memchr(p, '\n', (size_t) (f->text + end - p))) != NULL; ++p ) {
+        (*line)++;
+    }
+}
+
+/*
+ * Splits the text of 'f' into chunks of whole top-level expressions,
+ * about two per thread and none smaller than LPARSE_CHUNK_MIN, and
+ * queues them to be parsed.
+ */
+static void lparse_file_start(struct lparse_pool *pool, struct lparse_file *f) {
+    if ( !f->readable ) {
+        return;
+    }
+    size_t threads = lparse_workers(pool) + 1;
+    size_t target = f->len / (threads * 2);
+    if ( target < LPARSE_CHUNK_MIN ) {
+        target = LPARSE_CHUNK_MIN;
+    }
+
+    f->chunks = malloc((f->len / target + 2) * sizeof(struct lparse_chunk));
+    if ( f->chunks == NULL ) {
+        perror("Could not allocate parse");
+        exit(1);
+    }
+
+    long line = 0;
+    size_t chunk_start = 0;
+    if ( threads > 1 && f->len > target ) {
+        struct lparse_scanner scanner;
+        memset(&scanner, 0, sizeof(struct lparse_scanner));
+        size_t start, end;
+        while ( lparse_scan(&scanner, f->text, f->len, 1, &start, &end) ) {
+            if ( end - chunk_start >= target ) {
+                lparse_add_chunk(f, chunk_start, end, &line);
+                chunk_start = end;
+            }
+        }
+    }
+    if ( chunk_start < f->len || f->count == 0 ) {
+        lparse_add_chunk(f, chunk_start, f->len, &line);
+    }
+    f->pending = f->count;
+
+    if ( threads > 1 ) {
+        LPARSE_LOCK(pool);
+        if ( pool->tail != NULL ) {
+            pool->tail->queued = f;
+        } else {
+            pool->head = f;
+        }
+        pool->tail = f;
+#ifdef LPARSE_THREADS
+        pthread_cond_broadcast(&pool->work);
+#endif
+        LPARSE_UNLOCK(pool);
+    }
+}
+
+/*
+ * Starts parsing the file at 'path'. A parse started ahead by
+ * lparse_prefetch is taken over if the file still has the same content.
+ */
+struct lparse_file *lparse_file_open(struct lisper_ctx *ctx, const char *path) {
+    struct lparse_pool *pool = lparse_pool_get(ctx);
+    struct lparse_file *f = lparse_file_read(path);
+
+    for ( struct lparse_file **link = &pool->prefetched; *link != NULL; link = &(*link)->next ) {
+        struct lparse_file *ahead = *link;
+        if ( strcmp(ahead->path, path) != 0 ) {
+            continue;
+        }
+        *link = ahead->next;
+        pool->prefetch_count--;
+        ahead->next = NULL;
+        if ( ahead->readable && f->readable && ahead->len == f->len && memcmp(ahead->text, f->text, f->len) == 0 ) {
+            lparse_file_free(f);
+            return ahead;
+        }
+        lparse_file_del(ctx, ahead);
+        break;
+    }
+
+    lparse_file_start(pool, f);
+    return f;
+}
+
+/*
+ * Starts parsing the file at 'path' on the worker threads, ahead of it
+ * being loaded.
+ */
+void lparse_prefetch(struct lisper_ctx *ctx, const char *path) {
+    struct lparse_pool *pool = lparse_pool_get(ctx);
+    if ( lparse_workers(pool) == 0 || pool->prefetch_count >= LPARSE_MAX_PREFETCH ) {
+        return;
+    }
+    for ( struct lparse_file *f = pool->prefetched; f != NULL; f = f->next ) {
+        if ( strcmp(f->path, path) == 0 ) {
+            return;
+        }
+    }
+    struct lparse_file *f = lparse_file_read(path);
+    if ( !f->readable ) {
+        lparse_file_free(f);
+        return;
+    }
+    lparse_file_start(pool, f);
+    f->next = pool->prefetched;
+    pool->prefetched = f;
+    pool->prefetch_count++;
+}
+
+/*
+ * Waits until every chunk of 'f' has been parsed, parsing the ones no
+ * worker has taken yet. Returns 1 if the whole file parsed.
+ */
+int lparse_file_wait(struct lisper_ctx *ctx, struct lparse_file *f) {
+    struct lparse_pool *pool = lparse_pool_get(ctx);
+    LPARSE_LOCK(pool);
+    while ( f->pending > 0 ) {
+        struct lparse_file *mine = f;
+        struct lparse_chunk *c = lparse_claim(pool, &mine);
+        if ( c != NULL ) {
+            LPARSE_UNLOCK(pool);
+            lparse_chunk_parse(pool, f, c);
+            LPARSE_LOCK(pool);
+            c->parsed = 1;
+            f->pending--;
+            continue;
+        }
+#ifdef LPARSE_THREADS
+        pthread_cond_wait(&pool->done, &pool->lock);
+#endif
+    }
+    LPARSE_UNLOCK(pool);
+
+    if ( !f->readable ) {
+        return 0;
+    }
+    for ( size_t i = 0; i < f->count; ++i ) {
+        if ( !f->chunks[i].ok ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* message of why a waited for file did not parse; to be freed by the caller */
+char *lparse_file_error(struct lparse_file *f) {
+    if ( !f->readable ) {
+        const char *fmt = "%s: error: Unable to open file!\n";
+        size_t size = strlen(fmt) + strlen(f->path) + 1;
+        char *msg = malloc(size);
+        if ( msg != NULL ) {
+            snprintf(msg, size, fmt, f->path);
+        }
+        return msg;
+    }
+    for ( size_t i = 0; i < f->count; ++i ) {
+        if ( !f->chunks[i].ok ) {
+            return mpc_err_string(f->chunks[i].r.error);
+        }
+    }
+    return NULL;
+}
+
+void lparse_file_del(struct lisper_ctx *ctx, struct lparse_file *f) {
+    lparse_file_wait(ctx, f); /* no worker may still be parsing it */
+    lparse_file_free(f);
+}
+
+void lparse_pool_del(struct lparse_pool *pool) {
+    if ( pool == NULL ) {
+        return;
+    }
+#ifdef LPARSE_THREADS
+    if ( lparse_workers(pool) > 0 ) {
+        LPARSE_LOCK(pool);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->work);
+        LPARSE_UNLOCK(pool);
+        for ( size_t i = 0; i < pool->nworkers; ++i ) {
+            pthread_join(pool->workers[i], NULL);
+        }
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    /* the workers are gone; unparsed chunks of the files ahead are dropped */
+    while ( pool->prefetched != NULL ) {
+        struct lparse_file *f = pool->prefetched;
+        pool->prefetched = f->next;
+        lparse_file_free(f);
+    }
+    free(pool);
+}
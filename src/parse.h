@@ -0,0 +1,65 @@
+#ifndef LISPER_PARSE
+#define LISPER_PARSE
+
+#include <stdlib.h>
+#include "mpc.h"
+
+struct lisper_ctx;
+struct lparse_pool;
+
+/* files larger than this are split into chunks parsed in parallel */
+#define LPARSE_CHUNK_MIN (64 * 1024)
+
+/*
+ * Incremental scanner finding the boundaries of top-level expressions
+ * in a stream. Only delimiters, strings and comments are tracked; the
+ * text of every complete expression is handed to the real parser.
+ */
+struct lparse_scanner {
+    size_t pos; /* next byte to scan */
+    size_t start; /* first byte of the expression being scanned */
+    int started;
+    int depth;
+    int in_atom;
+    int in_string;
+    int in_comment;
+    int escaped;
+};
+
+int lparse_scan(struct lparse_scanner *, const char *buf, size_t len, int eof, size_t *start, size_t *end);
+
+/* run of whole top-level expressions of a file, parsed on its own */
+struct lparse_chunk {
+    size_t start;
+    size_t len;
+    long line; /* lines of the file before the chunk */
+    int parsed; /* 'ok' and 'r' hold the result */
+    int ok;
+    mpc_result_t r;
+};
+
+/*
+ * Source file being parsed. Its chunks are parsed by the worker threads
+ * of the interpreter, and by the thread waiting for them.
+ */
+struct lparse_file {
+    char *path;
+    char *text;
+    size_t len;
+    int readable;
+    struct lparse_chunk *chunks;
+    size_t count;
+    size_t claimed; /* chunks taken to be parsed */
+    size_t pending; /* chunks not parsed yet */
+    struct lparse_file *queued; /* next file with chunks to be parsed */
+    struct lparse_file *next; /* next prefetched file */
+};
+
+struct lparse_file *lparse_file_open(struct lisper_ctx *, const char *path);
+int lparse_file_wait(struct lisper_ctx *, struct lparse_file *);
+char *lparse_file_error(struct lparse_file *);
+void lparse_file_del(struct lisper_ctx *, struct lparse_file *);
+void lparse_prefetch(struct lisper_ctx *, const char *path);
+void lparse_pool_del(struct lparse_pool *);
+
+#endif
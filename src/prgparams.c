@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include "prgparams.h"
 #include "lisper.h"
 
@@ -8,11 +9,31 @@ void exit_with_help(int exit_code) {
     printf(
             "Usage: lisper [OPTION]... [FILE]\n"
             "Run a lisper program specified by FILE or enter a REPL (Read-Eval-Print Loop) session if no FILE is given.\n"
+            "With FILE '-', or when stdin is not a terminal, the program is read from stdin as it arrives.\n"
             "\n"
             "OPTIONs available:\n"
             "  -v, --version            show version infomation and exit\n"
             "  -h, --help               show this message and exit\n"
             "  -c <COMMAND>             run <COMMAND> and exit\n"
+            "  --serve <SOCKET>         serve evaluation requests on the unix socket <SOCKET>\n"
+            "  --preload <FILE>         load <FILE> once before serving (may be repeated)\n"
+            "  --each-line <SCRIPT> <FUNCTION>\n"
+            "                           load <SCRIPT> and call <FUNCTION> with every line of the\n"
+            "                           FILEs (or stdin), printing the non-empty results\n"
+            "  --connect <SOCKET>       send the program to the server at <SOCKET> instead of\n"
+            "                           running it in this process\n"
+            "  --jit-stats              report what the JIT compiled and ran on exit\n"
+            "  --perf-map               name the JIT's machine code for perf in\n"
+            "                           /tmp/perf-<PID>.map\n"
+            "  --emit-c                 write FILE to stdout as C source of a standalone\n"
+            "                           executable, to be linked with liblisper\n"
+            "  --max-steps <N>          stop evaluating after <N> s-expressions\n"
+            "  --max-time <MS>          stop evaluating after <MS> milliseconds\n"
+            "  --max-heap <BYTES>       stop evaluating once <BYTES> more are allocated\n"
+            "  --max-depth <N>          stop evaluating beyond <N> nested function calls\n"
+            "                           limits apply to the program, each REPL input,\n"
+            "                           each expression read from stdin and each\n"
+            "                           served request\n"
             "\n"
             "Lisper online source code repository: <https://www.github.com/Ezbob/lisper>\n"
             "Licensed under the very permissive MIT license\n" 
@@ -20,22 +41,56 @@ void exit_with_help(int exit_code) {
     exit(exit_code);
 }
 
+/* positive integer value of a --max-* option; 0 if it is not one */
+static size_t parse_limit(const char *value) {
+    char *end = NULL;
+    if ( value[0] < '0' || value[0] > '9' ) {
+        return 0;
+    }
+    unsigned long long n = strtoull(value, &end, 10);
+    if ( *end != '\0' || n > SIZE_MAX ) {
+        return 0;
+    }
+    return (size_t) n;
+}
+
 int parse_prg_params(int argc, char **argv, struct lisper_params *params) {
     
     char *filename = NULL;
     char *command = NULL;
+    char *serve = NULL;
+    char *connect = NULL;
+    int preload_count = 0;
+    char *each_line_script = NULL;
+    char *each_line_func = NULL;
+    char **inputs = NULL;
+    int input_count = 0;
     int version = 0;
     int help = 0;
+    int jit_stats = 0;
+    int perf_map = 0;
+    int emit_c = 0;
+    struct lbudget_limits limits;
+    memset(&limits, 0, sizeof(limits));
     int followed_by_optional = 0; /* bool trigger for options that take arguments */
     int arg_count = 0;
     char *current;
 
     for ( int i = 1; i < argc; ++i ) {
         current = argv[i];
-        if ( strlen(current) > 0 && current[0] != '-' && !followed_by_optional ) {
+        if ( each_line_script != NULL && (current[0] != '-' || strcmp(current, "-") == 0) ) {
+            /* the rest of the arguments are the record input files */
+            inputs = argv + i;
+            input_count = argc - i;
+            break;
+        } else if ( strlen(current) > 0 && current[0] != '-' && !followed_by_optional ) {
             arg_count++;
             filename = current;
             break; /* program filename found stopping lisper argument parsing  */
+        } else if ( strcmp(current, "-") == 0 && !followed_by_optional ) {
+            arg_count++;
+            filename = current; /* program is read from stdin */
+            break;
         } else if ( strlen(current) > 0 ) {
             /* insert optional parse conditions here */
             if ( strcmp(current, "--help") == 0 || strcmp(current, "-h") == 0 ) {
@@ -44,6 +99,15 @@ int parse_prg_params(int argc, char **argv, struct lisper_params *params) {
             } else if ( strcmp(current, "--version") == 0 || strcmp(current, "-v") == 0 ) {
                 version = 1;
                 arg_count++;
+            } else if ( strcmp(current, "--jit-stats") == 0 ) {
+                jit_stats = 1;
+                arg_count++;
+            } else if ( strcmp(current, "--perf-map") == 0 ) {
+                perf_map = 1;
+                arg_count++;
+            } else if ( strcmp(current, "--emit-c") == 0 ) {
+                emit_c = 1;
+                arg_count++;
             } else if ( strcmp(current, "-c") == 0 ) {
                 arg_count++;
                 if ((i + 1) >= argc) {
@@ -55,6 +119,58 @@ int parse_prg_params(int argc, char **argv, struct lisper_params *params) {
                     return 1;
                 }
                 command = value;
+            } else if ( strcmp(current, "--max-steps") == 0 || strcmp(current, "--max-time") == 0 ||
+                        strcmp(current, "--max-heap") == 0 || strcmp(current, "--max-depth") == 0 ) {
+                arg_count++;
+                if ((i + 1) >= argc) {
+                    return 1;
+                }
+                i += 1;
+                size_t n = parse_limit(argv[i]);
+                if ( n == 0 ) {
+                    return 1;
+                }
+                if ( strcmp(current, "--max-steps") == 0 ) {
+                    limits.steps = n;
+                } else if ( strcmp(current, "--max-time") == 0 ) {
+                    limits.time_ms = n;
+                } else if ( strcmp(current, "--max-heap") == 0 ) {
+                    limits.heap = n;
+                } else {
+                    limits.depth = n;
+                }
+            } else if ( strcmp(current, "--each-line") == 0 ) {
+                arg_count++;
+                if ((i + 2) >= argc) {
+                    return 1;
+                }
+                each_line_script = argv[i + 1];
+                each_line_func = argv[i + 2];
+                i += 2;
+                if (strlen(each_line_script) == 0 || strlen(each_line_func) == 0) {
+                    return 1;
+                }
+            } else if ( strcmp(current, "--serve") == 0 || strcmp(current, "--connect") == 0 ||
+                        strcmp(current, "--preload") == 0 ) {
+                arg_count++;
+                if ((i + 1) >= argc) {
+                    return 1;
+                }
+                i += 1;
+                char *value = argv[i];
+                if (strlen(value) == 0) {
+                    return 1;
+                }
+                if ( strcmp(current, "--serve") == 0 ) {
+                    serve = value;
+                } else if ( strcmp(current, "--connect") == 0 ) {
+                    connect = value;
+                } else {
+                    if ( preload_count == LISPER_MAX_PRELOADS ) {
+                        return 1;
+                    }
+                    params->preload[preload_count++] = value;
+                }
             } else {
                 return 1;
             }
@@ -63,6 +179,17 @@ int parse_prg_params(int argc, char **argv, struct lisper_params *params) {
 
     params->command = command;
     params->filename = filename;
+    params->serve = serve;
+    params->connect = connect;
+    params->preload_count = preload_count;
+    params->each_line_script = each_line_script;
+    params->each_line_func = each_line_func;
+    params->inputs = inputs;
+    params->input_count = input_count;
+    params->jit_stats = jit_stats;
+    params->perf_map = perf_map;
+    params->emit_c = emit_c;
+    params->limits = limits;
     params->version = version;
     params->help = help;
     params->arg_count = arg_count;
@@ -84,6 +211,11 @@ int handle_prg_params(struct lisper_params *parsed_params) {
         exit(0);
     }
 
+    if ( parsed_params->emit_c && (parsed_params->filename == NULL || strcmp(parsed_params->filename, "-") == 0) ) {
+        fprintf(stderr, "Error: --emit-c needs a program FILE\n");
+        return 1;
+    }
+
     return 0;
 }
 
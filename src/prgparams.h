@@ -1,9 +1,25 @@
 #ifndef LISPER_PRGPARAMS
 #define LISPER_PRGPARAMS
 
+#include "budget.h"
+
+#define LISPER_MAX_PRELOADS 32
+
 struct lisper_params {
     char *filename;
     char *command;
+    char *serve; /* unix socket path to serve evaluation requests on */
+    char *connect; /* unix socket path of a server to send the program to */
+    char *preload[LISPER_MAX_PRELOADS]; /* files loaded before serving */
+    int preload_count;
+    char *each_line_script; /* script loaded before processing lines */
+    char *each_line_func; /* function called with every line */
+    char **inputs; /* files processed line by line; stdin when there are none */
+    int input_count;
+    int jit_stats; /* report the JIT counters at exit */
+    int perf_map; /* write perf's map of the JIT's code */
+    int emit_c; /* write the program as C source instead of running it */
+    struct lbudget_limits limits; /* limits of the evaluation of the program (--max-*) */
     int help;
     int version;
     int arg_count;
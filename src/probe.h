@@ -0,0 +1,72 @@
+#ifndef LISPER_PROBE
+#define LISPER_PROBE
+
+/*
+ * Static tracepoints (USDT) of the 'lisper' provider, for perf, bpftrace
+ * and SystemTap:
+ *
+ *   function_entry(name, depth)   an interpreted function is called
+ *   function_return(name, depth)
+ *   load_start(path)              a file is loaded or imported
+ *   load_done(path, forms)
+ *   pool_grow(item size, blocks)  a value pool is added
+ *   heap_trim(bytes)              free pools are given back to the system
+ *   jit_compile(name, code, bytes)
+ *
+ * Names and paths are C strings, and the name of a function is NULL
+ * unless it was defined with 'def', '=' or 'fn'. Every argument is
+ * passed as a 64 bit integer.
+ *
+ * A probe is a nop where it is placed, described by an ELF note in the
+ * format of SystemTap's <sys/sdt.h>, so the probes are always in the
+ * binary and cost nothing until a tracer enables them:
+ *
+ *   bpftrace -e 'usdt:./lisper:lisper:function_entry { @[str(arg0)] = count(); }'
+ */
+
+#if defined(LISPER_ENABLE_USDT) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+
+#define LPROBE_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"lisper\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define LPROBE_ARG(n, x) [lprobe_a##n] "nor" ((long long) (x))
+
+#define LPROBE1(name, a0) \
+    __asm__ __volatile__ (LPROBE_NOTE(name, "-8@%[lprobe_a0]") :: LPROBE_ARG(0, a0))
+#define LPROBE2(name, a0, a1) \
+    __asm__ __volatile__ (LPROBE_NOTE(name, "-8@%[lprobe_a0] -8@%[lprobe_a1]") :: LPROBE_ARG(0, a0), LPROBE_ARG(1, a1))
+#define LPROBE3(name, a0, a1, a2) \
+    __asm__ __volatile__ (LPROBE_NOTE(name, "-8@%[lprobe_a0] -8@%[lprobe_a1] -8@%[lprobe_a2]") \
+        :: LPROBE_ARG(0, a0), LPROBE_ARG(1, a1), LPROBE_ARG(2, a2))
+
+#else
+
+#define LPROBE1(name, a0) ((void) (a0))
+#define LPROBE2(name, a0, a1) ((void) (a0), (void) (a1))
+#define LPROBE3(name, a0, a1, a2) ((void) (a0), (void) (a1), (void) (a2))
+
+#endif
+
+#endif
@@ -0,0 +1,735 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "re.h"
+
+/*
+ * Regular expressions matched in linear time.
+ *
+ * Patterns are compiled to a program for a Pike VM: the threads of every
+ * possible match advance through the subject in lockstep, one byte at a
+ * time, so matching takes time proportional to the length of the subject
+ * times the size of the program and never backtracks. Threads are kept
+ * in priority order, which gives the leftmost match with the preference
+ * of greedy and lazy quantifiers of backtracking engines.
+ *
+ * Supported: literals, '.', classes '[a-z]' and '[^...]', the escapes
+ * \d \w \s \D \W \S \n \t \r, anchors '^' and '$', groups '(...)' and
+ * '(?:...)', alternation '|' and the quantifiers * + ? {n} {n,} {n,m},
+ * lazy when followed by '?'.
+ */
+
+#define LRE_MAX_INSTS 20000
+#define LRE_MAX_REPEAT 1000
+
+enum lre_op {
+    LRE_OP_BYTE,
+    LRE_OP_ANY, /* any byte but a newline */
+    LRE_OP_SET,
+    LRE_OP_BOL,
+    LRE_OP_EOL,
+    LRE_OP_SPLIT, /* continue at x, and at y with a lower priority */
+    LRE_OP_JMP,
+    LRE_OP_SAVE, /* record the position in capture slot x */
+    LRE_OP_MATCH
+};
+
+struct lre_inst {
+    enum lre_op op;
+    int x;
+    int y;
+};
+
+struct lre {
+    struct lre_inst *insts;
+    size_t count;
+    unsigned char (*sets)[32]; /* bitmaps of the byte sets */
+    size_t groups; /* capture groups besides the whole match */
+};
+
+enum lre_node_type {
+    LRE_EMPTY,
+    LRE_BYTE,
+    LRE_ANY,
+    LRE_SET,
+    LRE_BOL,
+    LRE_EOL,
+    LRE_CAT,
+    LRE_ALT,
+    LRE_REPEAT,
+    LRE_GROUP
+};
+
+struct lre_node {
+    enum lre_node_type type;
+    int value; /* byte, set or group number */
+    int left;
+    int right;
+    int min;
+    int max; /* -1 when unbounded */
+    int greedy;
+};
+
+struct lre_parser {
+    const char *p;
+    const char *err;
+    struct lre_node *nodes;
+    size_t node_count;
+    size_t node_cap;
+    unsigned char (*sets)[32];
+    size_t set_count;
+    size_t set_cap;
+    size_t groups;
+    struct lre *re; /* program being compiled */
+    size_t inst_cap;
+};
+
+static void *lre_grow(void *data, size_t *cap, size_t count, size_t size) {
+    if ( count < *cap ) {
+        return data;
+    }
+    *cap = *cap == 0 ? 16 : *cap * 2;
+    void *resized = realloc(data, *cap * size);
+    if ( resized == NULL ) {
+        perror("Could not grow regular expression");
+        exit(1);
+    }
+    return resized;
+}
+
+static int lre_node(struct lre_parser *ps, enum lre_node_type type, int value, int left, int right) {
+    ps->nodes = lre_grow(ps->nodes, &ps->node_cap, ps->node_count, sizeof(struct lre_node));
+    struct lre_node *n = &ps->nodes[ps->node_count];
+    n->type = type;
+    n->value = value;
+    n->left = left;
+    n->right = right;
+    n->min = 0;
+    n->max = 0;
+    n->greedy = 1;
+    return (int) ps->node_count++;
+}
+
+static int lre_new_set(struct lre_parser *ps) {
+    ps->sets = lre_grow(ps->sets, &ps->set_cap, ps->set_count, sizeof(ps->sets[0]));
+    memset(ps->sets[ps->set_count], 0, sizeof(ps->sets[0]));
+    return (int) ps->set_count++;
+}
+
+static void lre_set_add(unsigned char *set, int lo, int hi) {
+    for ( int c = lo; c <= hi; ++c ) {
+        set[c >> 3] |= (unsigned char) (1 << (c & 7));
+    }
+}
+
+/* adds the bytes of the class escape 'c' (d, w or s) to 'set' */
+static void lre_set_class(unsigned char *set, char c) {
+    switch ( c ) {
+        case 'd':
+            lre_set_add(set, '0', '9');
+            break;
+        case 'w':
+            lre_set_add(set, '0', '9');
+            lre_set_add(set, 'a', 'z');
+            lre_set_add(set, 'A', 'Z');
+            lre_set_add(set, '_', '_');
+            break;
+        case 's':
+            lre_set_add(set, ' ', ' ');
+            lre_set_add(set, '\t', '\r'); /* \t \n \v \f \r */
+            break;
+    }
+}
+
+static void lre_set_negate(unsigned char *set) {
+    for ( int i = 0; i < 32; ++i ) {
+        set[i] = (unsigned char) ~set[i];
+    }
+}
+
+/* the byte an escape stands for */
+static int lre_escaped(char c) {
+    switch ( c ) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        default: return (unsigned char) c;
+    }
+}
+
+static int lre_parse_alt(struct lre_parser *);
+
+static int lre_parse_set(struct lre_parser *ps) {
+    int set = lre_new_set(ps);
+    int negate = 0;
+    if ( *ps->p == '^' ) {
+        negate = 1;
+        ps->p++;
+    }
+
+    int first = 1;
+    while ( *ps->p != ']' || first ) {
+        first = 0;
+        if ( *ps->p == '\0' ) {
+            ps->err = "Missing ']' in regular expression";
+            return -1;
+        }
+
+        int lo = (unsigned char) *ps->p++;
+        if ( lo == '\\' ) {
+            char c = *ps->p++;
+            if ( c == '\0' ) {
+                ps->err = "Trailing '\\' in regular expression";
+                return -1;
+            }
+            if ( strchr("dws", c) != NULL ) {
+                lre_set_class(ps->sets[set], c);
+                continue;
+            }
+            lo = lre_escaped(c);
+        }
+
+        int hi = lo;
+        if ( ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0' ) {
+            ps->p++;
+            hi = (unsigned char) *ps->p++;
+            if ( hi == '\\' ) {
+                if ( *ps->p == '\0' ) {
+                    ps->err = "Trailing '\\' in regular expression";
+                    return -1;
+                }
+                hi = lre_escaped(*ps->p++);
+            }
+            if ( hi < lo ) {
+                ps->err = "Invalid range in regular expression";
+                return -1;
+            }
+        }
+        lre_set_add(ps->sets[set], lo, hi);
+    }
+    ps->p++;
+
+    if ( negate ) {
+        lre_set_negate(ps->sets[set]);
+    }
+    return lre_node(ps, LRE_SET, set, -1, -1);
+}
+
+static int lre_parse_atom(struct lre_parser *ps) {
+    char c = *ps->p++;
+    int node, set;
+
+    switch ( c ) {
+        case '(':
+            if ( ps->p[0] == '?' && ps->p[1] == ':' ) {
+                ps->p += 2;
+                node = lre_parse_alt(ps);
+            } else {
+                if ( ps->groups == LRE_MAX_GROUPS ) {
+                    ps->err = "Too many groups in regular expression";
+                    return -1;
+                }
+                int group = (int) ++ps->groups;
+                node = lre_parse_alt(ps);
+                node = node < 0 ? node : lre_node(ps, LRE_GROUP, group, node, -1);
+            }
+            if ( node < 0 ) {
+                return node;
+            }
+            if ( *ps->p != ')' ) {
+                ps->err = "Missing ')' in regular expression";
+                return -1;
+            }
+            ps->p++;
+            return node;
+        case '[':
+            return lre_parse_set(ps);
+        case '.':
+            return lre_node(ps, LRE_ANY, 0, -1, -1);
+        case '^':
+            return lre_node(ps, LRE_BOL, 0, -1, -1);
+        case '$':
+            return lre_node(ps, LRE_EOL, 0, -1, -1);
+        case '*':
+        case '+':
+        case '?':
+            ps->err = "Nothing to repeat in regular expression";
+            return -1;
+        case '\\':
+            c = *ps->p++;
+            if ( c == '\0' ) {
+                ps->err = "Trailing '\\' in regular expression";
+                return -1;
+            }
+            if ( strchr("dwsDWS", c) != NULL ) {
+                set = lre_new_set(ps);
+                lre_set_class(ps->sets[set], (char) (c | 0x20));
+                if ( c >= 'A' && c <= 'Z' ) {
+                    lre_set_negate(ps->sets[set]);
+                }
+                return lre_node(ps, LRE_SET, set, -1, -1);
+            }
+            return lre_node(ps, LRE_BYTE, lre_escaped(c), -1, -1);
+        default:
+            return lre_node(ps, LRE_BYTE, (unsigned char) c, -1, -1);
+    }
+}
+
+static int lre_parse_count(struct lre_parser *ps, int *out) {
+    if ( *ps->p < '0' || *ps->p > '9' ) {
+        return 0;
+    }
+    long n = 0;
+    while ( *ps->p >= '0' && *ps->p <= '9' ) {
+        n = n * 10 + (*ps->p++ - '0');
+        if ( n > LRE_MAX_REPEAT ) {
+            n = LRE_MAX_REPEAT + 1;
+        }
+    }
+    *out = (int) n;
+    return 1;
+}
+
+/* '{n}', '{n,}' or '{n,m}'; returns 0 and leaves the input alone for a literal '{' */
+static int lre_parse_braces(struct lre_parser *ps, int *min, int *max) {
+    const char *start = ps->p;
+    ps->p++;
+    if ( !lre_parse_count(ps, min) ) {
+        ps->p = start;
+        return 0;
+    }
+    *max = *min;
+    if ( *ps->p == ',' ) {
+        ps->p++;
+        if ( !lre_parse_count(ps, max) ) {
+            *max = -1;
+        }
+    }
+    if ( *ps->p != '}' ) {
+        ps->p = start;
+        return 0;
+    }
+    ps->p++;
+    return 1;
+}
+
+static int lre_parse_repeat(struct lre_parser *ps) {
+    int node = lre_parse_atom(ps);
+
+    while ( node >= 0 ) {
+        int min, max;
+        char c = *ps->p;
+        if ( c == '*' ) {
+            min = 0;
+            max = -1;
+            ps->p++;
+        } else if ( c == '+' ) {
+            min = 1;
+            max = -1;
+            ps->p++;
+        } else if ( c == '?' ) {
+            min = 0;
+            max = 1;
+            ps->p++;
+        } else if ( c != '{' || !lre_parse_braces(ps, &min, &max) ) {
+            break;
+        }
+
+        if ( min > LRE_MAX_REPEAT || max > LRE_MAX_REPEAT || (max >= 0 && max < min) ) {
+            ps->err = "Invalid repetition count in regular expression";
+            return -1;
+        }
+
+        node = lre_node(ps, LRE_REPEAT, 0, node, -1);
+        ps->nodes[node].min = min;
+        ps->nodes[node].max = max;
+        if ( *ps->p == '?' ) {
+            ps->nodes[node].greedy = 0;
+            ps->p++;
+        }
+    }
+    return node;
+}
+
+static int lre_parse_cat(struct lre_parser *ps) {
+    int node = lre_node(ps, LRE_EMPTY, 0, -1, -1);
+    while ( *ps->p != '\0' && *ps->p != '|' && *ps->p != ')' ) {
+        int next = lre_parse_repeat(ps);
+        if ( next < 0 ) {
+            return next;
+        }
+        node = lre_node(ps, LRE_CAT, 0, node, next);
+    }
+    return node;
+}
+
+static int lre_parse_alt(struct lre_parser *ps) {
+    int node = lre_parse_cat(ps);
+    while ( node >= 0 && *ps->p == '|' ) {
+        ps->p++;
+        int other = lre_parse_cat(ps);
+        if ( other < 0 ) {
+            return other;
+        }
+        node = lre_node(ps, LRE_ALT, 0, node, other);
+    }
+    return node;
+}
+
+static int lre_emit(struct lre_parser *ps, enum lre_op op, int x, int y) {
+    struct lre *re = ps->re;
+    if ( re->count == LRE_MAX_INSTS ) {
+        ps->err = "Regular expression is too large";
+        return -1;
+    }
+    re->insts = lre_grow(re->insts, &ps->inst_cap, re->count, sizeof(struct lre_inst));
+    re->insts[re->count].op = op;
+    re->insts[re->count].x = x;
+    re->insts[re->count].y = y;
+    return (int) re->count++;
+}
+
+/* a split preferring to go on at the next instruction when 'greedy', and to 'target' otherwise */
+static void lre_patch_split(struct lre_parser *ps, int at, int target, int greedy) {
+    struct lre_inst *inst = &ps->re->insts[at];
+    inst->x = greedy ? at + 1 : target;
+    inst->y = greedy ? target : at + 1;
+}
+
+static int lre_compile_node(struct lre_parser *ps, int index) {
+    struct lre_node n = ps->nodes[index];
+    int at, jmp;
+
+    switch ( n.type ) {
+        case LRE_EMPTY:
+            return 0;
+        case LRE_BYTE:
+            return lre_emit(ps, LRE_OP_BYTE, n.value, 0) < 0 ? -1 : 0;
+        case LRE_ANY:
+            return lre_emit(ps, LRE_OP_ANY, 0, 0) < 0 ? -1 : 0;
+        case LRE_SET:
+            return lre_emit(ps, LRE_OP_SET, n.value, 0) < 0 ? -1 : 0;
+        case LRE_BOL:
+            return lre_emit(ps, LRE_OP_BOL, 0, 0) < 0 ? -1 : 0;
+        case LRE_EOL:
+            return lre_emit(ps, LRE_OP_EOL, 0, 0) < 0 ? -1 : 0;
+        case LRE_CAT:
+            if ( lre_compile_node(ps, n.left) < 0 ) {
+                return -1;
+            }
+            return lre_compile_node(ps, n.right);
+        case LRE_GROUP:
+            if ( lre_emit(ps, LRE_OP_SAVE, 2 * n.value, 0) < 0 || lre_compile_node(ps, n.left) < 0 ) {
+                return -1;
+            }
+            return lre_emit(ps, LRE_OP_SAVE, 2 * n.value + 1, 0) < 0 ? -1 : 0;
+        case LRE_ALT:
+            if ( (at = lre_emit(ps, LRE_OP_SPLIT, 0, 0)) < 0 || lre_compile_node(ps, n.left) < 0 ||
+                (jmp = lre_emit(ps, LRE_OP_JMP, 0, 0)) < 0 ) {
+                return -1;
+            }
+            lre_patch_split(ps, at, (int) ps->re->count, 1);
+            if ( lre_compile_node(ps, n.right) < 0 ) {
+                return -1;
+            }
+            ps->re->insts[jmp].x = (int) ps->re->count;
+            return 0;
+        case LRE_REPEAT:
+            for ( int i = 0; i < n.min; ++i ) {
+                if ( lre_compile_node(ps, n.left) < 0 ) {
+                    return -1;
+                }
+            }
+            if ( n.max < 0 ) {
+                /* loop: split to the body or past the jump back */
+                if ( (at = lre_emit(ps, LRE_OP_SPLIT, 0, 0)) < 0 || lre_compile_node(ps, n.left) < 0 ||
+                    lre_emit(ps, LRE_OP_JMP, at, 0) < 0 ) {
+                    return -1;
+                }
+                lre_patch_split(ps, at, (int) ps->re->count, n.greedy);
+                return 0;
+            }
+            /* each optional copy is skipped to the end, patched once it is known */
+            int first = (int) ps->re->count;
+            for ( int i = n.min; i < n.max; ++i ) {
+                if ( lre_emit(ps, LRE_OP_SPLIT, -1, 0) < 0 || lre_compile_node(ps, n.left) < 0 ) {
+                    return -1;
+                }
+            }
+            for ( int i = first; i < (int) ps->re->count; ++i ) {
+                struct lre_inst *inst = &ps->re->insts[i];
+                if ( inst->op == LRE_OP_SPLIT && inst->x == -1 ) {
+                    lre_patch_split(ps, i, (int) ps->re->count, n.greedy);
+                }
+            }
+            return 0;
+    }
+    return -1;
+}
+
+void lre_free(struct lre *re) {
+    if ( re == NULL ) {
+        return;
+    }
+    free(re->insts);
+    free(re->sets);
+    free(re);
+}
+
+/*
+ * Compiles 'pattern'. Returns NULL with a description of the problem in
+ * 'err' if the pattern is invalid.
+ */
+struct lre *lre_compile(const char *pattern, const char **err) {
+    struct lre_parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.p = pattern;
+
+    struct lre *re = calloc(1, sizeof(struct lre));
+    if ( re == NULL ) {
+        perror("Could not allocate regular expression");
+        exit(1);
+    }
+    ps.re = re;
+
+    int root = lre_parse_alt(&ps);
+    if ( root >= 0 && *ps.p == ')' ) {
+        ps.err = "Unmatched ')' in regular expression";
+        root = -1;
+    }
+
+    if ( root >= 0 && (lre_emit(&ps, LRE_OP_SAVE, 0, 0) < 0 || lre_compile_node(&ps, root) < 0 ||
+        lre_emit(&ps, LRE_OP_SAVE, 1, 0) < 0 || lre_emit(&ps, LRE_OP_MATCH, 0, 0) < 0) ) {
+        root = -1;
+    }
+
+    free(ps.nodes);
+    if ( root < 0 ) {
+        free(ps.sets);
+        lre_free(re);
+        *err = ps.err;
+        return NULL;
+    }
+    re->sets = ps.sets;
+    re->groups = ps.groups;
+    return re;
+}
+
+size_t lre_groups(const struct lre *re) {
+    return re->groups;
+}
+
+/* threads of one step of the VM in priority order */
+struct lre_list {
+    int *pcs;
+    long *caps; /* capture slots of every thread */
+    size_t count;
+};
+
+struct lre_vm {
+    const struct lre *re;
+    const char *s;
+    size_t len;
+    size_t ncaps;
+    unsigned *mark; /* generation at which an instruction was last added */
+    unsigned gen;
+};
+
+/* follows the jumps from 'pc' and adds the threads that consume a byte at 'sp' */
+static void lre_add(struct lre_vm *vm, struct lre_list *l, int pc, long *caps, size_t sp) {
+    if ( vm->mark[pc] == vm->gen ) {
+        return;
+    }
+    vm->mark[pc] = vm->gen;
+
+    const struct lre_inst *inst = &vm->re->insts[pc];
+    long saved;
+    switch ( inst->op ) {
+        case LRE_OP_JMP:
+            lre_add(vm, l, inst->x, caps, sp);
+            return;
+        case LRE_OP_SPLIT:
+            lre_add(vm, l, inst->x, caps, sp);
+            lre_add(vm, l, inst->y, caps, sp);
+            return;
+        case LRE_OP_SAVE:
+            saved = caps[inst->x];
+            caps[inst->x] = (long) sp;
+            lre_add(vm, l, pc + 1, caps, sp);
+            caps[inst->x] = saved;
+            return;
+        case LRE_OP_BOL:
+            if ( sp == 0 ) {
+                lre_add(vm, l, pc + 1, caps, sp);
+            }
+            return;
+        case LRE_OP_EOL:
+            if ( sp == vm->len ) {
+                lre_add(vm, l, pc + 1, caps, sp);
+            }
+            return;
+        default:
+            l->pcs[l->count] = pc;
+            memcpy(l->caps + l->count * vm->ncaps, caps, vm->ncaps * sizeof(long));
+            l->count++;
+            return;
+    }
+}
+
+/*
+ * Searches s[from..len) for the leftmost match, which has to span the
+ * whole of the subject when 'whole' is set. Returns 1 and fills 'caps'
+ * with 2 * (groups + 1) offsets into 's', -1 for groups that did not
+ * take part in the match, and 0 when nothing matched.
+ */
+int lre_search(const struct lre *re, const char *s, size_t len, size_t from, int whole, long *caps) {
+    struct lre_vm vm;
+    vm.re = re;
+    vm.s = s;
+    vm.len = len;
+    vm.ncaps = 2 * (re->groups + 1);
+    vm.mark = calloc(re->count, sizeof(unsigned));
+    vm.gen = 1;
+
+    struct lre_list lists[2];
+    for ( int i = 0; i < 2; ++i ) {
+        lists[i].pcs = malloc(re->count * sizeof(int));
+        lists[i].caps = malloc(re->count * vm.ncaps * sizeof(long));
+        lists[i].count = 0;
+    }
+    long *start = malloc(vm.ncaps * sizeof(long));
+    if ( vm.mark == NULL || lists[0].pcs == NULL || lists[0].caps == NULL ||
+        lists[1].pcs == NULL || lists[1].caps == NULL || start == NULL ) {
+        perror("Could not allocate regular expression matcher");
+        exit(1);
+    }
+    for ( size_t i = 0; i < vm.ncaps; ++i ) {
+        start[i] = -1;
+    }
+
+    struct lre_list *clist = &lists[0];
+    struct lre_list *nlist = &lists[1];
+    int matched = 0;
+
+    for ( size_t sp = from; ; ++sp ) {
+        /* a match starting here has the lowest priority of all */
+        if ( !matched && (!whole || sp == from) ) {
+            lre_add(&vm, clist, 0, start, sp);
+        }
+        if ( clist->count == 0 ) {
+            break;
+        }
+
+        vm.gen++;
+        for ( size_t i = 0; i < clist->count; ++i ) {
+            const struct lre_inst *inst = &re->insts[clist->pcs[i]];
+            long *tcaps = clist->caps + i * vm.ncaps;
+            unsigned char c = sp < len ? (unsigned char) s[sp] : 0;
+            int step = 0;
+
+            switch ( inst->op ) {
+                case LRE_OP_BYTE:
+                    step = sp < len && c == inst->x;
+                    break;
+                case LRE_OP_ANY:
+                    step = sp < len && c != '\n';
+                    break;
+                case LRE_OP_SET:
+                    step = sp < len && (re->sets[inst->x][c >> 3] & (1 << (c & 7)));
+                    break;
+                case LRE_OP_MATCH:
+                    if ( whole && sp != len ) {
+                        break;
+                    }
+                    matched = 1;
+                    memcpy(caps, tcaps, vm.ncaps * sizeof(long));
+                    /* the threads after this one have a lower priority */
+                    i = clist->count;
+                    break;
+                default:
+                    break;
+            }
+            if ( step ) {
+                lre_add(&vm, nlist, clist->pcs[i] + 1, tcaps, sp + 1);
+            }
+        }
+
+        struct lre_list *swap = clist;
+        clist = nlist;
+        nlist = swap;
+        nlist->count = 0;
+
+        if ( sp >= len ) {
+            break;
+        }
+    }
+
+    free(start);
+    for ( int i = 0; i < 2; ++i ) {
+        free(lists[i].pcs);
+        free(lists[i].caps);
+    }
+    free(vm.mark);
+    return matched;
+}
+
+static size_t lre_hash(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    for ( ; *s != '\0'; ++s ) {
+        h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+    }
+    return h;
+}
+
+void lre_cache_init(struct lre_cache *cache) {
+    memset(cache, 0, sizeof(struct lre_cache));
+}
+
+void lre_cache_destroy(struct lre_cache *cache) {
+    for ( size_t i = 0; i < LRE_CACHE_SIZE; ++i ) {
+        free(cache->entries[i].pattern);
+        lre_free(cache->entries[i].re);
+    }
+    memset(cache, 0, sizeof(struct lre_cache));
+}
+
+/*
+ * The compiled form of 'pattern', compiled on the first use and kept
+ * until it is the least recently used of the cached patterns. Invalid
+ * patterns are not cached; NULL is returned with the error in 'err'.
+ */
+struct lre *lre_cache_get(struct lre_cache *cache, const char *pattern, const char **err) {
+    size_t hash = lre_hash(pattern);
+    struct lre_cache_entry *victim = &cache->entries[0];
+
+    for ( size_t i = 0; i < LRE_CACHE_SIZE; ++i ) {
+        struct lre_cache_entry *entry = &cache->entries[i];
+        if ( entry->pattern != NULL && entry->hash == hash && strcmp(entry->pattern, pattern) == 0 ) {
+            entry->used = ++cache->tick;
+            return entry->re;
+        }
+        if ( entry->used < victim->used ) {
+            victim = entry;
+        }
+    }
+
+    struct lre *re = lre_compile(pattern, err);
+    if ( re == NULL ) {
+        return NULL;
+    }
+
+    char *copy = malloc(strlen(pattern) + 1);
+    if ( copy == NULL ) {
+        perror("Could not cache regular expression");
+        exit(1);
+    }
+    strcpy(copy, pattern);
+
+    free(victim->pattern);
+    lre_free(victim->re);
+    victim->hash = hash;
+    victim->pattern = copy;
+    victim->re = re;
+    victim->used = ++cache->tick;
+    return re;
+}
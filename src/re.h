@@ -0,0 +1,39 @@
+#ifndef LISPER_RE
+#define LISPER_RE
+
+#include <stdlib.h>
+
+/* compiled patterns kept by an interpreter */
+#define LRE_CACHE_SIZE 64
+
+/* capture groups a pattern may have besides the whole match */
+#define LRE_MAX_GROUPS 32
+
+struct lre;
+
+struct lre_cache_entry {
+    size_t hash;
+    char *pattern;
+    struct lre *re;
+    size_t used; /* tick of the last use; the least recently used entry is replaced */
+};
+
+/*
+ * Bounded cache of compiled regular expressions, so a pattern used in a
+ * loop is only compiled once.
+ */
+struct lre_cache {
+    struct lre_cache_entry entries[LRE_CACHE_SIZE];
+    size_t tick;
+};
+
+struct lre *lre_compile(const char *pattern, const char **err);
+void lre_free(struct lre *);
+size_t lre_groups(const struct lre *);
+int lre_search(const struct lre *, const char *s, size_t len, size_t from, int whole, long *caps);
+
+void lre_cache_init(struct lre_cache *);
+void lre_cache_destroy(struct lre_cache *);
+struct lre *lre_cache_get(struct lre_cache *, const char *pattern, const char **err);
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L /* fileno */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "reader.h"
+#include "context.h"
+#include "coro.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#define read _read
+#else
+#include <unistd.h>
+#endif
+
+void lreaders_init(struct lreaders *r) {
+    r->head = NULL;
+}
+
+static void lreader_del(struct lreader *reader) {
+    free(reader->data);
+    free(reader);
+}
+
+void lreaders_destroy(struct lreaders *r) {
+    struct lreader *reader = r->head;
+    while ( reader != NULL ) {
+        struct lreader *next = reader->next;
+        lreader_del(reader);
+        reader = next;
+    }
+    r->head = NULL;
+}
+
+/* the reader of 'fp', made on its first line; NULL if out of memory */
+static struct lreader *lreader_of(struct lreaders *r, FILE *fp) {
+    for ( struct lreader *reader = r->head; reader != NULL; reader = reader->next ) {
+        if ( reader->fp == fp ) {
+            return reader;
+        }
+    }
+    struct lreader *reader = calloc(1, sizeof(struct lreader));
+    if ( reader == NULL ) {
+        return NULL;
+    }
+    reader->data = malloc(LREADER_SIZE);
+    if ( reader->data == NULL ) {
+        free(reader);
+        return NULL;
+    }
+    reader->fp = fp;
+    reader->next = r->head;
+    r->head = reader;
+    return reader;
+}
+
+/* drops what was read ahead of 'fp'; its stream is closed or moved */
+static void lreader_forget(struct lreaders *r, FILE *fp) {
+    for ( struct lreader **link = &r->head; *link != NULL; link = &(*link)->next ) {
+        if ( (*link)->fp == fp ) {
+            struct lreader *reader = *link;
+            *link = reader->next;
+            lreader_del(reader);
+            return;
+        }
+    }
+}
+
+/*
+ * Refills the empty buffer of 'reader'. Other coroutines run while
+ * no input has arrived. Returns 0 at end of file or on an error.
+ */
+static int lreader_fill(struct lisper_ctx *ctx, struct lreader *reader) {
+    int fd = fileno(reader->fp);
+    if ( reader->eof || fd < 0 ) {
+        return 0;
+    }
+    lco_wait_readable(ctx, fd);
+    long n;
+    do {
+        n = (long) read(fd, reader->data, LREADER_SIZE);
+    } while ( n < 0 && errno == EINTR );
+    if ( n <= 0 ) {
+        /* a terminal may be read again after an end of file */
+        reader->eof = n < 0 || !isatty(fd);
+        return 0;
+    }
+    reader->pos = 0;
+    reader->len = (size_t) n;
+    return 1;
+}
+
+/* room for 'n' more bytes and a terminator after 'len' in '*buf' */
+static int lfile_reserve(char **buf, size_t *cap, size_t len, size_t n) {
+    size_t grown = *cap < 256 ? 256 : *cap;
+    while ( len + n >= grown ) {
+        grown *= 2;
+    }
+    if ( grown == *cap ) {
+        return 1;
+    }
+    char *resized = realloc(*buf, grown);
+    if ( resized == NULL ) {
+        return 0;
+    }
+    *buf = resized;
+    *cap = grown;
+    return 1;
+}
+
+/*
+ * Reads the next line of 'fp', including the newline, into the
+ * growable buffer '*buf' of capacity '*cap'. The buffer is reused
+ * between calls. Returns the length of the line, or -1 at end of file.
+ */
+long lfile_readline(FILE *fp, char **buf, size_t *cap) {
+    struct lisper_ctx *ctx = lisper_ctx_current();
+    struct lreader *reader = lreader_of(&ctx->readers, fp);
+    if ( reader == NULL || !lfile_reserve(buf, cap, 0, 1) ) {
+        return -1;
+    }
+
+    size_t len = 0;
+    (*buf)[0] = '\0';
+    while ( reader->pos < reader->len || lreader_fill(ctx, reader) ) {
+        const char *from = reader->data + reader->pos;
+        size_t avail = reader->len - reader->pos;
+        const char *newline = memchr(from, '\n', avail);
+        size_t n = newline != NULL ? (size_t) (newline - from) + 1 : avail;
+        if ( !lfile_reserve(buf, cap, len, n) ) {
+            break;
+        }
+        memcpy(*buf + len, from, n);
+        len += n;
+        (*buf)[len] = '\0';
+        reader->pos += n;
+        if ( newline != NULL ) {
+            return (long) len;
+        }
+    }
+
+    return len > 0 ? (long) len : -1;
+}
+
+/* closes 'fp' along with the input read ahead of it */
+int lfile_close(FILE *fp) {
+    lreader_forget(&lisper_ctx_current()->readers, fp);
+    return fclose(fp);
+}
+
+/* moves 'fp' back to its start, dropping the input read ahead of it */
+void lfile_rewind(FILE *fp) {
+    lreader_forget(&lisper_ctx_current()->readers, fp);
+    rewind(fp);
+}
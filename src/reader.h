@@ -0,0 +1,38 @@
+#ifndef LISPER_READER
+#define LISPER_READER
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bytes read from a descriptor at once */
+#define LREADER_SIZE 65536
+
+/*
+ * Input buffer of a file read line by line. Such files are read from
+ * their descriptors into a buffer of the interpreter rather than through
+ * stdio, so it is known when the next read has to wait for input and a
+ * coroutine can let the others run meanwhile. Copies of a file value
+ * share its stream, so the buffer is looked up by the stream.
+ */
+struct lreader {
+    FILE *fp;
+    char *data;
+    size_t pos; /* next byte to hand out */
+    size_t len; /* bytes read into 'data' */
+    int eof;
+    struct lreader *next;
+};
+
+/* the readers of the files of an interpreter */
+struct lreaders {
+    struct lreader *head;
+};
+
+void lreaders_init(struct lreaders *);
+void lreaders_destroy(struct lreaders *);
+
+long lfile_readline(FILE *, char **, size_t *);
+int lfile_close(FILE *);
+void lfile_rewind(FILE *);
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "region.h"
+
+/* alignment of every allocation; enough for any scalar */
+#define LREGION_ALIGN 16
+
+void lregion_init(struct lregion *r) {
+    r->chunk = NULL;
+    r->spare = NULL;
+}
+
+static void lregion_chunk_free(struct lregion_chunk *chunk) {
+    if ( chunk != NULL ) {
+        free(chunk->data);
+        free(chunk);
+    }
+}
+
+void lregion_destroy(struct lregion *r) {
+    while ( r->chunk != NULL ) {
+        struct lregion_chunk *prev = r->chunk->prev;
+        lregion_chunk_free(r->chunk);
+        r->chunk = prev;
+    }
+    lregion_chunk_free(r->spare);
+    r->spare = NULL;
+}
+
+void *lregion_alloc(struct lregion *r, size_t size) {
+    size = (size + LREGION_ALIGN - 1) & ~(size_t) (LREGION_ALIGN - 1);
+
+    struct lregion_chunk *chunk = r->chunk;
+    if ( chunk == NULL || chunk->size - chunk->used < size ) {
+        if ( r->spare != NULL && r->spare->size >= size ) {
+            chunk = r->spare;
+            r->spare = NULL;
+        } else {
+            size_t chunk_size = size > LREGION_CHUNK_SIZE ? size : LREGION_CHUNK_SIZE;
+            chunk = malloc(sizeof(struct lregion_chunk));
+            if ( chunk == NULL || (chunk->data = malloc(chunk_size)) == NULL ) {
+                perror("Could not allocate region");
+                exit(1);
+            }
+            chunk->size = chunk_size;
+        }
+        chunk->used = 0;
+        chunk->prev = r->chunk;
+        r->chunk = chunk;
+    }
+
+    void *mem = chunk->data + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+/* the current end of the region, to release to later */
+struct lregion_mark lregion_mark(const struct lregion *r) {
+    struct lregion_mark mark = { r->chunk, r->chunk != NULL ? r->chunk->used : 0 };
+    return mark;
+}
+
+/*
+ * Frees everything allocated after 'mark'. Only chunks started after the
+ * mark are visited, one when the region was not grown since.
+ */
+void lregion_release(struct lregion *r, struct lregion_mark mark) {
+    while ( r->chunk != mark.chunk ) {
+        struct lregion_chunk *chunk = r->chunk;
+        r->chunk = chunk->prev;
+        lregion_chunk_free(r->spare);
+        r->spare = chunk;
+    }
+    if ( r->chunk != NULL ) {
+        r->chunk->used = mark.used;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef LISPER_REGION
+#define LISPER_REGION
+
+#include <stdlib.h>
+
+/* bytes of a region chunk; larger allocations get a chunk of their own */
+#define LREGION_CHUNK_SIZE 65536
+
+struct lregion_chunk {
+    struct lregion_chunk *prev;
+    size_t size;
+    size_t used;
+    unsigned char *data;
+};
+
+/*
+ * Bump pointer allocator for memory with a last in, first out lifetime,
+ * such as the bindings of the scopes of calls. Nothing is freed by
+ * itself; releasing to a mark frees everything allocated after it in
+ * O(1).
+ */
+struct lregion {
+    struct lregion_chunk *chunk; /* chunk being bumped */
+    struct lregion_chunk *spare; /* last released chunk, kept so a call at a chunk boundary does not thrash */
+};
+
+struct lregion_mark {
+    struct lregion_chunk *chunk;
+    size_t used;
+};
+
+void lregion_init(struct lregion *);
+void lregion_destroy(struct lregion *);
+void *lregion_alloc(struct lregion *, size_t size);
+struct lregion_mark lregion_mark(const struct lregion *);
+void lregion_release(struct lregion *, struct lregion_mark);
+
+#endif
@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "seq.h"
+#include "value.h"
+#include "reader.h"
+#include "environment.h"
+#include "context.h"
+
+static struct lseq *lseq_new(enum lseq_kind kind) {
+    struct lseq *seq = calloc(1, sizeof(struct lseq));
+    if ( seq == NULL ) {
+        perror("Could not allocate sequence");
+        exit(1);
+    }
+    seq->refcount = 1;
+    seq->kind = kind;
+    return seq;
+}
+
+struct lseq *lseq_range(long long start, long long end, long long step) {
+    struct lseq *seq = lseq_new(LSEQ_RANGE);
+    seq->start = start;
+    seq->end = end;
+    seq->step = step;
+    return seq;
+}
+
+/* takes ownership of 'func' and 'seed' */
+struct lseq *lseq_iterate(struct lvalue *func, struct lvalue *seed) {
+    struct lseq *seq = lseq_new(LSEQ_ITERATE);
+    seq->func = func;
+    seq->value = seed;
+    return seq;
+}
+
+/* takes ownership of the string 'path'; the file is opened by each traversal */
+struct lseq *lseq_lines(struct lvalue *path) {
+    struct lseq *seq = lseq_new(LSEQ_LINES);
+    seq->value = path;
+    return seq;
+}
+
+/* takes ownership of 'qexpr' */
+struct lseq *lseq_list(struct lvalue *qexpr) {
+    struct lseq *seq = lseq_new(LSEQ_LIST);
+    seq->value = qexpr;
+    return seq;
+}
+
+/* a map or a filter of 'source' by 'func'; takes ownership of both */
+struct lseq *lseq_transform(enum lseq_kind kind, struct lvalue *func, struct lseq *source) {
+    struct lseq *seq = lseq_new(kind);
+    seq->func = func;
+    seq->source = source;
+    return seq;
+}
+
+/* takes ownership of 'source' */
+struct lseq *lseq_take(long long count, struct lseq *source) {
+    struct lseq *seq = lseq_new(LSEQ_TAKE);
+    seq->count = count;
+    seq->source = source;
+    return seq;
+}
+
+struct lseq *lseq_share(struct lseq *seq) {
+    seq->refcount++;
+    return seq;
+}
+
+void lseq_del(struct lseq *seq) {
+    while ( seq != NULL && --seq->refcount == 0 ) {
+        struct lseq *source = seq->source;
+        if ( seq->func != NULL ) {
+            lvalue_del(seq->func);
+        }
+        if ( seq->value != NULL ) {
+            lvalue_del(seq->value);
+        }
+        free(seq);
+        seq = source;
+    }
+}
+
+struct lseq_cursor *lseq_cursor_new(const struct lseq *seq) {
+    struct lseq_cursor *cursor = calloc(1, sizeof(struct lseq_cursor));
+    if ( cursor == NULL ) {
+        perror("Could not allocate sequence cursor");
+        exit(1);
+    }
+    cursor->seq = seq;
+    cursor->next = seq->kind == LSEQ_RANGE ? seq->start : seq->count;
+    if ( seq->source != NULL ) {
+        cursor->source = lseq_cursor_new(seq->source);
+    }
+    return cursor;
+}
+
+/* ends the traversal early; files are closed and pending elements dropped */
+void lseq_cursor_del(struct lseq_cursor *cursor) {
+    while ( cursor != NULL ) {
+        struct lseq_cursor *source = cursor->source;
+        if ( cursor->state != NULL ) {
+            lvalue_del(cursor->state);
+        }
+        if ( cursor->fp != NULL ) {
+            lfile_close(cursor->fp);
+        }
+        free(cursor->line);
+        free(cursor);
+        cursor = source;
+    }
+}
+
+/* (func x); borrows 'func' and consumes 'x' */
+static struct lvalue *lseq_apply(struct lenvironment *e, struct lvalue *func, struct lvalue *x) {
+    return lvalue_call(e, func, lvalue_add(lvalue_sexpr(), x));
+}
+
+/*
+ * Produces the next element of the traversal in 'out'. Returns 1 for an
+ * element, 0 at the end of the sequence and -1 with the error in 'out'
+ * when producing it failed. Nothing beyond the requested element is
+ * computed or read.
+ */
+int lseq_next(struct lenvironment *e, struct lseq_cursor *cursor, struct lvalue **out) {
+    const struct lseq *seq = cursor->seq;
+    struct lvalue *x = NULL;
+    int rc;
+
+    if ( cursor->done ) {
+        return 0;
+    }
+
+    /* an element is a step, so limits also hold over sequences that evaluate nothing */
+    struct lbudget *budget = &e->ctx->budget;
+    if ( ++budget->steps >= budget->check_at ) {
+        struct lvalue *err = lbudget_check(e->ctx);
+        if ( err != NULL ) {
+            *out = err;
+            return -1;
+        }
+    }
+
+    switch ( seq->kind ) {
+        case LSEQ_RANGE:
+            if ( seq->step > 0 ? cursor->next >= seq->end : cursor->next <= seq->end ) {
+                cursor->done = 1;
+                return 0;
+            }
+            *out = lvalue_int(cursor->next);
+            if ( seq->step > 0 ? cursor->next > LLONG_MAX - seq->step : cursor->next < LLONG_MIN - seq->step ) {
+                cursor->done = 1; /* the next one is past the integers */
+            } else {
+                cursor->next += seq->step;
+            }
+            return 1;
+
+        case LSEQ_ITERATE:
+            if ( cursor->state == NULL ) {
+                cursor->state = lvalue_copy(seq->value);
+            } else {
+                x = lseq_apply(e, seq->func, cursor->state);
+                cursor->state = NULL;
+                if ( x->type == LVAL_ERR ) {
+                    cursor->done = 1;
+                    *out = x;
+                    return -1;
+                }
+                cursor->state = x;
+            }
+            *out = lvalue_copy(cursor->state);
+            return 1;
+
+        case LSEQ_LINES:
+            if ( cursor->fp == NULL ) {
+                cursor->fp = fopen(seq->value->val.strval, "r");
+                if ( cursor->fp == NULL ) {
+                    cursor->done = 1;
+                    *out = lvalue_err("Could not open file '%s'. %s", seq->value->val.strval, strerror(errno));
+                    return -1;
+                }
+            }
+            long len = lfile_readline(cursor->fp, &cursor->line, &cursor->cap);
+            if ( len < 0 ) {
+                cursor->done = 1;
+                lfile_close(cursor->fp);
+                cursor->fp = NULL;
+                return 0;
+            }
+            if ( len > 0 && cursor->line[len - 1] == '\n' ) {
+                cursor->line[--len] = '\0';
+            }
+            *out = lvalue_str(cursor->line);
+            return 1;
+
+        case LSEQ_LIST:
+            if ( cursor->index == seq->value->val.l.count ) {
+                cursor->done = 1;
+                return 0;
+            }
+            *out = lvalue_copy(seq->value->val.l.cells[cursor->index++]);
+            return 1;
+
+        case LSEQ_MAP:
+            rc = lseq_next(e, cursor->source, &x);
+            if ( rc <= 0 ) {
+                cursor->done = 1;
+                *out = x;
+                return rc;
+            }
+            x = lseq_apply(e, seq->func, x);
+            if ( x->type == LVAL_ERR ) {
+                cursor->done = 1;
+                *out = x;
+                return -1;
+            }
+            *out = x;
+            return 1;
+
+        case LSEQ_FILTER:
+            while ( (rc = lseq_next(e, cursor->source, &x)) > 0 ) {
+                struct lvalue *keep = lseq_apply(e, seq->func, lvalue_copy(x));
+                if ( keep->type != LVAL_BOOL ) {
+                    cursor->done = 1;
+                    lvalue_del(x);
+                    if ( keep->type == LVAL_ERR ) {
+                        *out = keep;
+                    } else {
+                        *out = lvalue_err("Predicate of a filter returned '%s'; expected '%s'.",
+                            ltype_name(keep->type), ltype_name(LVAL_BOOL));
+                        lvalue_del(keep);
+                    }
+                    return -1;
+                }
+                int kept = keep->val.intval != 0;
+                lvalue_del(keep);
+                if ( kept ) {
+                    *out = x;
+                    return 1;
+                }
+                lvalue_del(x);
+                x = NULL;
+            }
+            cursor->done = 1;
+            *out = rc < 0 ? x : NULL;
+            return rc;
+
+        case LSEQ_TAKE:
+            if ( cursor->next <= 0 ) {
+                /* the source is not asked for more than is taken */
+                cursor->done = 1;
+                return 0;
+            }
+            cursor->next--;
+            rc = lseq_next(e, cursor->source, out);
+            if ( rc <= 0 ) {
+                cursor->done = 1;
+            }
+            return rc;
+    }
+    return 0;
+}
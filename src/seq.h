@@ -0,0 +1,64 @@
+#ifndef LISPER_SEQ
+#define LISPER_SEQ
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct lvalue;
+struct lenvironment;
+
+enum lseq_kind {
+    LSEQ_RANGE, /* integers from 'start' towards 'end' by 'step' */
+    LSEQ_ITERATE, /* 'value', (func value), (func (func value)), ... */
+    LSEQ_LINES, /* lines of the file at the path 'value' */
+    LSEQ_LIST, /* elements of the q-expression 'value' */
+    LSEQ_MAP, /* (func x) for every x of 'source' */
+    LSEQ_FILTER, /* x of 'source' for which (func x) is true */
+    LSEQ_TAKE /* the first 'count' elements of 'source' */
+};
+
+/*
+ * Lazy sequence. Describes how its elements are produced without
+ * producing any; the description is immutable and shared by every copy
+ * of the sequence value. Each traversal walks the sequence from the start
+ * with a cursor of its own, holding one element per stage at a time.
+ */
+struct lseq {
+    size_t refcount;
+    enum lseq_kind kind;
+    long long start;
+    long long end;
+    long long step;
+    long long count;
+    struct lvalue *func;
+    struct lvalue *value;
+    struct lseq *source;
+};
+
+/* position of a traversal; one per stage of the sequence */
+struct lseq_cursor {
+    const struct lseq *seq;
+    struct lseq_cursor *source;
+    long long next; /* next integer of a range; elements left to take */
+    size_t index; /* next element of a list */
+    struct lvalue *state; /* last element of an iteration */
+    FILE *fp; /* lines being read */
+    char *line;
+    size_t cap;
+    int done;
+};
+
+struct lseq *lseq_range(long long start, long long end, long long step);
+struct lseq *lseq_iterate(struct lvalue *func, struct lvalue *seed);
+struct lseq *lseq_lines(struct lvalue *path);
+struct lseq *lseq_list(struct lvalue *qexpr);
+struct lseq *lseq_transform(enum lseq_kind, struct lvalue *func, struct lseq *source);
+struct lseq *lseq_take(long long count, struct lseq *source);
+struct lseq *lseq_share(struct lseq *);
+void lseq_del(struct lseq *);
+
+struct lseq_cursor *lseq_cursor_new(const struct lseq *);
+void lseq_cursor_del(struct lseq_cursor *);
+int lseq_next(struct lenvironment *, struct lseq_cursor *, struct lvalue **);
+
+#endif
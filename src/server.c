@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "server.h"
+#include "execute.h"
+#include "builtin.h"
+#include "value.h"
+
+#ifdef _WIN32
+
+#define UNUSED(x) (void)(x)
+
+int exec_serve(struct lisper_ctx *ctx, struct lisper_params *params) {
+    UNUSED(ctx);
+    UNUSED(params);
+    fprintf(stderr, "Error: --serve is not supported on this platform\n");
+    return 1;
+}
+
+int exec_connect(struct lisper_params *params, int argc, char **argv) {
+    UNUSED(params);
+    UNUSED(argc);
+    UNUSED(argv);
+    fprintf(stderr, "Error: --connect is not supported on this platform\n");
+    return 1;
+}
+
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+/*
+ * Wire format.
+ * A request is a mode byte followed by NUL terminated strings, and ends
+ * when the client shuts down its writing end:
+ *   'c' <command>          evaluate a command, like 'lisper -c'
+ *   'f' <cwd> <argv[0]>... run the file named by the arguments, like 'lisper FILE',
+ *                          from the working directory of the client
+ * The response is everything the worker prints, followed by a NUL byte
+ * and a single byte exit status.
+ */
+enum {
+    REQUEST_COMMAND = 'c',
+    REQUEST_FILE = 'f'
+};
+
+static const int server_backlog = 64;
+
+static int socket_address(const char *path, struct sockaddr_un *addr) {
+    if ( strlen(path) >= sizeof(addr->sun_path) ) {
+        fprintf(stderr, "Error: socket path '%s' is too long\n", path);
+        return 1;
+    }
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while ( len > 0 ) {
+        ssize_t n = write(fd, buf, len);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return 1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Reads everything until the peer shuts down its writing end.
+ * The result is NUL terminated and the size excludes the terminator.
+ */
+static char *read_all(int fd, size_t *size) {
+    size_t cap = 4096;
+    size_t len = 0;
+    char *buf = malloc(cap);
+
+    while ( buf != NULL ) {
+        if ( len + 1 == cap ) {
+            cap *= 2;
+            char *resized = realloc(buf, cap);
+            if ( resized == NULL ) {
+                free(buf);
+                return NULL;
+            }
+            buf = resized;
+        }
+        ssize_t n = read(fd, buf + len, cap - len - 1);
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( n < 0 ) {
+            free(buf);
+            return NULL;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        len += n;
+    }
+
+    if ( buf != NULL ) {
+        buf[len] = '\0';
+        *size = len;
+    }
+    return buf;
+}
+
+/*
+ * Runs a single request in a forked worker. The worker shares the
+ * preloaded heap of the server copy-on-write, and prints straight
+ * into the connection.
+ */
+static int serve_request(struct lisper_ctx *ctx, int conn) {
+    size_t size = 0;
+    char *request = read_all(conn, &size);
+    if ( request == NULL || size == 0 ) {
+        free(request);
+        return 1;
+    }
+
+    dup2(conn, STDOUT_FILENO);
+    dup2(conn, STDERR_FILENO);
+
+    struct lisper_params params;
+    memset(&params, 0, sizeof(struct lisper_params));
+
+    int rc = 1;
+    if ( request[0] == REQUEST_COMMAND ) {
+        params.command = request + 1;
+        rc = exec_eval(ctx, &params);
+    } else if ( request[0] == REQUEST_FILE ) {
+        /* unpack the client argv; the file name is the last lisper argument */
+        char *cwd = request + 1;
+        size_t first = strlen(cwd) + 2;
+        int argc = 0;
+        for ( size_t i = first; i < size; i += strlen(request + i) + 1 ) {
+            argc++;
+        }
+        char **argv = malloc((argc + 1) * sizeof(char *));
+        int n = 0;
+        for ( size_t i = first; i < size; i += strlen(request + i) + 1 ) {
+            argv[n++] = request + i;
+        }
+        argv[n] = NULL;
+
+        if ( chdir(cwd) != 0 ) {
+            printf("Error: Could not change to directory '%s'. %s\n", cwd, strerror(errno));
+        } else if ( parse_prg_params(argc, argv, &params) == 0 && params.filename != NULL ) {
+            ctx->args.argc = argc;
+            ctx->args.argv = argv;
+            rc = exec_filein(ctx, &params);
+        } else {
+            printf("Error: Malformed file request\n");
+        }
+    } else {
+        printf("Error: Unknown request type\n");
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    char trailer[2] = { '\0', (char) rc };
+    write_all(conn, trailer, sizeof(trailer));
+    return rc;
+}
+
+int exec_serve(struct lisper_ctx *ctx, struct lisper_params *params) {
+    for ( int i = 0; i < params->preload_count; ++i ) {
+        struct lvalue *args = lvalue_add(lvalue_sexpr(), lvalue_str(params->preload[i]));
+        struct lvalue *x = builtin_load(ctx->env, args);
+        if ( x->type == LVAL_ERR ) {
+            lvalue_println(x);
+            lvalue_del(x);
+            return 1;
+        }
+        lvalue_del(x);
+    }
+
+    struct sockaddr_un addr;
+    if ( socket_address(params->serve, &addr) != 0 ) {
+        return 1;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( server < 0 ) {
+        perror("Could not create server socket");
+        return 1;
+    }
+
+    unlink(params->serve);
+    if ( bind(server, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+         listen(server, server_backlog) != 0 ) {
+        perror("Could not listen on server socket");
+        close(server);
+        return 1;
+    }
+
+    /* workers are reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+    fflush(stdout);
+#if defined(__linux__)
+    pid_t self = getpid();
+#endif
+
+    while ( 1 ) {
+        int conn = accept(server, NULL, NULL);
+        if ( conn < 0 ) {
+            if ( errno == EINTR || errno == ECONNABORTED ) {
+                continue;
+            }
+            perror("Could not accept connection");
+            break;
+        }
+
+        pid_t pid = fork();
+        if ( pid == 0 ) {
+            close(server);
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+#if defined(__linux__)
+            /* a worker does not outlive its server */
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if ( getppid() != self ) {
+                _exit(1);
+            }
+#endif
+            /* stop evaluating once the client hangs up */
+            ctx->budget.hangup_fd = conn;
+            int rc = serve_request(ctx, conn);
+            close(conn);
+            _exit(rc);
+        } else if ( pid < 0 ) {
+            perror("Could not fork worker");
+        }
+        close(conn);
+    }
+
+    close(server);
+    unlink(params->serve);
+    return 1;
+}
+
+int exec_connect(struct lisper_params *params, int argc, char **argv) {
+    struct sockaddr_un addr;
+    if ( socket_address(params->connect, &addr) != 0 ) {
+        return 1;
+    }
+
+    int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( conn < 0 || connect(conn, (struct sockaddr *) &addr, sizeof(addr)) != 0 ) {
+        perror("Could not connect to lisper server");
+        return 1;
+    }
+
+    int failed = 0;
+    if ( params->command != NULL ) {
+        char mode = REQUEST_COMMAND;
+        failed |= write_all(conn, &mode, 1);
+        failed |= write_all(conn, params->command, strlen(params->command) + 1);
+    } else if ( params->filename != NULL ) {
+        char mode = REQUEST_FILE;
+        char cwd[4096];
+        if ( getcwd(cwd, sizeof(cwd)) == NULL ) {
+            perror("Could not get working directory");
+            close(conn);
+            return 1;
+        }
+        failed |= write_all(conn, &mode, 1);
+        failed |= write_all(conn, cwd, strlen(cwd) + 1);
+        for ( int i = 0; i < argc; ++i ) {
+            failed |= write_all(conn, argv[i], strlen(argv[i]) + 1);
+        }
+    } else {
+        fprintf(stderr, "Error: --connect needs either -c <COMMAND> or a FILE\n");
+        close(conn);
+        return 1;
+    }
+    shutdown(conn, SHUT_WR);
+
+    if ( failed ) {
+        perror("Could not send request");
+        close(conn);
+        return 1;
+    }
+
+    /* stream the output until the trailer; the status byte follows the NUL */
+    char buf[4096];
+    int rc = 1;
+    int in_trailer = 0;
+    ssize_t n;
+    while ( (n = read(conn, buf, sizeof(buf))) != 0 ) {
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            break;
+        }
+        char *start = buf;
+        if ( !in_trailer ) {
+            char *nul = memchr(buf, '\0', n);
+            if ( nul == NULL ) {
+                fwrite(buf, 1, n, stdout);
+                continue;
+            }
+            fwrite(buf, 1, nul - buf, stdout);
+            in_trailer = 1;
+            start = nul + 1;
+        }
+        if ( start < buf + n ) {
+            rc = (unsigned char) buf[n - 1];
+        }
+    }
+
+    close(conn);
+    return rc;
+}
+
+#endif
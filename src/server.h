@@ -0,0 +1,11 @@
+#ifndef LISPER_SERVER
+#define LISPER_SERVER
+
+#include "context.h"
+#include "prgparams.h"
+
+int exec_serve(struct lisper_ctx *, struct lisper_params *);
+
+int exec_connect(struct lisper_params *, int argc, char **argv);
+
+#endif
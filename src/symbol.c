@@ -0,0 +1,107 @@
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbol.h"
+
+static const size_t lsymtab_initial_capacity = 256;
+
+/*
+ * FNV-1a hash of a symbol name
+ */
+size_t lsymbol_hash(const char *name) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for ( ; *name != '\0'; ++name ) {
+        h ^= (unsigned char) *name;
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t) h;
+}
+
+void lsymtab_init(struct lsymtab *tab) {
+    tab->capacity = lsymtab_initial_capacity;
+    tab->count = 0;
+    tab->buckets = calloc(tab->capacity, sizeof(struct lsymbol *));
+}
+
+void lsymtab_destroy(struct lsymtab *tab) {
+    for ( size_t i = 0; i < tab->capacity; ++i ) {
+        struct lsymbol *iter = tab->buckets[i];
+        while ( iter != NULL ) {
+            struct lsymbol *next = iter->next;
+            free(iter);
+            iter = next;
+        }
+    }
+    free(tab->buckets);
+    tab->buckets = NULL;
+    tab->capacity = 0;
+    tab->count = 0;
+}
+
+static void lsymtab_grow(struct lsymtab *tab) {
+    size_t capacity = tab->capacity * 2;
+    struct lsymbol **buckets = calloc(capacity, sizeof(struct lsymbol *));
+    if ( buckets == NULL ) {
+        return; /* keep the longer chains */
+    }
+
+    for ( size_t i = 0; i < tab->capacity; ++i ) {
+        struct lsymbol *iter = tab->buckets[i];
+        while ( iter != NULL ) {
+            struct lsymbol *next = iter->next;
+            size_t j = iter->hash & (capacity - 1);
+            iter->next = buckets[j];
+            buckets[j] = iter;
+            iter = next;
+        }
+    }
+
+    free(tab->buckets);
+    tab->buckets = buckets;
+    tab->capacity = capacity;
+}
+
+/*
+ * Returns the interned copy of 'name'. The returned string is owned by
+ * the symbol table and lives as long as the table.
+ */
+char *lsymtab_intern(struct lsymtab *tab, const char *name) {
+    size_t hash = lsymbol_hash(name);
+    struct lsymbol *iter = tab->buckets[hash & (tab->capacity - 1)];
+
+    for ( ; iter != NULL; iter = iter->next ) {
+        if ( iter->hash == hash && strcmp(iter->name, name) == 0 ) {
+            return iter->name;
+        }
+    }
+
+    if ( tab->count >= tab->capacity ) {
+        lsymtab_grow(tab);
+    }
+
+    size_t len = strlen(name);
+    struct lsymbol *sym = malloc(sizeof(struct lsymbol) + len + 1);
+    if ( sym == NULL ) {
+        return NULL;
+    }
+    sym->hash = hash;
+    sym->global = NULL;
+    sym->shadows = 0;
+    sym->special = NULL;
+    memcpy(sym->name, name, len + 1);
+
+    size_t i = hash & (tab->capacity - 1);
+    sym->next = tab->buckets[i];
+    tab->buckets[i] = sym;
+    tab->count++;
+
+    return sym->name;
+}
+
+/*
+ * The symbol record of an interned name
+ */
+struct lsymbol *lsymbol_of(const char *name) {
+    return (struct lsymbol *) (name - offsetof(struct lsymbol, name));
+}
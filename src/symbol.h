@@ -0,0 +1,40 @@
+#ifndef LISPER_SYMBOL
+#define LISPER_SYMBOL
+
+#include <stdlib.h>
+
+struct lenvironment_entry;
+struct lspecial_form;
+
+/*
+ * Interned symbol name. Every symbol with the same name in an
+ * interpreter shares one record, so symbols compare by pointer.
+ *
+ * The record doubles as the inline cache of every reference to the
+ * name: 'global' is the binding in the global environment, and
+ * 'shadows' counts the bindings of the name in other environments.
+ * While nothing shadows the name, every lookup resolves to 'global'.
+ */
+struct lsymbol {
+    size_t hash;
+    struct lsymbol *next; /* next symbol in the same bucket */
+    struct lenvironment_entry *global; /* global binding or NULL */
+    size_t shadows; /* number of non-global bindings */
+    const struct lspecial_form *special; /* special form named by the symbol or NULL */
+    char name[];
+};
+
+struct lsymtab {
+    struct lsymbol **buckets;
+    size_t capacity;
+    size_t count;
+};
+
+void lsymtab_init(struct lsymtab *);
+void lsymtab_destroy(struct lsymtab *);
+char *lsymtab_intern(struct lsymtab *, const char *);
+
+struct lsymbol *lsymbol_of(const char *);
+size_t lsymbol_hash(const char *);
+
+#endif
@@ -5,11 +5,22 @@
 #include "value.h"
 #include "environment.h"
 #include "mempool.h"
-
-extern struct mempool *lvalue_mp;
-
-struct lvalue *builtin_list(struct lenvironment *, struct lvalue *);
-struct lvalue *builtin_eval(struct lenvironment *, struct lvalue *);
+#include "context.h"
+#include "memo.h"
+#include "seq.h"
+#include "coro.h"
+#include "number.h"
+#include "writer.h"
+#include "symbol.h"
+#include "builtin.h"
+#include "jit.h"
+#include "probe.h"
+
+/* lvalues are served from the pool of the current interpreter context */
+#define lvalue_mp (lisper_ctx_current()->lvalue_mp)
+
+/* buckets of the scope of a function call */
+#define CALL_SCOPE_BUCKETS 8
 
 struct lvalue *lvalue_int(long long num) {
     struct lvalue *val = mempool_take(lvalue_mp);
@@ -46,17 +57,21 @@ struct lvalue *lvalue_err(char *fmt, ...) {
     return val;
 }
 
+/*
+ * Symbols are interned; the name is shared by every symbol
+ * with that name and is owned by the symbol table of the context.
+ */
 struct lvalue *lvalue_sym(char* sym) {
     struct lvalue *val = mempool_take(lvalue_mp);
     val->type = LVAL_SYM;
-    val->val.strval = malloc(strlen(sym) + 1);
-    strcpy(val->val.strval, sym);
+    val->val.strval = lsymtab_intern(&lisper_ctx_current()->symbols, sym);
     return val;
 }
 
 struct lvalue *lvalue_sexpr(void) {
     struct lvalue *val = mempool_take(lvalue_mp);
     val->type = LVAL_SEXPR;
+    val->hash = 0;
     val->val.l.count = 0;
     val->val.l.cells = NULL;
     return val;
@@ -65,6 +80,7 @@ struct lvalue *lvalue_sexpr(void) {
 struct lvalue *lvalue_qexpr(void) {
     struct lvalue *val = mempool_take(lvalue_mp);
     val->type = LVAL_QEXPR;
+    val->hash = 0;
     val->val.l.count = 0;
     val->val.l.cells = NULL;
     return val;
@@ -78,22 +94,75 @@ struct lvalue *lvalue_str(char *s) {
     return v;
 }
 
-struct lvalue *lvalue_builtin(struct lvalue *( *f)(struct lenvironment *, struct lvalue *)) {
+struct lvalue *lvalue_builtin(const struct lbuiltin *b) {
     struct lvalue *val = mempool_take(lvalue_mp);
     val->type = LVAL_BUILTIN;
-    val->val.builtin = f;
+    val->val.builtin = b;
     return val;
 }
 
-struct lfunction *lfunc_new(struct lenvironment *env, struct lvalue *formals, struct lvalue *body) {
+struct lfunction *lfunc_new(struct lvalue *formals, struct lvalue *body) {
     struct lfunction *new = malloc(sizeof(struct lfunction));
-    new->name = NULL;
-    new->env = env;
+    new->refcount = 1;
     new->formals = formals;
     new->body = body;
+    new->arity = formals->val.l.count;
+    new->variadic = 0;
+    new->calls = 0;
+    new->jit = NULL;
+    new->native = NULL;
+    new->name = NULL;
+    for ( size_t i = 0; i < formals->val.l.count; ++i ) {
+        if ( strcmp(formals->val.l.cells[i]->val.strval, "&") == 0 ) {
+            new->arity = i;
+            new->variadic = 1;
+            break;
+        }
+    }
     return new;
 }
 
+void lfunc_del(struct lfunction *func) {
+    if ( --func->refcount > 0 ) {
+        return;
+    }
+    ljit_free(func->jit);
+    lvalue_del(func->formals);
+    lvalue_del(func->body);
+    free(func);
+}
+
+/*
+ * Partial application of 'func' to the 'argc' values of 'argv';
+ * takes ownership of the values, but not of the array.
+ */
+struct lvalue *lvalue_pap(struct lfunction *func, size_t argc, struct lvalue **argv) {
+    struct lpap *pap = malloc(sizeof(struct lpap) + argc * sizeof(struct lvalue *));
+    pap->refcount = 1;
+    pap->fun = func;
+    func->refcount++;
+    pap->argc = argc;
+    for ( size_t i = 0; i < argc; ++i ) {
+        pap->argv[i] = argv[i];
+    }
+
+    struct lvalue *nw = mempool_take(lvalue_mp);
+    nw->type = LVAL_PAP;
+    nw->val.pap = pap;
+    return nw;
+}
+
+void lpap_del(struct lpap *pap) {
+    if ( --pap->refcount > 0 ) {
+        return;
+    }
+    for ( size_t i = 0; i < pap->argc; ++i ) {
+        lvalue_del(pap->argv[i]);
+    }
+    lfunc_del(pap->fun);
+    free(pap);
+}
+
 struct lfile *lfile_new(struct lvalue *path, struct lvalue *mode, FILE *fp) {
     struct lfile *new = malloc(sizeof(struct lfile));
     new->path = path;
@@ -102,10 +171,10 @@ struct lfile *lfile_new(struct lvalue *path, struct lvalue *mode, FILE *fp) {
     return new;
 }
 
-struct lvalue *lvalue_lambda(struct lvalue *formals, struct lvalue *body, size_t envcap) {
+struct lvalue *lvalue_lambda(struct lvalue *formals, struct lvalue *body) {
     struct lvalue *nw = mempool_take(lvalue_mp);
     nw->type = LVAL_FUNCTION;
-    nw->val.fun = lfunc_new(lenvironment_new(envcap), formals, body);
+    nw->val.fun = lfunc_new(formals, body);
     return nw;
 }
 
@@ -116,10 +185,40 @@ struct lvalue *lvalue_file(struct lvalue *path, struct lvalue *mode, FILE *fp) {
     return nw;
 }
 
+/*
+ * Wraps 'func' in a cache of at most 'capacity' results, or returns an
+ * error if the cache could not be allocated. Takes ownership of 'func'.
+ */
+struct lvalue *lvalue_memo(struct lvalue *func, size_t capacity) {
+    struct lmemo *memo = lmemo_new(func, capacity);
+    if ( memo == NULL ) {
+        lvalue_del(func);
+        return lvalue_err("Could not allocate the cache of a memoized function.");
+    }
+    struct lvalue *nw = mempool_take(lvalue_mp);
+    nw->type = LVAL_MEMO;
+    nw->val.memo = memo;
+    return nw;
+}
+
+/* takes ownership of 'seq' */
+struct lvalue *lvalue_seq(struct lseq *seq) {
+    struct lvalue *nw = mempool_take(lvalue_mp);
+    nw->type = LVAL_SEQ;
+    nw->val.seq = seq;
+    return nw;
+}
+
+/* takes ownership of 'chan' */
+struct lvalue *lvalue_chan(struct lchan *chan) {
+    struct lvalue *nw = mempool_take(lvalue_mp);
+    nw->type = LVAL_CHAN;
+    nw->val.chan = chan;
+    return nw;
+}
 
 void lvalue_del(struct lvalue *val) {
     struct lfile *file;
-    struct lfunction *func;
     switch (val->type) {
         case LVAL_FLOAT:
         case LVAL_INT:
@@ -127,11 +226,10 @@ void lvalue_del(struct lvalue *val) {
         case LVAL_BOOL:
             break;
         case LVAL_FUNCTION:
-            func = val->val.fun;
-            lenvironment_del(func->env);
-            lvalue_del(func->formals);
-            lvalue_del(func->body);
-            free(func);
+            lfunc_del(val->val.fun);
+            break;
+        case LVAL_PAP:
+            lpap_del(val->val.pap);
             break;
         case LVAL_FILE:
             file = val->val.file;
@@ -139,8 +237,18 @@ void lvalue_del(struct lvalue *val) {
             lvalue_del(file->mode);
             free(file);
             break;
-        case LVAL_ERR:
+        case LVAL_MEMO:
+            lmemo_del(val->val.memo);
+            break;
+        case LVAL_SEQ:
+            lseq_del(val->val.seq);
+            break;
+        case LVAL_CHAN:
+            lchan_del(val->val.chan);
+            break;
         case LVAL_SYM:
+            break;
+        case LVAL_ERR:
         case LVAL_STR:
             free(val->val.strval);
             break;
@@ -157,128 +265,149 @@ void lvalue_del(struct lvalue *val) {
 
 
 /**
- * Prints lvalue expressions (such as sexprs) given the prefix,
+ * Writes lvalue expressions (such as sexprs) given the prefix,
  * suffix and delimiter
  */
-void lvalue_expr_print(struct lvalue *val, char prefix, char suffix, char delimiter) {
-    putchar(prefix);
+static void lvalue_expr_write(struct lwriter *w, struct lvalue *val, char prefix, char suffix, char delimiter) {
+    lwriter_putc(w, prefix);
 
     size_t len = val->val.l.count;
 
-    if ( len > 0 ) lvalue_print(val->val.l.cells[0]);
+    if ( len > 0 ) lvalue_write(w, val->val.l.cells[0]);
 
     for ( size_t i = 1; i < len; i++ ) {
-        putchar(delimiter);
-        lvalue_print(val->val.l.cells[i]);
+        lwriter_putc(w, delimiter);
+        lvalue_write(w, val->val.l.cells[i]);
     }
 
-    putchar(suffix);
-}
-
-/**
- * Escapes the string value of the input lvalue
- * and prints the value to the stdout
- */
-void lvalue_print_str(struct lvalue *v) {
-    char *escaped = malloc(strlen(v->val.strval) + 1);
-    strcpy(escaped, v->val.strval);
-
-    escaped = mpcf_escape(escaped);
-    printf("\"%s\"", escaped);
-
-    free(escaped);
+    lwriter_putc(w, suffix);
 }
 
 /**
- * Prints the lvalue contents to stdout
+ * Renders the lvalue into the writer 'w', as print shows it
  */
-void lvalue_print(struct lvalue *val) {
+void lvalue_write(struct lwriter *w, struct lvalue *val) {
     switch ( val->type ) {
         case LVAL_FLOAT:
-            printf("%lf", val->val.floatval);
+            lwriter_double(w, val->val.floatval);
             break;
         case LVAL_INT:
-            printf("%lli", val->val.intval);
+            lwriter_int(w, val->val.intval);
             break;
         case LVAL_BOOL:
             if ( val->val.intval == 0 ) {
-                printf("false");
+                lwriter_puts(w, "false");
             } else {
-                printf("true");
+                lwriter_puts(w, "true");
             }
             break;
         case LVAL_ERR:
-            printf("Error: %s", val->val.strval);
+            lwriter_puts(w, "Error: ");
+            lwriter_puts(w, val->val.strval);
             break;
         case LVAL_SYM:
-            printf("%s", val->val.strval);
+            lwriter_puts(w, val->val.strval);
             break;
         case LVAL_STR:
-            lvalue_print_str(val);
+            lwriter_putc(w, '"');
+            lwriter_escaped(w, val->val.strval);
+            lwriter_putc(w, '"');
             break;
         case LVAL_SEXPR:
-            lvalue_expr_print(val, '(', ')', ' ');
+            lvalue_expr_write(w, val, '(', ')', ' ');
             break;
         case LVAL_QEXPR:
-            lvalue_expr_print(val, '{', '}', ' ');
+            lvalue_expr_write(w, val, '{', '}', ' ');
             break;
         case LVAL_FUNCTION:
-            printf("(\\ ");
-            lvalue_print(val->val.fun->formals);
-            putchar(' ');
-            lvalue_print(val->val.fun->body);
-            putchar(')');
+            lwriter_puts(w, "(\\ ");
+            lvalue_write(w, val->val.fun->formals);
+            lwriter_putc(w, ' ');
+            lvalue_write(w, val->val.fun->body);
+            lwriter_putc(w, ')');
+            break;
+        case LVAL_PAP:
+            /* printed as the function of the formals left unbound */
+            lwriter_puts(w, "(\\ {");
+            for ( size_t i = val->val.pap->argc; i < val->val.pap->fun->formals->val.l.count; ++i ) {
+                if ( i > val->val.pap->argc ) {
+                    lwriter_putc(w, ' ');
+                }
+                lvalue_write(w, val->val.pap->fun->formals->val.l.cells[i]);
+            }
+            lwriter_puts(w, "} ");
+            lvalue_write(w, val->val.pap->fun->body);
+            lwriter_putc(w, ')');
             break;
         case LVAL_BUILTIN:
-            printf("<builtin>");
+            lwriter_puts(w, "<builtin>");
+            break;
+        case LVAL_MEMO:
+            lwriter_puts(w, "<memo ");
+            lvalue_write(w, val->val.memo->func);
+            lwriter_putc(w, '>');
+            break;
+        case LVAL_SEQ:
+            lwriter_puts(w, "<sequence>");
+            break;
+        case LVAL_CHAN:
+            lwriter_puts(w, "<channel>");
             break;
         case LVAL_FILE:
-            printf("<file ");
-            lvalue_print(val->val.file->path);
-            printf(" @ mode ");
-            lvalue_print(val->val.file->mode);
-            printf(">");
+            lwriter_puts(w, "<file ");
+            lvalue_write(w, val->val.file->path);
+            lwriter_puts(w, " @ mode ");
+            lvalue_write(w, val->val.file->mode);
+            lwriter_putc(w, '>');
             break;
     }
 }
 
-void lvalue_println(struct lvalue *val) {
-    lvalue_print(val);
-    putchar('\n');
+/**
+ * Prints the lvalue contents to stdout
+ */
+void lvalue_print(struct lvalue *val) {
+    struct lwriter *w = &lisper_ctx_current()->out;
+    lvalue_write(w, val);
+    lwriter_flush(w);
 }
 
-enum {
-    LREAD_FLOAT = 0,
-    LREAD_INT = 1
-};
-
-struct lvalue *lvalue_read_num(mpc_ast_t *t, int choice) {
+void lvalue_println(struct lvalue *val) {
+    struct lwriter *w = &lisper_ctx_current()->out;
+    lvalue_write(w, val);
+    lwriter_putc(w, '\n');
+    lwriter_flush(w);
+}
 
-    int code = 0;
-    long long int int_read = 0;
-    double float_read = 0.0;
+/* a number token is a float when it has a fraction or an exponent */
+struct lvalue *lvalue_read_num(mpc_ast_t *t) {
+    const char *end = NULL;
+    enum lnumber_status status;
 
-    switch (choice) {
-        case LREAD_FLOAT:
-            code = sscanf(t->contents, "%lf", &float_read);
+    if ( strpbrk(t->contents, ".eE") != NULL ) {
+        double float_read = 0.0;
+        status = lnumber_parse_float(t->contents, &end, &float_read);
 
-            if ( code == 1 ) {
-                return lvalue_float(float_read);
-            }
-            break;
-        case LREAD_INT:
-            code = sscanf(t->contents, "%lli", &int_read);
+        if ( status == LNUMBER_OK && *end == '\0' ) {
+            return lvalue_float(float_read);
+        }
+    } else {
+        long long int int_read = 0;
+        status = lnumber_parse_int(t->contents, &end, &int_read);
 
-            if ( code == 1 ) {
-                return lvalue_int(int_read);
-            }
-            break;
+        if ( status == LNUMBER_OK && *end == '\0' ) {
+            return lvalue_int(int_read);
+        }
     }
 
+    if ( status == LNUMBER_RANGE ) {
+        return lvalue_err("Number '%s' is out of range.", t->contents);
+    }
     return lvalue_err("Cloud not parse '%s' as a number.", t->contents);
 }
 
 struct lvalue *lvalue_add(struct lvalue *val, struct lvalue *other) {
+    val->hash = 0;
     val->val.l.count++;
     struct lvalue **resized_cells = realloc(val->val.l.cells, val->val.l.count * sizeof(struct lvalue *));
     if ( resized_cells == NULL ) {
@@ -293,6 +422,7 @@ struct lvalue *lvalue_add(struct lvalue *val, struct lvalue *other) {
 }
 
 struct lvalue *lvalue_offer(struct lvalue *val, struct lvalue *other) {
+    val->hash = 0;
     val->val.l.count++;
     struct lvalue **resized = realloc(val->val.l.cells, val->val.l.count * sizeof(struct lvalue*));
         // resize the memory buffer to carry another cell
@@ -368,12 +498,8 @@ struct lvalue *lvalue_read(mpc_ast_t *t) {
         return lvalue_read_str(t);
     }
 
-    if ( strstr(t->tag, "float") ) {
-        return lvalue_read_num(t, LREAD_FLOAT);
-    }
-
-    if ( strstr(t->tag, "integer") ) {
-        return lvalue_read_num(t, LREAD_INT);
+    if ( strstr(t->tag, "number") ) {
+        return lvalue_read_num(t);
     }
 
     if ( strstr(t->tag, "symbol") ) {
@@ -402,6 +528,11 @@ struct lvalue *lvalue_read(mpc_ast_t *t) {
         val = lvalue_add(val, lvalue_read(child));
     }
 
+    if ( val->type == LVAL_QEXPR ) {
+        /* literal data; hash it up front so comparisons can use the hash */
+        lvalue_hash(val);
+    }
+
     return val;
 }
 
@@ -413,6 +544,7 @@ struct lvalue *lvalue_pop(struct lvalue *v, int i) {
     struct lvalue *x = v->val.l.cells[i];
     memmove(v->val.l.cells + i, v->val.l.cells + (i + 1), sizeof(struct lvalue *) * (v->val.l.count - i - 1));
     v->val.l.count--;
+    v->hash = 0;
 
     struct lvalue **cs = realloc(v->val.l.cells, v->val.l.count * sizeof(struct lvalue *));
     if ( !cs && v->val.l.count > 0 ) {
@@ -441,17 +573,19 @@ struct lvalue *lvalue_take(struct lvalue *v, int i) {
 struct lvalue *lvalue_copy(struct lvalue *v) {
     struct lvalue *x = mempool_take(lvalue_mp);
     x->type = v->type;
+    x->hash = v->hash;
     struct lvalue *p;
     FILE *fp;
     struct lvalue *m;
 
     switch(v->type) {
         case LVAL_FUNCTION:
-            x->val.fun = lfunc_new(
-                lenvironment_copy(v->val.fun->env),
-                lvalue_copy(v->val.fun->formals),
-                lvalue_copy(v->val.fun->body)
-            );
+            x->val.fun = v->val.fun;
+            x->val.fun->refcount++;
+            break;
+        case LVAL_PAP:
+            x->val.pap = v->val.pap;
+            x->val.pap->refcount++;
             break;
         case LVAL_BUILTIN:
             x->val.builtin = v->val.builtin;
@@ -459,8 +593,10 @@ struct lvalue *lvalue_copy(struct lvalue *v) {
         case LVAL_FLOAT:
             x->val.floatval = v->val.floatval;
             break;
-        case LVAL_ERR:
         case LVAL_SYM:
+            x->val.strval = v->val.strval;
+            break;
+        case LVAL_ERR:
         case LVAL_STR:
             x->val.strval = malloc((strlen(v->val.strval) + 1) * sizeof(char));
             strcpy(x->val.strval, v->val.strval);
@@ -483,6 +619,15 @@ struct lvalue *lvalue_copy(struct lvalue *v) {
             fp = v->val.file->fp; /* copy share fp to limit fp use to the same file */
             x->val.file = lfile_new(p, m, fp);
             break;
+        case LVAL_MEMO:
+            x->val.memo = lmemo_share(v->val.memo);
+            break;
+        case LVAL_SEQ:
+            x->val.seq = lseq_share(v->val.seq);
+            break;
+        case LVAL_CHAN:
+            x->val.chan = lchan_share(v->val.chan);
+            break;
      }
 
     return x;
@@ -492,8 +637,17 @@ struct lvalue *lvalue_copy(struct lvalue *v) {
  * Compare two lvalues for equality.
  * Returns zero if input values x and y are not equal,
  * returns a non-zero otherwise
+ *
+ * Only symbols are hash-consed; they compare by pointer. Expressions
+ * are not shared between values, since builtins edit their argument
+ * lists in place, so equal expressions are still compared cell by cell,
+ * after their cached hashes have ruled out most unequal ones.
  */
 int lvalue_eq(struct lvalue *x, struct lvalue *y) {
+    if ( x == y ) {
+        return 1;
+    }
+
     if ( x->type != y->type ) {
         return 0;
     }
@@ -504,24 +658,51 @@ int lvalue_eq(struct lvalue *x, struct lvalue *y) {
         case LVAL_BOOL:
         case LVAL_INT:
             return (x->val.intval == y->val.intval);
-        case LVAL_ERR:
         case LVAL_SYM:
+            return x->val.strval == y->val.strval;
+        case LVAL_ERR:
         case LVAL_STR:
             return strcmp(x->val.strval, y->val.strval) == 0;
         case LVAL_BUILTIN:
             return (x->val.builtin == y->val.builtin);
         case LVAL_FUNCTION:
-            return lvalue_eq(x->val.fun->formals, y->val.fun->formals) &&
-                 lvalue_eq(x->val.fun->body, y->val.fun->body);
+            return x->val.fun == y->val.fun || (
+                lvalue_eq(x->val.fun->formals, y->val.fun->formals) &&
+                lvalue_eq(x->val.fun->body, y->val.fun->body)
+            );
+        case LVAL_PAP:
+            if ( x->val.pap == y->val.pap ) {
+                return 1;
+            }
+            if ( x->val.pap->argc != y->val.pap->argc ||
+                !lvalue_eq(x->val.pap->fun->formals, y->val.pap->fun->formals) ||
+                !lvalue_eq(x->val.pap->fun->body, y->val.pap->fun->body) ) {
+                return 0;
+            }
+            for ( size_t i = 0; i < x->val.pap->argc; ++i ) {
+                if ( !lvalue_eq(x->val.pap->argv[i], y->val.pap->argv[i]) ) {
+                    return 0;
+                }
+            }
+            return 1;
         case LVAL_FILE:
             return lvalue_eq(x->val.file->path, y->val.file->path) &&
                 lvalue_eq(x->val.file->mode, y->val.file->mode) &&
                 x->val.file->fp == y->val.file->fp;
+        case LVAL_MEMO:
+            return x->val.memo == y->val.memo;
+        case LVAL_SEQ:
+            return x->val.seq == y->val.seq;
+        case LVAL_CHAN:
+            return x->val.chan == y->val.chan;
         case LVAL_QEXPR:
         case LVAL_SEXPR:
             if ( x->val.l.count != y->val.l.count ) {
                 return 0;
             }
+            if ( x->hash != 0 && y->hash != 0 && x->hash != y->hash ) {
+                return 0;
+            }
             for ( size_t i = 0; i < x->val.l.count; ++i ) {
                 if ( !lvalue_eq(x->val.l.cells[i], y->val.l.cells[i]) ) {
                     return 0;
@@ -532,6 +713,83 @@ int lvalue_eq(struct lvalue *x, struct lvalue *y) {
     return 0;
 }
 
+static size_t lhash_combine(size_t seed, size_t h) {
+    return seed ^ (h + (size_t) 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+static size_t lhash_bytes(const void *data, size_t len) {
+    /* FNV-1a */
+    const unsigned char *bytes = data;
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for ( size_t i = 0; i < len; ++i ) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t) h;
+}
+
+/**
+ * Structural hash of a lvalue.
+ * Values that are equal according to lvalue_eq hash to the same value.
+ */
+size_t lvalue_hash(struct lvalue *v) {
+    size_t h = lhash_combine(0, (size_t) v->type);
+    double d;
+
+    switch ( v->type ) {
+        case LVAL_FLOAT:
+            d = v->val.floatval;
+            if ( d == 0.0 ) {
+                d = 0.0; /* -0.0 == 0.0 */
+            }
+            return lhash_combine(h, lhash_bytes(&d, sizeof(double)));
+        case LVAL_BOOL:
+        case LVAL_INT:
+            return lhash_combine(h, lhash_bytes(&v->val.intval, sizeof(long long)));
+        case LVAL_SYM:
+            return lhash_combine(h, lsymbol_of(v->val.strval)->hash);
+        case LVAL_ERR:
+        case LVAL_STR:
+            return lhash_combine(h, lhash_bytes(v->val.strval, strlen(v->val.strval)));
+        case LVAL_BUILTIN:
+            return lhash_combine(h, lhash_bytes(&v->val.builtin, sizeof(v->val.builtin)));
+        case LVAL_FUNCTION:
+            h = lhash_combine(h, lvalue_hash(v->val.fun->formals));
+            return lhash_combine(h, lvalue_hash(v->val.fun->body));
+        case LVAL_PAP:
+            h = lhash_combine(h, lvalue_hash(v->val.pap->fun->formals));
+            h = lhash_combine(h, lvalue_hash(v->val.pap->fun->body));
+            for ( size_t i = 0; i < v->val.pap->argc; ++i ) {
+                h = lhash_combine(h, lvalue_hash(v->val.pap->argv[i]));
+            }
+            return h;
+        case LVAL_FILE:
+            h = lhash_combine(h, lvalue_hash(v->val.file->path));
+            h = lhash_combine(h, lvalue_hash(v->val.file->mode));
+            return lhash_combine(h, lhash_bytes(&v->val.file->fp, sizeof(FILE *)));
+        case LVAL_MEMO:
+            return lhash_combine(h, lhash_bytes(&v->val.memo, sizeof(struct lmemo *)));
+        case LVAL_SEQ:
+            return lhash_combine(h, lhash_bytes(&v->val.seq, sizeof(struct lseq *)));
+        case LVAL_CHAN:
+            return lhash_combine(h, lhash_bytes(&v->val.chan, sizeof(struct lchan *)));
+        case LVAL_QEXPR:
+        case LVAL_SEXPR:
+            if ( v->hash == 0 ) {
+                /* the hash of the cells is cached until the cells change */
+                size_t cells = v->val.l.count;
+                for ( size_t i = 0; i < v->val.l.count; ++i ) {
+                    cells = lhash_combine(cells, lvalue_hash(v->val.l.cells[i]));
+                }
+                unsigned long long wide = cells;
+                unsigned int folded = (unsigned int) (wide ^ (wide >> 32));
+                v->hash = folded != 0 ? folded : 1;
+            }
+            return lhash_combine(h, v->hash);
+    }
+    return h;
+}
+
 /**
  * Given a lvalue type, return it's string representation
  */
@@ -557,6 +815,15 @@ char *ltype_name(enum ltype t) {
             return "q-expression";
         case LVAL_SEXPR:
             return "s-expression";
+        case LVAL_MEMO:
+            return "memoized function";
+        case LVAL_SEQ:
+            return "sequence";
+        case LVAL_CHAN:
+            return "channel";
+        case LVAL_PAP:
+            /* partially applied functions are functions to the language */
+            return "function";
         default:
             break;
     }
@@ -595,130 +862,213 @@ void lvalue_pretty_print(struct lvalue *v) {
 /**
  * evaluate a function
  */
-struct lvalue *lvalue_call(struct lenvironment *e, struct lvalue *f, struct lvalue *v) {
-
-    if ( f->type == LVAL_BUILTIN ) {
-        return f->val.builtin(e, v);
-    }
-
+/*
+ * Calls the function or partial application 'f' with all of its
+ * arguments: the bound ones followed by 'argv'. The arguments are
+ * borrowed; 'owned', the s-expression holding them if the caller gave
+ * it up, is deleted as soon as they are bound.
+ */
+static struct lvalue *lvalue_call_full(struct lenvironment *e, struct lvalue *f, size_t argc, struct lvalue **argv, struct lvalue *owned) {
     struct lfunction *func = f->val.fun;
-    struct lvalue **args = v->val.l.cells;
-    struct lvalue *formals = func->formals;
-
-    size_t given = v->val.l.count;
-    size_t total = formals->val.l.count;
+    struct lvalue **bound = NULL;
+    size_t bound_count = 0;
+    if ( f->type == LVAL_PAP ) {
+        func = f->val.pap->fun;
+        bound = f->val.pap->argv;
+        bound_count = f->val.pap->argc;
+    }
 
-    while ( v->val.l.count > 0 ) {
+    struct lvalue **formals = func->formals->val.l.cells;
+    size_t total = func->formals->val.l.count;
+    size_t given = bound_count + argc;
 
-        if ( formals->val.l.count == 0 &&
-            args[0]->type != LVAL_SEXPR ) {
+    if ( !func->variadic && given > func->arity ) {
+        struct lvalue *extra = argv[func->arity - bound_count];
+        if ( extra->type != LVAL_SEXPR || extra->val.l.count != 0 ) {
             /* Error case: non-symbolic parameter parsed */
-            lvalue_del(v);
+            if ( owned != NULL ) {
+                lvalue_del(owned);
+            }
             return lvalue_err(
                 "Function parsed too many arguments; "
                 "got %lu expected %lu",
                 given,
                 total
             );
-        } else if ( formals->val.l.count == 0 &&
-            args[0]->type == LVAL_SEXPR &&
-            args[0]->val.l.count == 0 ) {
-            /* Function with no parameters case: can be called with a empty sexpr */
-            break;
         }
+        /* Function called with a trailing empty sexpr; e.g. a function without parameters */
+        given = func->arity;
+    }
 
-        struct lvalue *sym = lvalue_pop(formals, 0); /* unbound name */
+    /* compiled code does not count steps, so limits keep to the interpreter */
+    struct lbudget *budget = &e->ctx->budget;
+    struct lvalue *res = NULL;
+    if ( !func->variadic && !budget->bounded && ((func->native != NULL && func->native(e->ctx, bound, bound_count, argv, &res)) ||
+        ljit_call(e->ctx, func, bound, bound_count, argv, &res)) ) {
+        if ( owned != NULL ) {
+            lvalue_del(owned);
+        }
+        return res;
+    }
 
-        if ( strcmp(sym->val.strval, "&") == 0 ) {
-            /* Variable argument case with '&' */
-            if ( formals->val.l.count != 1 ) {
-                lvalue_del(v);
-                return lvalue_err(
-                    "Function format invalid. "
-                    "Symbol '&' not followed by a single symbol."
-                );
-            }
+    if ( budget->depth >= budget->depth_limit ) {
+        if ( owned != NULL ) {
+            lvalue_del(owned);
+        }
+        return lvalue_err("Evaluation exceeded its depth limit.");
+    }
 
-            /* Binding rest of the arguments to nsym */
-            struct lvalue *nsym = lvalue_pop(formals, 0);
-            lenvironment_put(func->env, nsym, builtin_list(e, v));
-            lvalue_del(sym);
-            lvalue_del(nsym);
-            break;
+    /* the scope of the call only lives as long as the call */
+    struct lenvironment_entry *buckets[CALL_SCOPE_BUCKETS];
+    struct lenvironment scope;
+    lenvironment_init(&scope, buckets, CALL_SCOPE_BUCKETS);
+
+    for ( size_t i = 0; i < func->arity; ++i ) {
+        struct lvalue *arg = i < bound_count ? bound[i] : argv[i - bound_count];
+        lenvironment_put(&scope, formals[i], arg);
+    }
+
+    if ( func->variadic ) {
+        /* Binding rest of the arguments to the symbol after '&' */
+        struct lvalue *rest = lvalue_qexpr();
+        for ( size_t i = func->arity; i < given; ++i ) {
+            struct lvalue *arg = i < bound_count ? bound[i] : argv[i - bound_count];
+            lvalue_add(rest, lvalue_copy(arg));
         }
+        lenvironment_put(&scope, formals[func->arity + 1], rest);
+        lvalue_del(rest);
+    }
 
-        struct lvalue *val = lvalue_pop(v, 0); /* value to apply to unbound name */
+    if ( owned != NULL ) {
+        lvalue_del(owned);
+    }
 
-        lenvironment_put(func->env, sym, val);
-        lvalue_del(sym);
-        lvalue_del(val);
+    scope.parent = e;
+    budget->depth++;
+    LPROBE2(function_entry, func->name, budget->depth);
+    res = lvalue_eval_cells(&scope, func->body->val.l.count, func->body->val.l.cells);
+    LPROBE2(function_return, func->name, budget->depth);
+    budget->depth--;
+    lenvironment_clear(&scope);
+    return res;
+}
+
+/* whether the arguments of a call of 'f' leave it partially applied */
+static int lvalue_call_partial(struct lvalue *f, size_t argc) {
+    if ( f->type == LVAL_PAP ) {
+        return f->val.pap->argc + argc < f->val.pap->fun->arity;
     }
+    return argc < f->val.fun->arity;
+}
 
-    lvalue_del(v);
+struct lvalue *lvalue_call(struct lenvironment *e, struct lvalue *f, struct lvalue *v) {
 
-    if ( formals->val.l.count > 0 &&
-        strcmp(formals->val.l.cells[0]->val.strval, "&") == 0 ) {
-        /* only first non-variable arguments was applied; create a empty qexpr  */
+    if ( f->type == LVAL_BUILTIN ) {
+        const struct lbuiltin *b = f->val.builtin;
+        if ( b->span == NULL ) {
+            return b->call(e, v);
+        }
+        struct lvalue *res = b->span(e->ctx, v->val.l.count, v->val.l.cells);
+        lvalue_del(v);
+        return res;
+    }
 
-        if ( formals->val.l.count != 2 ) {
-            return lvalue_err(
-                "Function format invalid. "
-                "Symbol '&' not followed by single symbol."
-            );
+    if ( f->type == LVAL_MEMO ) {
+        return lmemo_call(e, f->val.memo, v);
+    }
+
+    struct lfunction *func = f->type == LVAL_PAP ? f->val.pap->fun : f->val.fun;
+    if ( func->variadic && func->formals->val.l.count != func->arity + 2 ) {
+        lvalue_del(v);
+        return lvalue_err(
+            "Function format invalid. "
+            "Symbol '&' not followed by a single symbol."
+        );
+    }
+
+    if ( lvalue_call_partial(f, v->val.l.count) ) {
+        /* not all arguments given yet; bind the ones that are */
+        struct lvalue **bound = f->type == LVAL_PAP ? f->val.pap->argv : NULL;
+        size_t bound_count = f->type == LVAL_PAP ? f->val.pap->argc : 0;
+        size_t given = bound_count + v->val.l.count;
+        struct lregion_mark mark = lregion_mark(&e->ctx->region);
+        struct lvalue **argv = lregion_alloc(&e->ctx->region, given * sizeof(struct lvalue *));
+        for ( size_t i = 0; i < bound_count; ++i ) {
+            argv[i] = lvalue_copy(bound[i]);
         }
+        for ( size_t i = 0; i < v->val.l.count; ++i ) {
+            argv[bound_count + i] = v->val.l.cells[i];
+        }
+        v->val.l.count = 0;
+        lvalue_del(v);
 
-        /* Remove '&' */
-        lvalue_del(lvalue_pop(formals, 0));
+        struct lvalue *pap = lvalue_pap(func, given, argv);
+        lregion_release(&e->ctx->region, mark);
+        return pap;
+    }
 
-        /* Create a empty list for the next symbol */
-        struct lvalue *sym = lvalue_pop(formals, 0);
-        struct lvalue *val = lvalue_qexpr();
+    return lvalue_call_full(e, f, v->val.l.count, v->val.l.cells, v);
+}
 
-        lenvironment_put(func->env, sym, val);
-        lvalue_del(sym);
-        lvalue_del(val);
+/*
+ * Calls 'f' with the arguments 'argv', which are borrowed, so a caller
+ * making many calls can reuse them. Only a call that keeps its arguments,
+ * such as one of a builtin taking them or a partial application, is
+ * given a copy.
+ */
+struct lvalue *lvalue_call_span(struct lenvironment *e, struct lvalue *f, size_t argc, struct lvalue **argv) {
+    if ( f->type == LVAL_BUILTIN && f->val.builtin->span != NULL ) {
+        return f->val.builtin->span(e->ctx, argc, argv);
     }
 
-    if ( formals->val.l.count == 0 ) {
-        func->env->parent = e;
-        return builtin_eval( func->env, lvalue_add(lvalue_sexpr(), lvalue_copy(func->body)) );
+    if ( f->type == LVAL_FUNCTION || f->type == LVAL_PAP ) {
+        struct lfunction *func = f->type == LVAL_PAP ? f->val.pap->fun : f->val.fun;
+        if ( !func->variadic && !lvalue_call_partial(f, argc) ) {
+            return lvalue_call_full(e, f, argc, argv, NULL);
+        }
     }
-    return lvalue_copy(f);
+
+    struct lvalue *v = lvalue_sexpr();
+    for ( size_t i = 0; i < argc; ++i ) {
+        lvalue_add(v, lvalue_copy(argv[i]));
+    }
+    return lvalue_call(e, f, v);
 }
 
 
-struct lvalue *lvalue_eval_sexpr(struct lenvironment *e, struct lvalue *v) {
-    /* empty sexpr */
-    if ( v->val.l.count == 0 ) {
-        return v;
+/* every evaluated s-expression is a step of the budget */
+static struct lvalue *lvalue_step(struct lenvironment *e) {
+    struct lbudget *budget = &e->ctx->budget;
+    if ( ++budget->steps >= budget->check_at ) {
+        return lbudget_check(e->ctx);
     }
+    return NULL;
+}
 
-    /*
-     * Implicit qouting
-     * Intercept special sexpr to make symbols qouted
-     */
-    struct lvalue *first = v->val.l.cells[0];
-    if ( first->type == LVAL_SYM && v->val.l.count > 1 ) {
-        struct lvalue *sec = v->val.l.cells[1];
-        if (
-            (
-                strcmp(first->val.strval, "=") == 0    ||
-                strcmp(first->val.strval, "def") == 0  ||
-                strcmp(first->val.strval, "fn") == 0
-            ) && sec->type == LVAL_SYM
-        ) {
-            v->val.l.cells[1] = lvalue_add(lvalue_qexpr(), sec);
-        }
+/*
+ * Special forms get their operands unevaluated.
+ * A form is found by the identity of its interned name, and only
+ * stands in while that name is still bound to the form's builtin.
+ */
+static const struct lspecial_form *lvalue_special(struct lvalue *first, size_t count) {
+    if ( first->type != LVAL_SYM || count < 2 ) {
+        return NULL;
     }
-
-    /* Depth-first evaluation of sexpr arguments.
-       This resolves the actual meaning of the sexpr, such that
-       what operator to apply to this sexpr is known, and if
-       there was any error executing nested sexpr etc...
-     */
-    for ( size_t i = 0; i < v->val.l.count; i++ ) {
-        v->val.l.cells[i] = lvalue_eval(e, v->val.l.cells[i]);
+    struct lsymbol *sym = lsymbol_of(first->val.strval);
+    const struct lspecial_form *form = sym->special;
+    if (
+        form != NULL && sym->shadows == 0 && sym->global != NULL &&
+        sym->global->envval->type == LVAL_BUILTIN &&
+        sym->global->envval->val.builtin->call == form->builtin
+    ) {
+        return form;
     }
+    return NULL;
+}
+
+/* applies the first value of the s-expression 'v' of evaluated values to the rest */
+static struct lvalue *lvalue_apply(struct lenvironment *e, struct lvalue *v) {
+    v->hash = 0;
 
     /* Hoist first lvalue if only one is available.
        This helps to sub results of sexprs, but
@@ -735,6 +1085,16 @@ struct lvalue *lvalue_eval_sexpr(struct lenvironment *e, struct lvalue *v) {
         }
     }
 
+    /* Builtins of the span calling convention borrow the
+       evaluated arguments in place; nothing is popped or moved.
+     */
+    struct lvalue *head = v->val.l.cells[0];
+    if ( head->type == LVAL_BUILTIN && head->val.builtin->span != NULL ) {
+        struct lvalue *res = head->val.builtin->span(e->ctx, v->val.l.count - 1, v->val.l.cells + 1);
+        lvalue_del(v);
+        return res;
+    }
+
     /* Function evaluation.
        Take the first lvalue in the sexpression and apply it to the
        following lvalue sequence
@@ -745,7 +1105,9 @@ struct lvalue *lvalue_eval_sexpr(struct lenvironment *e, struct lvalue *v) {
 
     switch ( operator->type ) {
         case LVAL_FUNCTION:
+        case LVAL_PAP:
         case LVAL_BUILTIN:
+        case LVAL_MEMO:
             res = lvalue_call(e, operator, v);
             break;
         default:
@@ -760,6 +1122,89 @@ struct lvalue *lvalue_eval_sexpr(struct lenvironment *e, struct lvalue *v) {
     return res;
 }
 
+struct lvalue *lvalue_eval_sexpr(struct lenvironment *e, struct lvalue *v) {
+    /* empty sexpr */
+    if ( v->val.l.count == 0 ) {
+        return v;
+    }
+
+    struct lvalue *err = lvalue_step(e);
+    if ( err != NULL ) {
+        lvalue_del(v);
+        return err;
+    }
+
+    const struct lspecial_form *form = lvalue_special(v->val.l.cells[0], v->val.l.count);
+    if ( form != NULL ) {
+        lvalue_del(lvalue_pop(v, 0));
+        return form->eval(e, v);
+    }
+
+    /* Depth-first evaluation of sexpr arguments.
+       This resolves the actual meaning of the sexpr, such that
+       what operator to apply to this sexpr is known, and if
+       there was any error executing nested sexpr etc...
+     */
+    for ( size_t i = 0; i < v->val.l.count; i++ ) {
+        v->val.l.cells[i] = lvalue_eval(e, v->val.l.cells[i]);
+    }
+    return lvalue_apply(e, v);
+}
+
+/*
+ * Evaluates 'cells' as the cells of a s-expression without modifying
+ * or taking them, so code shared by every evaluation, such as the body
+ * of a function, is not copied first. Only the values the evaluation
+ * needs are made; a branch not taken is never copied.
+ */
+struct lvalue *lvalue_eval_cells(struct lenvironment *e, size_t count, struct lvalue **cells) {
+    if ( count == 0 ) {
+        return lvalue_sexpr();
+    }
+
+    struct lvalue *err = lvalue_step(e);
+    if ( err != NULL ) {
+        return err;
+    }
+
+    struct lvalue *v = lvalue_sexpr();
+    const struct lspecial_form *form = lvalue_special(cells[0], count);
+    if ( form != NULL ) {
+        if ( form->span != NULL ) {
+            lvalue_del(v);
+            return form->span(e, count - 1, cells + 1);
+        }
+        /* the other forms take their operands */
+        for ( size_t i = 1; i < count; i++ ) {
+            lvalue_add(v, lvalue_copy(cells[i]));
+        }
+        return form->eval(e, v);
+    }
+
+    v->val.l.cells = malloc(count * sizeof(struct lvalue *));
+    if ( v->val.l.cells == NULL ) {
+        perror("Could not allocate lvalue cell buffer");
+        exit(1);
+    }
+    for ( size_t i = 0; i < count; i++ ) {
+        v->val.l.cells[i] = lvalue_eval_borrowed(e, cells[i]);
+        v->val.l.count = i + 1;
+    }
+    return lvalue_apply(e, v);
+}
+
+/* evaluates 'v' without modifying or taking it */
+struct lvalue *lvalue_eval_borrowed(struct lenvironment *e, struct lvalue *v) {
+    switch ( v->type ) {
+        case LVAL_SYM:
+            return lenvironment_get(e, v);
+        case LVAL_SEXPR:
+            return lvalue_eval_cells(e, v->val.l.count, v->val.l.cells);
+        default:
+            return lvalue_copy(v);
+    }
+}
+
 struct lvalue *lvalue_eval(struct lenvironment *e, struct lvalue *v) {
 
     struct lvalue *x;
@@ -15,22 +15,70 @@ enum ltype {
     LVAL_FUNCTION,
     LVAL_FILE,
     LVAL_BOOL,
-    LVAL_STR
+    LVAL_STR,
+    LVAL_MEMO,
+    LVAL_PAP,
+    LVAL_SEQ,
+    LVAL_CHAN
 };
 
 struct lvalue; 
 struct lenvironment;
+struct lmemo;
+struct lseq;
+struct lchan;
+struct lisper_ctx;
+struct ljit;
+
+/*
+ * Machine code of a function compiled ahead of time (see --emit-c). Runs
+ * a call with the arguments 'bound' followed by 'args' and returns 1 with
+ * the result in the last argument, or 0 if the interpreter has to run it.
+ */
+typedef int (*lnative_fn)(struct lisper_ctx *, struct lvalue **, size_t, struct lvalue **, struct lvalue **);
 
 struct lcells {
     size_t count;
     struct lvalue **cells;
 };
 
+/*
+ * Function created by a lambda. Immutable once created and shared by
+ * every copy of the function value; each call binds the arguments in
+ * a scope of its own.
+ */
 struct lfunction {
-    char *name;
-    struct lenvironment *env;
+    size_t refcount;
     struct lvalue *formals;
     struct lvalue *body;
+    size_t arity; /* number of formals before '&' */
+    int variadic; /* formals end in '&' */
+    size_t calls; /* invocations counted until the function is compiled */
+    struct ljit *jit; /* machine code of the function or NULL */
+    lnative_fn native; /* code compiled ahead of time or NULL */
+    const char *name; /* interned name the function was first bound to; NULL for lambdas */
+};
+
+/*
+ * Partial application; a function with its leading arguments bound.
+ * Immutable and shared between copies like the function itself.
+ */
+struct lpap {
+    size_t refcount;
+    struct lfunction *fun;
+    size_t argc;
+    struct lvalue *argv[];
+};
+
+/*
+ * Descriptor of a builtin function, implementing one of two calling conventions:
+ * 'call' takes ownership of a s-expression of the arguments, while
+ * 'span' borrows 'argc' arguments from 'argv' and must not keep or modify them.
+ */
+struct lbuiltin {
+    char *name;
+    struct lvalue *(*call)(struct lenvironment *, struct lvalue *);
+    struct lvalue *(*span)(struct lisper_ctx *, size_t, struct lvalue **);
 };
 
 struct lfile {
@@ -41,19 +89,26 @@ struct lfile {
 
 struct lvalue {
     enum ltype type;
+    unsigned int hash; /* cached hash of the cells of s- and q-expressions; 0 when unknown */
     union val {
         double floatval;
         long long intval;
         char *strval;
         struct lcells l;
-        struct lvalue *(*builtin)(struct lenvironment *, struct lvalue *);
+        const struct lbuiltin *builtin;
         struct lfunction *fun;
+        struct lpap *pap;
         struct lfile *file;
+        struct lmemo *memo;
+        struct lseq *seq;
+        struct lchan *chan;
     } val;
 };
 
 struct lvalue *lvalue_read(mpc_ast_t *);
 
+struct lwriter;
+void lvalue_write(struct lwriter *, struct lvalue *);
 void lvalue_print(struct lvalue *);
 void lvalue_println(struct lvalue *);
 void lvalue_del(struct lvalue *);
@@ -65,11 +120,14 @@ struct lvalue *lvalue_bool(long long);
 struct lvalue *lvalue_int(long long);
 struct lvalue *lvalue_sym(char *);
 struct lvalue *lvalue_str(char *);
-struct lvalue *lvalue_builtin(struct lvalue *(*)(struct lenvironment *, struct lvalue *));
+struct lvalue *lvalue_builtin(const struct lbuiltin *);
 struct lvalue *lvalue_sexpr(void);
 struct lvalue *lvalue_qexpr(void);
-struct lvalue *lvalue_lambda(struct lvalue *, struct lvalue *, size_t);
+struct lvalue *lvalue_lambda(struct lvalue *, struct lvalue *);
 struct lvalue *lvalue_file(struct lvalue *, struct lvalue *, FILE *);
+struct lvalue *lvalue_memo(struct lvalue *, size_t);
+struct lvalue *lvalue_seq(struct lseq *);
+struct lvalue *lvalue_chan(struct lchan *);
 
 /* lvalue transformers */
 struct lvalue *lvalue_add(struct lvalue *, struct lvalue *);
@@ -80,8 +138,12 @@ struct lvalue *lvalue_pop(struct lvalue *, int);
 struct lvalue *lvalue_take(struct lvalue *, int); /* same as pop except frees input lvalue */
 struct lvalue *lvalue_copy(struct lvalue *);
 int lvalue_eq(struct lvalue *, struct lvalue *);
+size_t lvalue_hash(struct lvalue *);
 struct lvalue *lvalue_call(struct lenvironment *, struct lvalue *, struct lvalue *);
+struct lvalue *lvalue_call_span(struct lenvironment *, struct lvalue *, size_t, struct lvalue **);
 struct lvalue *lvalue_eval(struct lenvironment *, struct lvalue *);
+struct lvalue *lvalue_eval_borrowed(struct lenvironment *, struct lvalue *);
+struct lvalue *lvalue_eval_cells(struct lenvironment *, size_t, struct lvalue **);
 
 char *ltype_name(enum ltype);
 void lvalue_pretty_print(struct lvalue *);
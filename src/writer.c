@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "writer.h"
+#include "number.h"
+
+void lwriter_init(struct lwriter *w, FILE *fp) {
+    w->fp = fp;
+    w->data = NULL;
+    w->len = 0;
+    w->cap = 0;
+}
+
+void lwriter_destroy(struct lwriter *w) {
+    lwriter_flush(w);
+    free(w->data);
+    lwriter_init(w, NULL);
+}
+
+/* room for 'n' more bytes and a terminator */
+void lwriter_reserve(struct lwriter *w, size_t n) {
+    if ( w->len + n < w->cap ) {
+        return;
+    }
+    size_t cap = w->cap == 0 ? LWRITER_INITIAL_SIZE : w->cap;
+    while ( w->len + n >= cap ) {
+        cap *= 2;
+    }
+    char *resized = realloc(w->data, cap);
+    if ( resized == NULL ) {
+        perror("Could not grow output buffer");
+        exit(1);
+    }
+    w->data = resized;
+    w->cap = cap;
+}
+
+/* hands the buffered text to the stream of the writer, or drops it when there is none */
+void lwriter_flush(struct lwriter *w) {
+    if ( w->fp != NULL && w->len > 0 ) {
+        fwrite(w->data, 1, w->len, w->fp);
+    }
+    w->len = 0;
+}
+
+const char *lwriter_cstr(struct lwriter *w) {
+    lwriter_reserve(w, 1);
+    w->data[w->len] = '\0';
+    return w->data;
+}
+
+void lwriter_write(struct lwriter *w, const char *s, size_t n) {
+    lwriter_reserve(w, n);
+    memcpy(w->data + w->len, s, n);
+    w->len += n;
+}
+
+void lwriter_puts(struct lwriter *w, const char *s) {
+    lwriter_write(w, s, strlen(s));
+}
+
+void lwriter_int(struct lwriter *w, long long n) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long u = n < 0 ? 0 - (unsigned long long) n : (unsigned long long) n;
+    do {
+        *--p = (char) ('0' + u % 10);
+        u /= 10;
+    } while ( u != 0 );
+    if ( n < 0 ) {
+        *--p = '-';
+    }
+    lwriter_write(w, p, (size_t) (digits + sizeof(digits) - p));
+}
+
+static const double writer_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* integers up to 2^53 are exact in a double */
+#define LWRITER_MAX_EXACT 9007199254740992.0
+
+/*
+ * The fewest fraction digits 'k' for which m / 10^k reads back as 'a',
+ * with m below 2^53 so the division is the correctly rounded one of the
+ * reader. Returns -1 when no such m exists.
+ */
+static int lwriter_fixed_digits(double a, unsigned long long *out) {
+    for ( int k = 0; k <= 22; ++k ) {
+        double scaled = a * writer_pow10[k];
+        if ( scaled >= LWRITER_MAX_EXACT ) {
+            return -1;
+        }
+        /* 'scaled' is off by a rounding, so the neighbours are tried too */
+        unsigned long long m = (unsigned long long) (scaled + 0.5);
+        unsigned long long candidates[3] = { m, m - 1, m + 1 };
+        for ( int i = 0; i < 3; ++i ) {
+            if ( candidates[i] > 0 && (double) candidates[i] / writer_pow10[k] == a ) {
+                *out = candidates[i];
+                return k;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Writes the decimal digits[0..n) with the first digit at 10^exp10, in
+ * full from 1e-4 up to 1e15 and in exponent notation otherwise. There is
+ * always a fraction or an exponent, so it reads back as a float.
+ */
+static void lwriter_decimal(struct lwriter *w, int negative, const char *digits, int n, int exp10) {
+    if ( negative ) {
+        lwriter_putc(w, '-');
+    }
+
+    if ( exp10 < -4 || exp10 >= 15 ) {
+        lwriter_putc(w, digits[0]);
+        if ( n > 1 ) {
+            lwriter_putc(w, '.');
+            lwriter_write(w, digits + 1, (size_t) n - 1);
+        }
+        lwriter_putc(w, 'e');
+        lwriter_int(w, exp10);
+        return;
+    }
+
+    if ( exp10 < 0 ) {
+        lwriter_write(w, "0.", 2);
+        for ( int i = exp10 + 1; i < 0; ++i ) {
+            lwriter_putc(w, '0');
+        }
+        lwriter_write(w, digits, (size_t) n);
+        return;
+    }
+
+    int whole = exp10 + 1;
+    lwriter_write(w, digits, (size_t) (n < whole ? n : whole));
+    for ( int i = n; i < whole; ++i ) {
+        lwriter_putc(w, '0');
+    }
+    lwriter_putc(w, '.');
+    if ( n > whole ) {
+        lwriter_write(w, digits + whole, (size_t) (n - whole));
+    } else {
+        lwriter_putc(w, '0');
+    }
+}
+
+/*
+ * Rounds the 17 significant digits of 'a' in 'digits', a terminated
+ * string, to 'n' digits into 'out' and returns whether they still read
+ * back as 'a'.
+ */
+static int lwriter_round_digits(double a, const char *digits, int exp10, int n, char *out, int *out_exp10) {
+    int up;
+    if ( digits[n] != '5' ) {
+        up = digits[n] > '5';
+    } else if ( strspn(digits + n + 1, "0") < (size_t) (16 - n) ) {
+        up = 1;
+    } else {
+        /* a tie of the rounded digits may not be one of 'a'; the C library decides */
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*e", n - 1, a);
+        up = buf[0] != digits[0] || (n > 1 && strncmp(buf + 2, digits + 1, (size_t) n - 1) != 0);
+    }
+
+    memcpy(out, digits, (size_t) n);
+    *out_exp10 = exp10;
+    if ( up ) {
+        int i = n - 1;
+        while ( i >= 0 && out[i] == '9' ) {
+            out[i--] = '0';
+        }
+        if ( i < 0 ) {
+            out[0] = '1';
+            *out_exp10 = exp10 + 1;
+        } else {
+            out[i]++;
+        }
+    }
+
+    char buf[40];
+    memcpy(buf, out, (size_t) n);
+    snprintf(buf + n, sizeof(buf) - (size_t) n, "e%d", *out_exp10 - n + 1);
+    const char *end;
+    double back;
+    return lnumber_parse_float(buf, &end, &back) == LNUMBER_OK && back == a;
+}
+
+/*
+ * The shortest decimal that reads back as 'd'. Numbers that are short
+ * decimals, the bulk of what scripts print, are found with a few exact
+ * double operations; the others start from the 17 digits that always
+ * read back and are shortened while they still do.
+ */
+void lwriter_double(struct lwriter *w, double d) {
+    char digits[24];
+    int negative = signbit(d) != 0;
+    double a = negative ? -d : d;
+    unsigned long long m;
+    int k, n, exp10;
+
+    if ( isnan(d) ) {
+        lwriter_write(w, "nan", 3);
+        return;
+    }
+    if ( isinf(d) ) {
+        lwriter_puts(w, negative ? "-inf" : "inf");
+        return;
+    }
+    if ( a == 0 ) {
+        lwriter_puts(w, negative ? "-0.0" : "0.0");
+        return;
+    }
+
+    if ( a >= 1e-4 && a < 1e15 && (k = lwriter_fixed_digits(a, &m)) >= 0 ) {
+        char *p = digits + sizeof(digits);
+        for ( ; m != 0; m /= 10 ) {
+            *--p = (char) ('0' + m % 10);
+        }
+        n = (int) (digits + sizeof(digits) - p);
+        /* the last digit of m is at 10^-k */
+        exp10 = n - 1 - k;
+        memmove(digits, p, (size_t) n);
+        while ( n > 1 && digits[n - 1] == '0' ) {
+            n--;
+        }
+        lwriter_decimal(w, negative, digits, n, exp10);
+        return;
+    }
+
+    char buf[40], all[18];
+    snprintf(buf, sizeof(buf), "%.16e", a);
+    all[0] = buf[0];
+    memcpy(all + 1, buf + 2, 16);
+    all[17] = '\0';
+    exp10 = atoi(buf + 19);
+
+    /* 15 digits are enough for any double that is a shorter decimal, but subnormals hold fewer */
+    for ( n = a < DBL_MIN ? 1 : 15; n < 17; ++n ) {
+        if ( lwriter_round_digits(a, all, exp10, n, digits, &k) ) {
+            exp10 = k;
+            break;
+        }
+    }
+    if ( n == 17 ) {
+        memcpy(digits, all, 17);
+    }
+    while ( n > 1 && digits[n - 1] == '0' ) {
+        n--;
+    }
+    lwriter_decimal(w, negative, digits, n, exp10);
+}
+
+/* 's' with the escapes the reader understands, as mpcf_escape writes them */
+void lwriter_escaped(struct lwriter *w, const char *s) {
+    for ( ; *s != '\0'; ++s ) {
+        const char *escape;
+        switch ( *s ) {
+            case '\a': escape = "\\a"; break;
+            case '\b': escape = "\\b"; break;
+            case '\f': escape = "\\f"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            case '\t': escape = "\\t"; break;
+            case '\v': escape = "\\v"; break;
+            case '\\': escape = "\\\\"; break;
+            case '\'': escape = "\\'"; break;
+            case '"': escape = "\\\""; break;
+            default:
+                lwriter_putc(w, *s);
+                continue;
+        }
+        lwriter_write(w, escape, 2);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LISPER_WRITER
+#define LISPER_WRITER
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* bytes a writer holds before it is flushed or grown */
+#define LWRITER_INITIAL_SIZE 65536
+
+/*
+ * Output buffer. Values are rendered into a reusable buffer and handed
+ * to the stream in one piece by lwriter_flush; a writer without a
+ * stream only collects text, as for 'to-string'.
+ */
+struct lwriter {
+    FILE *fp;
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+void lwriter_init(struct lwriter *, FILE *fp);
+void lwriter_destroy(struct lwriter *);
+void lwriter_reserve(struct lwriter *, size_t n);
+void lwriter_flush(struct lwriter *);
+
+void lwriter_write(struct lwriter *, const char *s, size_t n);
+void lwriter_puts(struct lwriter *, const char *s);
+void lwriter_int(struct lwriter *, long long);
+void lwriter_double(struct lwriter *, double);
+void lwriter_escaped(struct lwriter *, const char *s);
+
+static inline void lwriter_putc(struct lwriter *w, char c) {
+    if ( w->len == w->cap ) {
+        lwriter_reserve(w, 1);
+    }
+    w->data[w->len++] = c;
+}
+
+/* the text collected so far, terminated; stays owned by the writer */
+const char *lwriter_cstr(struct lwriter *);
+
+#endif
@@ -0,0 +1,27 @@
+# Runs the lisper program TEST with LISPER and compares what it prints
+# with the file next to it named like it with the extension .out. The
+# program runs on a copy of itself in a directory of its own in the build
+# tree, where it may also write files.
+get_filename_component(dir ${TEST} DIRECTORY)
+get_filename_component(name ${TEST} NAME_WE)
+
+set(work ${CMAKE_CURRENT_BINARY_DIR}/tests/${name})
+file(REMOVE_RECURSE ${work})
+file(MAKE_DIRECTORY ${work})
+file(COPY ${TEST} DESTINATION ${work})
+
+execute_process(
+  COMMAND ${LISPER} ${name}.lspr
+  WORKING_DIRECTORY ${work}
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE output
+  RESULT_VARIABLE result
+)
+file(READ ${dir}/${name}.out expected)
+
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "${name}: exited with ${result}\n${output}")
+endif()
+if (NOT output STREQUAL expected)
+  message(FATAL_ERROR "${name}: output differs\n--- expected\n${expected}--- got\n${output}")
+endif()